@@ -0,0 +1,270 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "FrustumCuller.hpp"
+#include "JobSystem.hpp"
+#include "Runtime.hpp"
+#include "VulkanContext.hpp"
+
+using namespace vesuvio;
+
+// CPU side benchmarks of the engine, GPU work runs headless.
+// Usage: benchmarks [benchmark name], runs all of them without a name.
+// Has to be started from the sample_app directory, the shaders are loaded from its assets
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::chrono::milliseconds::period>(end - start).count();
+}
+
+// A quad with the default material, enough to record real draws
+struct Scene
+{
+	void init(GfxContext* gfxContext) {
+		gfx = gfxContext;
+		const Vertex vertices[] = {
+			{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+			{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+			{{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+			{{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
+		};
+		const uint16_t indices[] = { 0, 1, 2, 2, 3, 0 };
+		vb = gfx->createVertexBuffer(vertices, 4);
+		ib = gfx->createIndexBuffer(indices, 6);
+		material = gfx->createMaterial(TextureHandle());
+	}
+
+	void cleanup() {
+		gfx->destroyMaterial(material);
+		gfx->destroyVertexBuffer(vb);
+		gfx->destroyIndexBuffer(ib);
+	}
+
+	GfxContext* gfx;
+	VertexBufferHandle vb;
+	IndexBufferHandle ib;
+	static constexpr uint32_t INDEX_COUNT = 6;
+	Material* material;
+};
+
+// Renders frameCount headless frames, renderFn records each of them
+static void runFrames(uint32_t frameCount, const std::function<void(GfxContext* gfx, Scene& scene)>& renderFn, const std::function<void(VulkanContext* vulkan)>& reportFn) {
+	Runtime runtime;
+	Runtime::WindowInit window;
+	window.name = "benchmarks";
+	window.width = 640;
+	window.height = 480;
+	window.headless = true;
+	Runtime::GfxInit gfxInit;
+	gfxInit.gfxBackend = GfxContext::GfxBackend::Vulkan;
+	Scene scene;
+	uint32_t frame = 0;
+	runtime.init(window, gfxInit, [&](float) {
+		if (++frame == frameCount) {
+			runtime.requestExit();
+		}
+	}, [&](GfxContext* gfx) {
+		renderFn(gfx, scene);
+	});
+	scene.init(runtime.getGfxContext());
+	runtime.run();
+	reportFn(static_cast<VulkanContext*>(runtime.getGfxContext()));
+	scene.cleanup();
+}
+
+// CPU time of 10k setTransform() + draw() pairs, each one pushes its constants into the uniform ring buffer
+static void benchmarkUniformUpdates() {
+	static constexpr uint32_t FRAME_COUNT = 100;
+	static constexpr uint32_t UPDATE_COUNT = 10000;
+	double totalMs = 0.0;
+	runFrames(FRAME_COUNT, [&](GfxContext* gfx, Scene& scene) {
+		gfx->beginRenderPass(nullptr);
+		gfx->setMaterial(scene.material);
+		gfx->setMeshBuffers(scene.vb, scene.ib);
+		const auto start = Clock::now();
+		for (uint32_t i = 0; i < UPDATE_COUNT; i++) {
+			gfx->setTransform(glm::translate(glm::mat4(1.0f), glm::vec3(0.0001f * i, 0.0f, 0.0f)));
+			gfx->draw(Scene::INDEX_COUNT);
+		}
+		totalMs += elapsedMs(start, Clock::now());
+		gfx->endRenderPass();
+	}, [&](VulkanContext* vulkan) {
+		printf("uniform_updates: %.3f ms per %u constant updates (%llu draws dropped)\n",
+			totalMs / FRAME_COUNT, UPDATE_COUNT, (unsigned long long)vulkan->getDrawStats().droppedDraws);
+	});
+}
+
+// Recording time of 50k draws split across 1, 2, 4 and 8 threads of the runtime's job system.
+// The transform changes every 4th draw, so the constants of a frame fit into the uniform ring buffer
+static void benchmarkParallelRecording() {
+	static constexpr uint32_t FRAME_COUNT = 50;
+	static constexpr uint32_t DRAW_COUNT = 50000;
+	static constexpr uint32_t DRAWS_PER_TRANSFORM = 4;
+	static constexpr uint32_t THREAD_COUNTS[] = { 1, 2, 4, 8 };
+	for (uint32_t threadCount : THREAD_COUNTS) {
+		std::vector<DrawCommand> draws;
+		double totalMs = 0.0;
+		runFrames(FRAME_COUNT, [&](GfxContext* gfx, Scene& scene) {
+			if (draws.empty()) {
+				draws.resize(DRAW_COUNT);
+				for (uint32_t i = 0; i < DRAW_COUNT; i++) {
+					DrawCommand& draw = draws[i];
+					draw.material = scene.material;
+					draw.vertexBuffer = scene.vb;
+					draw.indexBuffer = scene.ib;
+					draw.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0001f * (i / DRAWS_PER_TRANSFORM), 0.0f, 0.0f));
+					draw.indexCount = Scene::INDEX_COUNT;
+					draw.firstIndex = 0;
+					draw.vertexOffset = 0;
+				}
+			}
+			gfx->beginRenderPass(nullptr, true);
+			gfx->drawParallel(draws.data(), DRAW_COUNT, threadCount);
+			gfx->endRenderPass();
+			totalMs += static_cast<VulkanContext*>(gfx)->getDrawStats().lastParallelRecordSeconds * 1000.0;
+		}, [&](VulkanContext* vulkan) {
+			printf("parallel_recording: %u draws on %u threads in %.3f ms (%llu draws dropped)\n",
+				DRAW_COUNT, vulkan->getDrawStats().lastParallelThreadCount, totalMs / FRAME_COUNT,
+				(unsigned long long)vulkan->getDrawStats().droppedDraws);
+		});
+	}
+}
+
+// Each node waits on its two children, so waiting inside a job is exercised on every level
+static void forkJoin(JobSystem& jobSystem, uint32_t depth) {
+	if (depth == 0) {
+		return;
+	}
+	JobCounter counter;
+	jobSystem.run([&jobSystem, depth]() { forkJoin(jobSystem, depth - 1); }, &counter);
+	jobSystem.run([&jobSystem, depth]() { forkJoin(jobSystem, depth - 1); }, &counter);
+	jobSystem.wait(counter);
+}
+
+// Scheduling overhead of the job system: throughput of empty jobs and of a binary fork/join tree
+static void benchmarkJobSystem() {
+	static constexpr uint32_t RUN_COUNT = 10;
+	static constexpr uint32_t EMPTY_JOB_COUNT = 100000;
+	static constexpr uint32_t TREE_DEPTH = 16; // 2^17 - 2 jobs
+	JobSystem jobSystem;
+	jobSystem.init();
+
+	double emptyMs = 0.0;
+	for (uint32_t run = 0; run < RUN_COUNT; run++) {
+		const auto start = Clock::now();
+		JobCounter counter;
+		for (uint32_t i = 0; i < EMPTY_JOB_COUNT; i++) {
+			jobSystem.run([]() {}, &counter);
+		}
+		jobSystem.wait(counter);
+		emptyMs += elapsedMs(start, Clock::now());
+	}
+
+	double treeMs = 0.0;
+	for (uint32_t run = 0; run < RUN_COUNT; run++) {
+		const auto start = Clock::now();
+		forkJoin(jobSystem, TREE_DEPTH);
+		treeMs += elapsedMs(start, Clock::now());
+	}
+
+	const uint32_t treeJobCount = (2u << TREE_DEPTH) - 2;
+	const JobSystem::Stats stats = jobSystem.getStats();
+	printf("job_system: %u workers + main thread\n", jobSystem.getWorkerCount());
+	printf("job_system: %.3f ms per %u empty jobs (%.0f jobs/ms)\n",
+		emptyMs / RUN_COUNT, EMPTY_JOB_COUNT, EMPTY_JOB_COUNT * RUN_COUNT / emptyMs);
+	printf("job_system: %.3f ms per fork/join tree of %u jobs (%.0f jobs/ms)\n",
+		treeMs / RUN_COUNT, treeJobCount, treeJobCount * RUN_COUNT / treeMs);
+	printf("job_system: %llu jobs executed, %llu stolen\n",
+		(unsigned long long)stats.jobsExecuted, (unsigned long long)stats.jobsStolen);
+	jobSystem.shutdown();
+}
+
+// Objects culled per millisecond per core by the scalar, SSE and AVX paths, on the calling thread and on the job system.
+// Levels the CPU doesn't support are skipped, every level has to produce the same visible set
+static void benchmarkFrustumCulling() {
+	static constexpr uint32_t RUN_COUNT = 20;
+	static constexpr uint32_t OBJECT_COUNT = 1000000;
+	static constexpr FrustumCuller::SimdLevel LEVELS[] = { FrustumCuller::SimdLevel::Scalar, FrustumCuller::SimdLevel::Sse, FrustumCuller::SimdLevel::Avx };
+	static const char* LEVEL_NAMES[] = { "scalar", "sse", "avx" };
+
+	FrustumCuller culler;
+	culler.reserve(OBJECT_COUNT);
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+	for (uint32_t i = 0; i < OBJECT_COUNT; i++) {
+		culler.addObject(glm::vec4(position(random), position(random), position(random), radius(random)));
+	}
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+	const Frustum frustum = Frustum::fromViewProjection(projection * view);
+
+	JobSystem jobSystem;
+	jobSystem.init();
+	std::vector<uint32_t> visible;
+	std::vector<uint32_t> referenceVisible;
+	for (uint32_t level = 0; level < 3; level++) {
+		culler.setSimdLevel(LEVELS[level]);
+		if (culler.getSimdLevel() != LEVELS[level]) {
+			printf("frustum_culling: %s not supported, skipped\n", LEVEL_NAMES[level]);
+			continue;
+		}
+		for (JobSystem* parallel : { static_cast<JobSystem*>(nullptr), &jobSystem }) {
+			culler.resetStats();
+			const auto start = Clock::now();
+			for (uint32_t run = 0; run < RUN_COUNT; run++) {
+				culler.cull(frustum, visible, parallel);
+			}
+			const double wallMs = elapsedMs(start, Clock::now()) / RUN_COUNT;
+			printf("frustum_culling: %s %s, %.0f objects/ms per core, %.3f ms per %u objects (%zu visible)\n",
+				LEVEL_NAMES[level], parallel ? "job system" : "single thread",
+				culler.getStats().getObjectsPerMillisecondPerCore(), wallMs, OBJECT_COUNT, visible.size());
+			if (referenceVisible.empty()) {
+				referenceVisible = visible;
+			}
+			else if (visible != referenceVisible) {
+				printf("frustum_culling: %s differs from the first visible set (%zu instead of %zu objects)\n",
+					LEVEL_NAMES[level], visible.size(), referenceVisible.size());
+			}
+		}
+	}
+	jobSystem.shutdown();
+}
+
+struct Benchmark
+{
+	const char* name;
+	void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+	{ "uniform_updates", benchmarkUniformUpdates },
+	{ "parallel_recording", benchmarkParallelRecording },
+	{ "job_system", benchmarkJobSystem },
+	{ "frustum_culling", benchmarkFrustumCulling },
+};
+
+int main(int argc, char** argv) {
+	bool found = false;
+	for (const Benchmark& benchmark : BENCHMARKS) {
+		if (argc < 2 || strcmp(benchmark.name, argv[1]) == 0) {
+			benchmark.run();
+			found = true;
+		}
+	}
+	if (!found) {
+		printf("Unknown benchmark %s, available:\n", argv[1]);
+		for (const Benchmark& benchmark : BENCHMARKS) {
+			printf("  %s\n", benchmark.name);
+		}
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "DescriptorAllocator.hpp"
+
+#include <cassert>
+#include <algorithm>
+
+#include "VulkanContext.hpp"
+#include "Hasher.hpp"
+
+namespace vesuvio {
+
+	namespace {
+		bool isImageDescriptor(vk::DescriptorType type) {
+			return type == vk::DescriptorType::eSampler
+				|| type == vk::DescriptorType::eCombinedImageSampler
+				|| type == vk::DescriptorType::eSampledImage
+				|| type == vk::DescriptorType::eStorageImage
+				|| type == vk::DescriptorType::eInputAttachment;
+		}
+	}
+
+	DescriptorAllocator::DescriptorAllocator()
+	: device()
+	, setsPerPool(0)
+	, freeable(false)
+	, currentPool(0)
+	, stats()
+	, frameCounters()
+	{
+
+	}
+
+	void DescriptorAllocator::create(vk::Device device, const std::vector<PoolSize>& poolSizes, uint32_t setsPerPool, bool freeable) {
+		assert(setsPerPool > 0);
+		this->device = device;
+		this->setsPerPool = setsPerPool;
+		this->freeable = freeable;
+		this->poolSizes.clear();
+		for (const PoolSize& poolSize : poolSizes) {
+			this->poolSizes.push_back(vk::DescriptorPoolSize{ poolSize.type, poolSize.countPerSet * setsPerPool });
+		}
+
+		vk::DescriptorPool pool = createPool();
+		if (pool) {
+			pools.push_back(pool);
+		}
+		currentPool = 0;
+	}
+
+	void DescriptorAllocator::destroy() {
+		if (pools.empty()) {
+			return;
+		}
+
+		printf("Descriptor allocator: %u pools, %llu allocations, %llu updates, %llu cache hits\n",
+			stats.poolCount, (unsigned long long)stats.total.allocations, (unsigned long long)stats.total.updates, (unsigned long long)stats.total.cacheHits);
+
+		for (vk::DescriptorPool pool : pools) {
+			device.destroyDescriptorPool(pool);
+		}
+		pools.clear();
+		setPools.clear();
+		cache.clear();
+		cachedSetHashes.clear();
+		stats.poolCount = 0;
+		stats.cachedSets = 0;
+	}
+
+	vk::DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout) {
+		vk::DescriptorSetAllocateInfo allocInfo{};
+		allocInfo.setSetLayouts(layout);
+		vk::DescriptorSet set;
+
+		// Freed sets can make room in any pool, without freeing only the pools after the current one can have any
+		const size_t poolsToTry = freeable ? pools.size() : pools.size() - currentPool;
+		vk::DescriptorPool pool;
+		for (size_t i = 0; i < poolsToTry && !set; i++) {
+			const size_t poolIndex = (currentPool + i) % pools.size();
+			allocInfo.descriptorPool = pools[poolIndex];
+			vk::Result result = device.allocateDescriptorSets(&allocInfo, &set);
+			if (result == vk::Result::eSuccess) {
+				currentPool = poolIndex;
+				pool = pools[poolIndex];
+			}
+			else {
+				// Usually out of pool memory or fragmented, other errors are retried with a new pool as well
+				set = nullptr;
+			}
+		}
+		if (!set) {
+			pool = createPool();
+			if (!pool) {
+				return nullptr;
+			}
+			pools.push_back(pool);
+			currentPool = pools.size() - 1;
+			allocInfo.descriptorPool = pool;
+			vk::Result result = device.allocateDescriptorSets(&allocInfo, &set);
+			if (result != vk::Result::eSuccess) {
+				printf("Failed to allocate a descriptor set from a new pool (VkResult %d)\n", static_cast<int>(result));
+				return nullptr;
+			}
+		}
+
+		if (freeable) {
+			setPools[static_cast<VkDescriptorSet>(set)] = pool;
+		}
+		stats.total.allocations++;
+		frameCounters.allocations++;
+		return set;
+	}
+
+	void DescriptorAllocator::free(vk::DescriptorSet set) {
+		assert(freeable);
+		auto setPool = setPools.find(static_cast<VkDescriptorSet>(set));
+		assert(setPool != setPools.end());
+		device.freeDescriptorSets(setPool->second, set);
+		setPools.erase(setPool);
+	}
+
+	vk::DescriptorSet DescriptorAllocator::getSet(vk::DescriptorSetLayout layout, const std::vector<Binding>& bindings) {
+		const uint64_t hash = hashSet(layout, bindings);
+		auto candidates = cache.equal_range(hash);
+		for (auto cached = candidates.first; cached != candidates.second; ++cached) {
+			if (cached->second.layout == layout && sameBindings(cached->second.bindings, bindings)) {
+				cached->second.references++;
+				stats.total.cacheHits++;
+				frameCounters.cacheHits++;
+				return cached->second.set;
+			}
+		}
+
+		vk::DescriptorSet set = allocate(layout);
+		if (!set) {
+			return nullptr;
+		}
+		std::vector<vk::WriteDescriptorSet> descriptorWrites;
+		descriptorWrites.reserve(bindings.size());
+		for (const Binding& binding : bindings) {
+			vk::WriteDescriptorSet descriptorWrite{};
+			descriptorWrite.dstSet = set;
+			descriptorWrite.dstBinding = binding.binding;
+			descriptorWrite.dstArrayElement = 0;
+			descriptorWrite.descriptorType = binding.type;
+			descriptorWrite.descriptorCount = 1;
+			if (isImageDescriptor(binding.type)) {
+				descriptorWrite.pImageInfo = &binding.imageInfo;
+			}
+			else {
+				descriptorWrite.pBufferInfo = &binding.bufferInfo;
+			}
+			descriptorWrites.push_back(descriptorWrite);
+		}
+		device.updateDescriptorSets(descriptorWrites, {});
+		stats.total.updates++;
+		frameCounters.updates++;
+
+		cache.emplace(hash, CachedSet{ layout, bindings, set, 1 });
+		cachedSetHashes.emplace(static_cast<VkDescriptorSet>(set), hash);
+		stats.cachedSets = static_cast<uint32_t>(cache.size());
+		return set;
+	}
+
+	void DescriptorAllocator::release(vk::DescriptorSet set) {
+		auto cachedSetHash = cachedSetHashes.find(static_cast<VkDescriptorSet>(set));
+		assert(cachedSetHash != cachedSetHashes.end());
+		auto candidates = cache.equal_range(cachedSetHash->second);
+		auto cached = std::find_if(candidates.first, candidates.second, [set](const auto& candidate) {
+			return candidate.second.set == set;
+		});
+		assert(cached != candidates.second);
+		if (--cached->second.references > 0) {
+			return;
+		}
+
+		cache.erase(cached);
+		cachedSetHashes.erase(cachedSetHash);
+		stats.cachedSets = static_cast<uint32_t>(cache.size());
+		// Sets of a per frame allocator stay allocated until the reset
+		if (freeable) {
+			free(set);
+		}
+	}
+
+	void DescriptorAllocator::reset() {
+		for (vk::DescriptorPool pool : pools) {
+			device.resetDescriptorPool(pool);
+		}
+		currentPool = 0;
+		setPools.clear();
+		cache.clear();
+		cachedSetHashes.clear();
+		stats.cachedSets = 0;
+	}
+
+	void DescriptorAllocator::nextFrame() {
+		stats.lastFrame = frameCounters;
+		frameCounters = Counters{};
+	}
+
+	vk::DescriptorPool DescriptorAllocator::createPool() {
+		vk::DescriptorPoolCreateInfo poolInfo{};
+		if (freeable) {
+			poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+		}
+		poolInfo.setPoolSizes(poolSizes);
+		poolInfo.maxSets = setsPerPool;
+		vk::DescriptorPool pool;
+		vk::Result result = device.createDescriptorPool(&poolInfo, nullptr, &pool);
+		if (result != vk::Result::eSuccess) {
+			printf("Failed to create a descriptor pool (VkResult %d)\n", static_cast<int>(result));
+			return nullptr;
+		}
+		stats.poolCount++;
+		return pool;
+	}
+
+	uint64_t DescriptorAllocator::hashSet(vk::DescriptorSetLayout layout, const std::vector<Binding>& bindings) {
+		Hasher hasher;
+		hasher.add(static_cast<VkDescriptorSetLayout>(layout));
+		for (const Binding& binding : bindings) {
+			hasher.add(binding.binding);
+			hasher.add(binding.type);
+			if (isImageDescriptor(binding.type)) {
+				hasher.add(static_cast<VkSampler>(binding.imageInfo.sampler));
+				hasher.add(static_cast<VkImageView>(binding.imageInfo.imageView));
+				hasher.add(binding.imageInfo.imageLayout);
+			}
+			else {
+				hasher.add(static_cast<VkBuffer>(binding.bufferInfo.buffer));
+				hasher.add(binding.bufferInfo.offset);
+				hasher.add(binding.bufferInfo.range);
+			}
+		}
+		return hasher.value;
+	}
+
+	bool DescriptorAllocator::sameBindings(const std::vector<Binding>& a, const std::vector<Binding>& b) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i].binding != b[i].binding || a[i].type != b[i].type) {
+				return false;
+			}
+			// Only the info which is written for the type counts, like in hashSet()
+			const bool same = isImageDescriptor(a[i].type)
+				? a[i].imageInfo == b[i].imageInfo
+				: a[i].bufferInfo == b[i].bufferInfo;
+			if (!same) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
\ No newline at end of file
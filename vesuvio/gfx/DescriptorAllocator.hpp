@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vesuvio {
+	// Hands out descriptor sets from a chain of pools, another pool is added whenever the current ones run out.
+	// Sets of a persistent allocator are freed one by one, a per frame allocator (one per frame in flight)
+	// has its pools reset as a whole with reset() instead.
+	// Sets requested with getSet() are cached by their layout and bindings, identical requests
+	// return the same set without vkUpdateDescriptorSets and are reference counted until release().
+	class DescriptorAllocator
+	{
+	public:
+		// Descriptors of a type per set, a pool holds setsPerPool times as many
+		struct PoolSize
+		{
+			vk::DescriptorType type;
+			uint32_t countPerSet;
+		};
+
+		// A single descriptor, either buffer or image info is used depending on the type
+		struct Binding
+		{
+			uint32_t binding;
+			vk::DescriptorType type;
+			vk::DescriptorBufferInfo bufferInfo;
+			vk::DescriptorImageInfo imageInfo;
+
+			static Binding buffer(uint32_t binding, vk::DescriptorType type, vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range) {
+				return Binding{ binding, type, vk::DescriptorBufferInfo{ buffer, offset, range }, vk::DescriptorImageInfo{} };
+			}
+			static Binding image(uint32_t binding, vk::DescriptorType type, vk::Sampler sampler, vk::ImageView imageView, vk::ImageLayout layout) {
+				return Binding{ binding, type, vk::DescriptorBufferInfo{}, vk::DescriptorImageInfo{ sampler, imageView, layout } };
+			}
+		};
+
+		struct Counters
+		{
+			uint64_t allocations;
+			uint64_t updates; // vkUpdateDescriptorSets calls
+			uint64_t cacheHits;
+		};
+
+		struct Stats
+		{
+			uint32_t poolCount;
+			uint32_t cachedSets;
+			Counters total;
+			Counters lastFrame; // between the last two nextFrame() calls
+		};
+
+	public:
+		DescriptorAllocator();
+		// freeable allows free() and release(), otherwise sets only go away with reset()
+		void create(vk::Device device, const std::vector<PoolSize>& poolSizes, uint32_t setsPerPool, bool freeable);
+		void destroy();
+
+		// Returns a null set if not even a new pool could provide one (e.g. out of device memory)
+		vk::DescriptorSet allocate(vk::DescriptorSetLayout layout);
+		void free(vk::DescriptorSet set);
+		// Allocates and writes the set on a cache miss, a null set if the allocation failed
+		vk::DescriptorSet getSet(vk::DescriptorSetLayout layout, const std::vector<Binding>& bindings);
+		// Frees a set from getSet() once every request of it has been released
+		void release(vk::DescriptorSet set);
+		// All sets become invalid, the pools are kept for the next allocations
+		void reset();
+
+		void nextFrame();
+		const Stats& getStats() const { return stats; }
+
+	private:
+		vk::DescriptorPool createPool();
+		static uint64_t hashSet(vk::DescriptorSetLayout layout, const std::vector<Binding>& bindings);
+		static bool sameBindings(const std::vector<Binding>& a, const std::vector<Binding>& b);
+
+	private:
+		// The full key is kept, sets with colliding hashes are told apart by comparing it
+		struct CachedSet
+		{
+			vk::DescriptorSetLayout layout;
+			std::vector<Binding> bindings;
+			vk::DescriptorSet set;
+			uint32_t references;
+		};
+
+	private:
+		vk::Device device;
+		std::vector<vk::DescriptorPoolSize> poolSizes;
+		uint32_t setsPerPool;
+		bool freeable;
+		std::vector<vk::DescriptorPool> pools;
+		size_t currentPool; // earlier pools are full until they are reset or sets are freed
+		std::unordered_map<VkDescriptorSet, vk::DescriptorPool> setPools; // only kept if freeable
+		std::unordered_multimap<uint64_t, CachedSet> cache;
+		std::unordered_map<VkDescriptorSet, uint64_t> cachedSetHashes;
+		Stats stats;
+		Counters frameCounters;
+	};
+}
\ No newline at end of file
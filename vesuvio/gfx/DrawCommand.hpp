@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "Handle.hpp"
+
+namespace vesuvio {
+	struct Material;
+
+	// One entry of a draw list which can be recorded in parallel
+	struct DrawCommand
+	{
+		Material* material;
+		VertexBufferHandle vertexBuffer;
+		IndexBufferHandle indexBuffer;
+		glm::mat4 transform;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace vesuvio {
+	// View frustum as six planes (xyz normal pointing inwards, w distance) in the space the matrix maps from.
+	// Same test as the GPU culling shader, so it serves as the CPU reference for it.
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+
+		// Expects clip space depth in [0, 1]. Planes of an infinite far plane degenerate to a zero normal
+		// with a positive distance, they are kept unnormalized and never reject anything
+		static Frustum fromViewProjection(const glm::mat4& viewProj) {
+			// glm is column major, m[column][row]
+			auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+			Frustum frustum{};
+			frustum.planes[0] = row(3) + row(0); // left
+			frustum.planes[1] = row(3) - row(0); // right
+			frustum.planes[2] = row(3) + row(1);
+			frustum.planes[3] = row(3) - row(1);
+			frustum.planes[4] = row(2); // z >= 0
+			frustum.planes[5] = row(3) - row(2); // z <= w
+			for (glm::vec4& plane : frustum.planes) {
+				const float length = glm::length(glm::vec3(plane));
+				if (length > 1e-6f) {
+					plane /= length;
+				}
+			}
+			return frustum;
+		}
+
+		// Bounding sphere (xyz center, w radius) in object space moved into the space of the frustum,
+		// the radius grows with the largest scale of the transform
+		static glm::vec4 transformSphere(const glm::mat4& transform, const glm::vec4& sphere) {
+			const glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f));
+			const float scaleSquared = std::max({
+				glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+				glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+				glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2]))
+			});
+			return glm::vec4(center, sphere.w * std::sqrt(scaleSquared));
+		}
+
+		bool intersectsSphere(const glm::vec4& sphere) const {
+			for (const glm::vec4& plane : planes) {
+				if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// True if the sphere touches a plane within tolerance, where a test with different rounding (e.g. on the GPU) might decide differently
+		bool nearBoundary(const glm::vec4& sphere, float tolerance) const {
+			for (const glm::vec4& plane : planes) {
+				if (std::abs(glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w + sphere.w) <= tolerance) {
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "GeometryArena.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <algorithm>
+
+namespace vesuvio {
+
+	GeometryArena::GeometryArena()
+	: name("")
+	, allocator(nullptr)
+	, usage()
+	, stride(1)
+	, blockCapacity(0)
+	, usedBytes(0)
+	, peakUsedBytes(0)
+	, allocationCount(0)
+	{
+
+	}
+
+	void GeometryArena::create(const char* name, VmaAllocator allocator, vk::BufferUsageFlags usage, uint32_t stride, vk::DeviceSize blockSize, const std::vector<uint32_t>& queueFamilies) {
+		assert(stride > 0);
+		this->name = name;
+		this->allocator = allocator;
+		this->usage = usage | vk::BufferUsageFlagBits::eTransferDst;
+		this->stride = stride;
+		this->blockCapacity = static_cast<uint32_t>(blockSize / stride);
+		this->queueFamilies = queueFamilies;
+		createBlock(blockCapacity);
+	}
+
+	void GeometryArena::destroy() {
+		if (blocks.empty()) {
+			return;
+		}
+		printf("Geometry arena '%s': %u blocks, peak %llu of %llu bytes used, %u allocations left\n",
+			name, static_cast<uint32_t>(blocks.size()), (unsigned long long)peakUsedBytes,
+			(unsigned long long)getStats().capacityBytes, allocationCount);
+
+		for (Block& block : blocks) {
+			// Allocations which were never freed must not keep the virtual block alive
+			vmaClearVirtualBlock(block.virtualBlock);
+			vmaDestroyVirtualBlock(block.virtualBlock);
+			vmaDestroyBuffer(allocator, block.buffer, block.bufferAlloc);
+		}
+		blocks.clear();
+		usedBytes = 0;
+		allocationCount = 0;
+	}
+
+	GeometryArena::Allocation GeometryArena::allocate(uint32_t count) {
+		assert(count > 0);
+
+		VmaVirtualAllocationCreateInfo allocInfo = {};
+		allocInfo.size = count;
+		allocInfo.alignment = 1; // the block is addressed in elements
+
+		Allocation allocation{};
+		VkDeviceSize first = 0;
+		bool found = false;
+		for (uint32_t i = 0; i < blocks.size() && !found; i++) {
+			if (blocks[i].capacity >= count && vmaVirtualAllocate(blocks[i].virtualBlock, &allocInfo, &allocation.handle, &first) == VK_SUCCESS) {
+				allocation.block = i;
+				found = true;
+			}
+		}
+		if (!found) {
+			createBlock(std::max(blockCapacity, count));
+			allocation.block = static_cast<uint32_t>(blocks.size() - 1);
+			VkResult result = vmaVirtualAllocate(blocks.back().virtualBlock, &allocInfo, &allocation.handle, &first);
+			assert(result == VK_SUCCESS);
+		}
+
+		allocation.buffer = blocks[allocation.block].buffer;
+		allocation.first = static_cast<uint32_t>(first);
+		allocation.count = count;
+		allocation.offset = first * stride;
+
+		usedBytes += static_cast<uint64_t>(count) * stride;
+		peakUsedBytes = std::max(peakUsedBytes, usedBytes);
+		allocationCount++;
+		return allocation;
+	}
+
+	void GeometryArena::free(Allocation& allocation) {
+		if (!allocation.handle) {
+			return;
+		}
+		assert(allocation.block < blocks.size());
+		vmaVirtualFree(blocks[allocation.block].virtualBlock, allocation.handle);
+		usedBytes -= static_cast<uint64_t>(allocation.count) * stride;
+		allocationCount--;
+		allocation = Allocation{};
+	}
+
+	GeometryArena::Stats GeometryArena::getStats() const {
+		Stats stats{};
+		stats.blockCount = static_cast<uint32_t>(blocks.size());
+		stats.allocationCount = allocationCount;
+		for (const Block& block : blocks) {
+			stats.capacityBytes += static_cast<uint64_t>(block.capacity) * stride;
+		}
+		stats.usedBytes = usedBytes;
+		stats.peakUsedBytes = peakUsedBytes;
+		return stats;
+	}
+
+	void GeometryArena::createBlock(uint32_t capacity) {
+		Block block{};
+		block.capacity = capacity;
+
+		vk::BufferCreateInfo bufferInfo{};
+		bufferInfo.size = static_cast<vk::DeviceSize>(capacity) * stride;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = queueFamilies.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+		bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		VkResult result = vmaCreateBuffer(allocator, (VkBufferCreateInfo*)&bufferInfo, &allocInfo, (VkBuffer*)&block.buffer, &block.bufferAlloc, nullptr);
+		assert(vk::Result(result) == vk::Result::eSuccess);
+
+		VmaVirtualBlockCreateInfo virtualBlockInfo = {};
+		virtualBlockInfo.size = capacity;
+		result = vmaCreateVirtualBlock(&virtualBlockInfo, &block.virtualBlock);
+		assert(result == VK_SUCCESS);
+
+		blocks.push_back(block);
+		printf("Created geometry arena block '%s' #%u (%llu bytes)\n", name, static_cast<uint32_t>(blocks.size() - 1), (unsigned long long)bufferInfo.size);
+	}
+}
\ No newline at end of file
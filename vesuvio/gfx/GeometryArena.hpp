@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+namespace vesuvio {
+	// Large shared device buffers which geometry is suballocated from, so many meshes can be drawn
+	// without rebinding by passing their first element as firstIndex/vertexOffset.
+	// Space is managed in elements of a fixed stride with a VMA virtual block (TLSF) per buffer,
+	// a new block is added when no existing one has room left.
+	class GeometryArena
+	{
+	public:
+		struct Allocation
+		{
+			vk::Buffer buffer; // of the block the allocation lives in
+			vk::DeviceSize offset; // in bytes from the start of buffer
+			uint32_t first; // in elements, offset / stride
+			uint32_t count;
+			uint32_t block;
+			VmaVirtualAllocation handle;
+		};
+
+		struct Stats
+		{
+			uint32_t blockCount;
+			uint32_t allocationCount;
+			uint64_t capacityBytes;
+			uint64_t usedBytes;
+			uint64_t peakUsedBytes;
+		};
+
+	public:
+		GeometryArena();
+		// Blocks are shared by all given queue families, so uploads need no ownership transfer
+		void create(const char* name, VmaAllocator allocator, vk::BufferUsageFlags usage, uint32_t stride, vk::DeviceSize blockSize, const std::vector<uint32_t>& queueFamilies);
+		void destroy();
+
+		// Allocations larger than the block size get a block of their own
+		Allocation allocate(uint32_t count);
+		void free(Allocation& allocation);
+
+		uint32_t getStride() const { return stride; }
+		Stats getStats() const;
+
+	private:
+		struct Block
+		{
+			vk::Buffer buffer;
+			VmaAllocation bufferAlloc;
+			VmaVirtualBlock virtualBlock;
+			uint32_t capacity; // in elements
+		};
+
+	private:
+		void createBlock(uint32_t capacity);
+
+	private:
+		const char* name;
+		VmaAllocator allocator;
+		vk::BufferUsageFlags usage;
+		uint32_t stride;
+		uint32_t blockCapacity;
+		std::vector<uint32_t> queueFamilies;
+		std::vector<Block> blocks;
+		uint64_t usedBytes;
+		uint64_t peakUsedBytes;
+		uint32_t allocationCount;
+	};
+}
\ No newline at end of file
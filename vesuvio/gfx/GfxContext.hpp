@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <functional>
+#include <vector>
 
 #define VSV_GFX_BACKEND(X) VSV_GFX_BACKEND_##X()
 
@@ -19,11 +21,29 @@
 #define VSV_GFX_BACKEND_D3D12() 0
 #endif
 
+// GPU timestamp scopes, compiled out completely if not enabled
+#if defined(VSV_ENABLE_GPU_PROFILER)
+#define VSV_GPU_PROFILER() 1
+#else
+#define VSV_GPU_PROFILER() 0
+#endif
+
 struct GLFWwindow;
 struct Vertex;
+namespace vesuvio {
+	struct RenderPass;
+	struct Material;
+	class Mesh;
+}
+#include "Handle.hpp"
 #include "VertexBuffer.hpp"
 #include "IndexBuffer.hpp"
 #include "Texture.hpp"
+#include "Material.hpp"
+#include "DrawCommand.hpp"
+#include "InstanceData.hpp"
+#include "ObjectBuffer.hpp"
+#include "GpuScopeTiming.hpp"
 
 namespace vesuvio {
 	class GfxContext
@@ -35,27 +55,114 @@ namespace vesuvio {
 			Vulkan,
 			D3D12,
 		};
+
+		// How finished frames reach the display, unsupported modes fall back to the next one down to Fifo
+		enum class PresentMode
+		{
+			Fifo, // waits for vertical blank, never tears
+			Mailbox, // waits for vertical blank, newer frames replace queued ones
+			Immediate, // no waiting, may tear
+			LowLatency, // Fifo, but a frame only starts once the GPU has finished the previous one
+		};
+
+		struct PresentPolicy
+		{
+			PresentMode mode = PresentMode::Mailbox;
+			uint32_t framesAhead = 0; // how many frames the CPU may record ahead of the GPU, 0 for all frames in flight
+			float targetFrameRate = 0.0f; // frames per second the CPU is paced to, 0 for unlimited
+		};
+	public:
+		// Called with the pixels of a finished headless frame, the data is only valid during the call
+		using ReadbackFunc = std::function<void(const void* pixels, uint32_t width, uint32_t height, uint64_t frame)>;
+		// Runs task(0) ... task(taskCount - 1) concurrently and returns once all of them have finished
+		using ParallelForFunc = std::function<void(uint32_t taskCount, const std::function<void(uint32_t taskIndex)>& task)>;
+		// Upper bound for the instances of all drawInstanced() calls of one frame
+		static constexpr uint32_t MAX_INSTANCES_PER_FRAME = 100000;
 	public:
 		virtual ~GfxContext() {}
 		virtual void init(const char* appName, GLFWwindow* window) = 0;
-		virtual void update() = 0;
+		// Renders into offscreen targets without a window, surface or swap chain
+		virtual void initHeadless(const char* appName, uint32_t width, uint32_t height) = 0;
+		// Starts recording a frame, returns false if no frame could be started (e.g. the swap chain had to be recreated).
+		// Uploads are flushed (and acquired by the graphics queue) here, so buffers, textures and materials created
+		// between beginFrame() and endFrame() must not be drawn before the next frame
+		virtual bool beginFrame() = 0;
+		// Submits (and presents) the frame
+		virtual void endFrame() = 0;
+		// Changing the mode recreates the swap chain at the start of the next frame
+		virtual void setPresentPolicy(const PresentPolicy& policy) = 0;
+		// Blocks until the next frame should start according to the present policy,
+		// input sampled afterwards is as recent as the policy allows
+		virtual void waitForNextFrame() = 0;
+		// Only used in headless mode, frames are read back asynchronously while a callback is set
+		virtual void setReadbackCallback(ReadbackFunc readbackFn) = 0;
 
+		// Buffers and textures are referred to by handles, destroying one with a stale handle is ignored
+		// and draws (or objects of setObjects()) with stale buffer handles are dropped.
+		// All destroy calls (buffers, textures, materials and object buffers) are thread safe and don't stall,
+		// the resource is freed once the frames which might use it have finished
 		//virtual void createBuffer() = 0;
-		virtual VertexBuffer* createVertexBuffer(const Vertex* vertices, uint16_t vertexCount) = 0;
-		virtual void destroyVertexBuffer(VertexBuffer* vertexBuffer) = 0;
-		virtual IndexBuffer* createIndexBuffer(const uint16_t* indices, uint32_t indexCount) = 0;
-		virtual void destroyIndexBuffer(IndexBuffer* indexBuffer) = 0;
-
-		virtual Texture* createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage) = 0;
-		virtual void destroyTexture(Texture* texture) = 0;
-
-		/*
-		beginRenderPass(rp)
-		setMaterial(m)
-		setMeshBuffers(vb, ib)
-		draw(indexCount)
-		endRenderPass()
-		*/
+		virtual VertexBufferHandle createVertexBuffer(const Vertex* vertices, uint32_t vertexCount) = 0;
+		virtual void destroyVertexBuffer(VertexBufferHandle vertexBuffer) = 0;
+		virtual IndexBufferHandle createIndexBuffer(const uint16_t* indices, uint32_t indexCount) = 0;
+		// Stored with 16-bit indices if every index fits
+		virtual IndexBufferHandle createIndexBuffer(const uint32_t* indices, uint32_t indexCount) = 0;
+		virtual void destroyIndexBuffer(IndexBufferHandle indexBuffer) = 0;
+
+		// mipLevels is the number of allocated levels, only level 0 is filled by uploads
+		virtual TextureHandle createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage, uint32_t mipLevels = 1) = 0;
+		virtual void destroyTexture(TextureHandle texture) = 0;
+		// Loads a KTX2/DDS container with its precomputed (and possibly block compressed) mip chain,
+		// any other image is decoded to RGBA8 and gets its mip chain generated on the GPU. Returns an invalid handle on failure
+		virtual TextureHandle loadTexture(const char* fileName) = 0;
+		// Only the low mips of the KTX2/DDS container are resident at first, finer levels are streamed in
+		// once they are requested and evicted again when the texture memory budget is exceeded
+		virtual TextureHandle loadStreamedTexture(const char* fileName) = 0;
+		// Size, format and residency of the texture, nullptr for stale handles
+		virtual const Texture* getTexture(TextureHandle texture) const = 0;
+		// Finest mip level the current frame needs (see Texture::selectMipLevel()), ignored for textures which are not streamed
+		virtual void requestTextureMip(TextureHandle texture, uint32_t mipLevel) = 0;
+		// Upper bound for streamed texture memory in bytes, 0 derives it from the device's memory budget
+		virtual void setTextureBudget(uint64_t bytes) = 0;
+
+		// An invalid albedo handle uses the default texture
+		virtual Material* createMaterial(TextureHandle albedo) = 0;
+		virtual void destroyMaterial(Material* material) = 0;
+
+		// GPU driven draw list of up to capacity objects, returns nullptr if the device can't draw indirectly or out of memory
+		virtual ObjectBuffer* createObjectBuffer(uint32_t capacity) = 0;
+		virtual void destroyObjectBuffer(ObjectBuffer* objectBuffer) = 0;
+		// Replaces all objects, their vertex and index buffers have to share one geometry arena block each.
+		// The new objects are culled and drawn from the next frame on, frames in flight keep the old ones instead of being waited for
+		virtual void setObjects(ObjectBuffer* objectBuffer, const DrawObject* objects, uint32_t objectCount) = 0;
+
+		// Commands are recorded into the current frame, state which is already bound is not bound again.
+		// renderPass nullptr is the main pass which renders into the swap chain (or the offscreen target in headless mode).
+		// A parallel render pass only accepts drawParallel(), everything else is recorded inline.
+		virtual void beginRenderPass(RenderPass* renderPass, bool parallel = false) = 0;
+		virtual void setMaterial(Material* material) = 0;
+		virtual void setMeshBuffers(VertexBufferHandle vertexBuffer, IndexBufferHandle indexBuffer) = 0;
+		// Binds the split streams of the mesh instead of an interleaved vertex buffer
+		virtual void setMesh(Mesh* mesh) = 0;
+		virtual void setTransform(const glm::mat4& model) = 0;
+		// firstIndex and vertexOffset are relative to the bound buffers, which may live anywhere in a shared geometry arena
+		virtual void draw(uint32_t indexCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0) = 0;
+		// Draws the bound vertex and index buffer once per instance, the transform set with setTransform() is ignored.
+		// The instance data is copied into this frame's instance stream right away, which holds MAX_INSTANCES_PER_FRAME instances.
+		// A draw whose instances don't fit into the rest of the stream is dropped, larger scenes have to be split across frames or drawn indirectly
+		virtual void drawInstanced(uint32_t indexCount, const InstanceData* instances, uint32_t instanceCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0) = 0;
+		// Splits the draw list into threadCount parts which are recorded concurrently
+		virtual void drawParallel(const DrawCommand* draws, uint32_t drawCount, uint32_t threadCount) = 0;
+		// Culls the objects against the current camera on the GPU, has to be called outside of a render pass and at most once per frame
+		virtual void cullObjects(ObjectBuffer* objectBuffer) = 0;
+		// Draws the objects which passed cullObjects() in this frame with a single indirect draw
+		virtual void drawObjects(ObjectBuffer* objectBuffer, Material* material) = 0;
+		virtual void endRenderPass() = 0;
+		// Lets the runtime run parallel recording on its own worker threads, by default the parts are recorded one after another on the calling thread
+		virtual void setParallelFor(ParallelForFunc parallelForFn) = 0;
+
+		// Rolling GPU times of the profiled scopes, empty if the GPU profiler is compiled out
+		virtual const std::vector<GpuScopeTiming>& getGpuTimings() const = 0;
 
 		virtual void resizeFramebuffer(uint16_t width, uint16_t height) = 0;
 		virtual GfxBackend getGfxBackend() const = 0;
@@ -10,17 +10,51 @@ namespace vesuvio {
 	public:
 		virtual ~GfxContextNone() {}
 		virtual void init(const char* appName, GLFWwindow* window) override {}
-		virtual void update() override {}
+		virtual void initHeadless(const char* appName, uint32_t width, uint32_t height) override {}
+		virtual bool beginFrame() override { return true; }
+		virtual void endFrame() override {}
+		virtual void setPresentPolicy(const PresentPolicy& policy) override {}
+		virtual void waitForNextFrame() override {}
+		virtual void setReadbackCallback(ReadbackFunc readbackFn) override {}
 
-		VertexBuffer* createVertexBuffer(const Vertex* vertices, uint16_t vertexCount) override { return nullptr; };
-		void destroyVertexBuffer(VertexBuffer* vertexBuffer) override {};
-		IndexBuffer* createIndexBuffer(const uint16_t* indices, uint32_t indexCount) override { return nullptr; };
-		void destroyIndexBuffer(IndexBuffer* vertexBuffer) override {};
+		VertexBufferHandle createVertexBuffer(const Vertex* vertices, uint32_t vertexCount) override { return {}; };
+		void destroyVertexBuffer(VertexBufferHandle vertexBuffer) override {};
+		IndexBufferHandle createIndexBuffer(const uint16_t* indices, uint32_t indexCount) override { return {}; };
+		IndexBufferHandle createIndexBuffer(const uint32_t* indices, uint32_t indexCount) override { return {}; };
+		void destroyIndexBuffer(IndexBufferHandle vertexBuffer) override {};
 
-		Texture* createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage) override { return nullptr; };
-		void destroyTexture(Texture* texture) override {};
+		TextureHandle createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage, uint32_t mipLevels = 1) override { return {}; };
+		void destroyTexture(TextureHandle texture) override {};
+		TextureHandle loadTexture(const char* fileName) override { return {}; };
+		TextureHandle loadStreamedTexture(const char* fileName) override { return {}; };
+		const Texture* getTexture(TextureHandle texture) const override { return nullptr; };
+		void requestTextureMip(TextureHandle texture, uint32_t mipLevel) override {};
+		void setTextureBudget(uint64_t bytes) override {};
+
+		Material* createMaterial(TextureHandle albedo) override { return nullptr; };
+		void destroyMaterial(Material* material) override {};
+
+		ObjectBuffer* createObjectBuffer(uint32_t capacity) override { return nullptr; };
+		void destroyObjectBuffer(ObjectBuffer* objectBuffer) override {};
+		void setObjects(ObjectBuffer* objectBuffer, const DrawObject* objects, uint32_t objectCount) override {};
+
+		void beginRenderPass(RenderPass* renderPass, bool parallel = false) override {};
+		void setMaterial(Material* material) override {};
+		void setMeshBuffers(VertexBufferHandle vertexBuffer, IndexBufferHandle indexBuffer) override {};
+		void setMesh(Mesh* mesh) override {};
+		void setTransform(const glm::mat4& model) override {};
+		void draw(uint32_t indexCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0) override {};
+		void drawInstanced(uint32_t indexCount, const InstanceData* instances, uint32_t instanceCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0) override {};
+		void drawParallel(const DrawCommand* draws, uint32_t drawCount, uint32_t threadCount) override {};
+		void cullObjects(ObjectBuffer* objectBuffer) override {};
+		void drawObjects(ObjectBuffer* objectBuffer, Material* material) override {};
+		void endRenderPass() override {};
+		void setParallelFor(ParallelForFunc parallelForFn) override {};
 
 		virtual GfxBackend getGfxBackend() const override { return GfxContext::GfxBackend::None; }
 		virtual void resizeFramebuffer(uint16_t width, uint16_t height) override {};
+		virtual const std::vector<GpuScopeTiming>& getGpuTimings() const override { return noTimings; }
+	private:
+		const std::vector<GpuScopeTiming> noTimings;
 	};
 }
\ No newline at end of file
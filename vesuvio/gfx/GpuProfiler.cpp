@@ -0,0 +1,173 @@
+#include "GpuProfiler.hpp"
+
+#if VSV_GFX_BACKEND(VULKAN) && VSV_GPU_PROFILER()
+
+#include <cassert>
+#include <algorithm>
+
+namespace vesuvio {
+
+	GpuProfiler::GpuProfiler()
+	: device()
+	, queryPool()
+	, supported(false)
+	, timestampPeriodMs(0.0)
+	, timestampMask(0)
+	, frameIndex(0)
+	, droppedScopes(0)
+	{
+
+	}
+
+	void GpuProfiler::create(vk::Device device, float timestampPeriod, uint32_t timestampValidBits, uint32_t frameCount) {
+		this->device = device;
+		frameScopes.resize(frameCount);
+
+		// Without valid bits the queue does not support timestamps, all scopes become no-ops
+		supported = timestampValidBits > 0;
+		if (!supported) {
+			printf("GPU profiler disabled: graphics queue does not support timestamps\n");
+			return;
+		}
+		timestampPeriodMs = static_cast<double>(timestampPeriod) / 1000000.0;
+		timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (1ull << timestampValidBits) - 1;
+
+		vk::QueryPoolCreateInfo createInfo{};
+		createInfo.queryType = vk::QueryType::eTimestamp;
+		createInfo.queryCount = frameCount * MAX_SCOPES_PER_FRAME * 2;
+		queryPool = device.createQueryPool(createInfo);
+
+		// value + availability for every query of a frame
+		queryResults.resize(MAX_SCOPES_PER_FRAME * 2 * 2);
+
+		printf("Created GPU profiler (%u frames with %u scopes each)\n", frameCount, MAX_SCOPES_PER_FRAME);
+	}
+
+	void GpuProfiler::destroy() {
+		if (queryPool) {
+			device.destroyQueryPool(queryPool);
+			queryPool = nullptr;
+		}
+	}
+
+	void GpuProfiler::beginFrame(vk::CommandBuffer commandBuffer, uint32_t frameIndex) {
+		assert(openScopes.empty());
+		this->frameIndex = frameIndex;
+		if (!supported) {
+			return;
+		}
+
+		collect(frameIndex);
+		frameScopes[frameIndex].clear();
+		commandBuffer.resetQueryPool(queryPool, frameIndex * MAX_SCOPES_PER_FRAME * 2, MAX_SCOPES_PER_FRAME * 2);
+	}
+
+	void GpuProfiler::endFrame() {
+		assert(openScopes.empty() && "GPU scope was not closed");
+	}
+
+	void GpuProfiler::beginScope(vk::CommandBuffer commandBuffer, const char* name) {
+		const uint32_t depth = static_cast<uint32_t>(openScopes.size());
+		const size_t parentPathLength = openPath.size();
+		if (depth > 0) {
+			openPath += '/';
+		}
+		openPath += name;
+
+		// remembers where the path of the parent ends
+		openPathLengths.push_back(parentPathLength);
+
+		std::vector<uint32_t>& scopes = frameScopes[frameIndex];
+		if (scopes.size() == MAX_SCOPES_PER_FRAME) {
+			// Only the nesting is tracked, so the scope can still be closed
+			if (droppedScopes == 0) {
+				printf("More than %u GPU scopes in one frame, the rest are not measured\n", MAX_SCOPES_PER_FRAME);
+			}
+			droppedScopes++;
+			openScopes.push_back(DROPPED_SCOPE);
+			return;
+		}
+		uint32_t scopeIndex = static_cast<uint32_t>(scopes.size());
+		scopes.push_back(findTiming(openPath, depth));
+		openScopes.push_back(scopeIndex);
+
+		if (supported) {
+			commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool, (frameIndex * MAX_SCOPES_PER_FRAME + scopeIndex) * 2);
+		}
+	}
+
+	void GpuProfiler::endScope(vk::CommandBuffer commandBuffer) {
+		assert(!openScopes.empty());
+		uint32_t scopeIndex = openScopes.back();
+		openScopes.pop_back();
+		openPath.resize(openPathLengths.back());
+		openPathLengths.pop_back();
+
+		if (supported && scopeIndex != DROPPED_SCOPE) {
+			commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, (frameIndex * MAX_SCOPES_PER_FRAME + scopeIndex) * 2 + 1);
+		}
+	}
+
+	void GpuProfiler::collect(uint32_t frameIndex) {
+		const std::vector<uint32_t>& scopes = frameScopes[frameIndex];
+		if (scopes.empty()) {
+			return;
+		}
+
+		const uint32_t queryCount = static_cast<uint32_t>(scopes.size()) * 2;
+		// The frame has finished, so this only fails if a scope was never executed.
+		// Not waiting keeps it from ever stalling, unavailable scopes are skipped.
+		vk::Result result = device.getQueryPoolResults(
+			queryPool, frameIndex * MAX_SCOPES_PER_FRAME * 2, queryCount,
+			queryCount * 2 * sizeof(uint64_t), queryResults.data(), 2 * sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability
+		);
+		assert(result == vk::Result::eSuccess || result == vk::Result::eNotReady);
+
+		for (uint32_t i = 0; i < scopes.size(); i++) {
+			const uint64_t* begin = &queryResults[i * 4];
+			const uint64_t* end = &queryResults[i * 4 + 2];
+			if (!begin[1] || !end[1]) {
+				continue;
+			}
+			const double ms = static_cast<double>((end[0] - begin[0]) & timestampMask) * timestampPeriodMs;
+
+			History& history = histories[scopes[i]];
+			if (history.samples.size() < HISTORY_SIZE) {
+				history.samples.push_back(ms);
+			}
+			else {
+				history.samples[history.next] = ms;
+			}
+			history.next = (history.next + 1) % HISTORY_SIZE;
+
+			GpuScopeTiming& timing = timings[scopes[i]];
+			timing.minMs = *std::min_element(history.samples.begin(), history.samples.end());
+			timing.maxMs = *std::max_element(history.samples.begin(), history.samples.end());
+			double sum = 0.0;
+			for (double sample : history.samples) {
+				sum += sample;
+			}
+			timing.avgMs = sum / history.samples.size();
+			timing.sampleCount = static_cast<uint32_t>(history.samples.size());
+		}
+	}
+
+	uint32_t GpuProfiler::findTiming(const std::string& path, uint32_t depth) {
+		auto it = timingLookup.find(path);
+		if (it != timingLookup.end()) {
+			return it->second;
+		}
+
+		uint32_t index = static_cast<uint32_t>(timings.size());
+		GpuScopeTiming timing{};
+		timing.name = path;
+		timing.depth = depth;
+		timings.push_back(timing);
+		histories.emplace_back();
+		timingLookup.emplace(path, index);
+		return index;
+	}
+}
+
+#endif
\ No newline at end of file
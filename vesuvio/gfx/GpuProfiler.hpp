@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "GfxContext.hpp"
+#include "GpuScopeTiming.hpp"
+
+#if VSV_GFX_BACKEND(VULKAN) && VSV_GPU_PROFILER()
+#include <vulkan/vulkan.hpp>
+#endif
+
+namespace vesuvio {
+#if VSV_GFX_BACKEND(VULKAN) && VSV_GPU_PROFILER()
+	// Measures named and nested GPU scopes with timestamp queries.
+	// Every frame in flight has its own range of queries, which is read back once the fence of
+	// that frame has been waited on, so collecting the results never stalls.
+	// Scopes are identified by their path, the results are kept as rolling min/avg/max over the last frames.
+	class GpuProfiler
+	{
+	public:
+		// Closes the scope at the end of the C++ scope
+		class Scope
+		{
+		public:
+			Scope(GpuProfiler& profiler, vk::CommandBuffer commandBuffer, const char* name)
+			: profiler(profiler)
+			, commandBuffer(commandBuffer)
+			{
+				profiler.beginScope(commandBuffer, name);
+			}
+			~Scope() {
+				profiler.endScope(commandBuffer);
+			}
+		private:
+			GpuProfiler& profiler;
+			vk::CommandBuffer commandBuffer;
+		};
+
+	public:
+		GpuProfiler();
+		void create(vk::Device device, float timestampPeriod, uint32_t timestampValidBits, uint32_t frameCount);
+		void destroy();
+
+		// Collects the results of the frame which used this slot before and resets its queries.
+		// Must only be called once the fence of that frame has been signaled, before any scope is recorded.
+		void beginFrame(vk::CommandBuffer commandBuffer, uint32_t frameIndex);
+		void endFrame();
+
+		void beginScope(vk::CommandBuffer commandBuffer, const char* name);
+		void endScope(vk::CommandBuffer commandBuffer);
+
+		const std::vector<GpuScopeTiming>& getTimings() const { return timings; }
+		// Scopes beyond MAX_SCOPES_PER_FRAME in a frame are not measured
+		uint64_t getDroppedScopes() const { return droppedScopes; }
+
+	private:
+		struct History
+		{
+			std::vector<double> samples; // ring of the last HISTORY_SIZE samples
+			uint32_t next = 0;
+		};
+
+	private:
+		void collect(uint32_t frameIndex);
+		uint32_t findTiming(const std::string& path, uint32_t depth);
+
+	private:
+		static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+		static constexpr uint32_t HISTORY_SIZE = 120;
+		static constexpr uint32_t DROPPED_SCOPE = UINT32_MAX;
+
+		vk::Device device;
+		vk::QueryPool queryPool;
+		bool supported;
+		double timestampPeriodMs;
+		uint64_t timestampMask;
+
+		uint32_t frameIndex;
+		// per frame in flight, timing index of every scope recorded, scope i uses the queries 2 * i and 2 * i + 1
+		std::vector<std::vector<uint32_t>> frameScopes;
+		std::vector<uint32_t> openScopes; // indices into frameScopes[frameIndex], DROPPED_SCOPE if the frame had no query left
+		std::string openPath;
+		std::vector<size_t> openPathLengths;
+		std::vector<uint64_t> queryResults;
+		uint64_t droppedScopes;
+
+		std::unordered_map<std::string, uint32_t> timingLookup;
+		std::vector<GpuScopeTiming> timings;
+		std::vector<History> histories;
+	};
+
+#define VSV_GPU_SCOPE_CONCAT_IMPL(a, b) a##b
+#define VSV_GPU_SCOPE_CONCAT(a, b) VSV_GPU_SCOPE_CONCAT_IMPL(a, b)
+#define VSV_GPU_SCOPE(profiler, commandBuffer, name) vesuvio::GpuProfiler::Scope VSV_GPU_SCOPE_CONCAT(gpuScope, __LINE__)(profiler, commandBuffer, name)
+#else
+#define VSV_GPU_SCOPE(profiler, commandBuffer, name)
+#endif
+}
\ No newline at end of file
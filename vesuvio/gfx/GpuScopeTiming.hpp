@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace vesuvio {
+	// Rolling GPU time of a named scope, in milliseconds
+	struct GpuScopeTiming
+	{
+		std::string name; // full path of the scope, e.g. "Frame/MainPass"
+		uint32_t depth;   // 0 for outermost scopes
+		double minMs;
+		double avgMs;
+		double maxMs;
+		uint32_t sampleCount; // number of frames the rolling values are based on
+	};
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace vesuvio {
+	struct VertexBuffer;
+	struct IndexBuffer;
+	struct Texture;
+
+	// Typed reference to a resource in a ResourcePool: the slot index plus the generation the slot had when the
+	// resource was created. Destroying the resource bumps the generation, so stale handles are detected even after
+	// the slot has been reused. Default constructed handles refer to nothing.
+	template<typename T>
+	struct Handle
+	{
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		bool isValid() const { return index != INVALID_INDEX; }
+		bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const Handle& other) const { return !(*this == other); }
+		// Any strict order, e.g. for sorting draws by their resources
+		bool operator<(const Handle& other) const { return index != other.index ? index < other.index : generation < other.generation; }
+
+		static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+	};
+
+	using VertexBufferHandle = Handle<VertexBuffer>;
+	using IndexBufferHandle = Handle<IndexBuffer>;
+	using TextureHandle = Handle<Texture>;
+}
\ No newline at end of file
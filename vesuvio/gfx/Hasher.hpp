@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+namespace vesuvio {
+	// FNV-1a, for the state hashes of the pipeline and descriptor set caches
+	struct Hasher
+	{
+		uint64_t value = 14695981039346656037ull;
+
+		void addBytes(const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++) {
+				value ^= bytes[i];
+				value *= 1099511628211ull;
+			}
+		}
+
+		// Only for types without padding
+		template<typename T>
+		void add(const T& data) {
+			addBytes(&data, sizeof(T));
+		}
+
+		void addString(const char* string) {
+			addBytes(string, string ? strlen(string) : 0);
+			add('\0');
+		}
+	};
+}
\ No newline at end of file
@@ -5,19 +5,21 @@
 #if VSV_GFX_BACKEND(VULKAN)
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
+#include "GeometryArena.hpp"
 #endif
 
 #include "Vertex.hpp"
+#include "IndexType.hpp"
 
 namespace vesuvio {
 	struct IndexBuffer
 	{
-		std::vector<uint16_t> indices;
+		IndexType indexType;
+		uint32_t indexCount;
 #if VSV_GFX_BACKEND(VULKAN)
 		struct
 		{
-			vk::Buffer buffer;
-			VmaAllocation bufferAlloc;
+			GeometryArena::Allocation allocation; // drawn with allocation.first as firstIndex
 		} vk;
 #endif
 	};
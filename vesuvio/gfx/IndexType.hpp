@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace vesuvio {
+	enum class IndexType
+	{
+		Uint16,
+		Uint32,
+	};
+
+	inline uint32_t getIndexSize(IndexType indexType) {
+		return indexType == IndexType::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	// Smallest index type which can address every vertex
+	// (primitive restart is disabled, so 0xFFFF is a regular 16-bit index)
+	inline IndexType selectIndexType(uint32_t vertexCount) {
+		return vertexCount <= 0x10000 ? IndexType::Uint16 : IndexType::Uint32;
+	}
+
+	inline IndexType selectIndexType(const uint32_t* indices, uint32_t indexCount) {
+		const uint32_t maxIndex = indexCount > 0 ? *std::max_element(indices, indices + indexCount) : 0;
+		return selectIndexType(maxIndex + 1);
+	}
+
+	inline std::vector<uint16_t> narrowIndices(const uint32_t* indices, uint32_t indexCount) {
+		return std::vector<uint16_t>(indices, indices + indexCount);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+namespace vesuvio {
+	// Per instance vertex stream of instanced draws, bound to binding 1 next to the interleaved vertices
+	struct InstanceData
+	{
+		glm::mat4 transform;
+		glm::vec4 params; // tints the vertex color in instanced.vert, free for other shaders
+
+		static vk::VertexInputBindingDescription getBindingDescription() {
+			vk::VertexInputBindingDescription bindingDescription{};
+			bindingDescription.binding = 1;
+			bindingDescription.stride = sizeof(InstanceData);
+			bindingDescription.inputRate = vk::VertexInputRate::eInstance;
+
+			return bindingDescription;
+		}
+
+		// Locations 3 to 6 are the columns of the transform, location 7 the params
+		static std::array<vk::VertexInputAttributeDescription, 5> getAttributeDescriptions() {
+			std::array<vk::VertexInputAttributeDescription, 5> attributeDescriptions{};
+
+			for (uint32_t i = 0; i < 4; i++) {
+				attributeDescriptions[i].binding = 1;
+				attributeDescriptions[i].location = 3 + i;
+				attributeDescriptions[i].format = vk::Format::eR32G32B32A32Sfloat;
+				attributeDescriptions[i].offset = offsetof(InstanceData, transform) + sizeof(glm::vec4) * i;
+			}
+
+			attributeDescriptions[4].binding = 1;
+			attributeDescriptions[4].location = 7;
+			attributeDescriptions[4].format = vk::Format::eR32G32B32A32Sfloat;
+			attributeDescriptions[4].offset = offsetof(InstanceData, params);
+
+			return attributeDescriptions;
+		}
+	};
+}
\ No newline at end of file
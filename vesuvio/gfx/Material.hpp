@@ -0,0 +1,22 @@
+#pragma once
+
+#include "GfxContext.hpp"
+
+#if VSV_GFX_BACKEND(VULKAN)
+#include <vulkan/vulkan.hpp>
+#endif
+
+#include "Texture.hpp"
+
+namespace vesuvio {
+	struct Material
+	{
+		Texture* albedo;
+#if VSV_GFX_BACKEND(VULKAN)
+		struct
+		{
+			vk::DescriptorSet descriptorSet;
+		} vk;
+#endif
+	};
+}
\ No newline at end of file
@@ -1,48 +1,108 @@
 #include "Mesh.hpp"
 
 #include "GfxContext.hpp"
+#include "MeshFile.hpp"
+
+#if VSV_GFX_BACKEND(VULKAN)
+#include "VulkanContext.hpp"
+#endif
 
 namespace vesuvio {
 
 	Mesh::Mesh(GfxContext* gfxContext) 
-	: gfxContext(gfxContext)
+	: vertexCount(0)
+	, indexCount(0)
+	, indexType(IndexType::Uint16)
+	, gfxContext(gfxContext)
 	, storage(StorageInfo::Synced)
 	{
-
+#if VSV_GFX_BACKEND(VULKAN)
+		if (gfxContext->getGfxBackend() == GfxContext::GfxBackend::Vulkan) {
+			vkImpl.context = static_cast<VulkanContext*>(gfxContext);
+		}
+#endif
 	}
 
 	Mesh::~Mesh() {
-
+#if VSV_GFX_BACKEND(VULKAN)
+		vkImpl.destroy();
+#endif
 	}
 
-	void Mesh::setData(const glm::vec3* posData, const Remainder* remainderData, uint16_t vertexCount, const uint16_t* indicesData, uint32_t indexCount, StorageInfo storageInfo) {
+	void Mesh::setData(const glm::vec3* posData, const Remainder* remainderData, uint32_t vertexCount, const uint32_t* indicesData, uint32_t indexCount, StorageInfo storageInfo) {
 		storage = storageInfo;
+		this->vertexCount = vertexCount;
+		this->indexCount = indexCount;
+		indexType = selectIndexType(vertexCount);
+		encoding = VertexEncoding();
 
-		pos.clear();
-		remainder.clear();
-		indices.clear();
 		if (storageInfo == StorageInfo::Synced) {
-			pos.reserve(vertexCount);
-			for (uint16_t i = 0; i < vertexCount; i++) {
-				pos.push_back(posData[i]);
-			}
-
-			remainder.reserve(vertexCount);
-			for (uint16_t i = 0; i < vertexCount; i++) {
-				remainder.push_back(remainderData[i]);
-			}
-
-			indices.reserve(indexCount);
-			for (uint32_t i = 0; i < indexCount; i++) {
-				indices.push_back(indicesData[i]);
-			}
+			pos.assign(posData, posData + vertexCount);
+			remainder.assign(remainderData, remainderData + vertexCount);
+			indices.assign(indicesData, indicesData + indexCount);
+		}
+		else {
+			// Release the memory as well
+			std::vector<glm::vec3>().swap(pos);
+			std::vector<Remainder>().swap(remainder);
+			std::vector<uint32_t>().swap(indices);
+		}
+
+		uploadStreams(posData, remainderData, indicesData);
+	}
+
+	void Mesh::setEncodedData(const void* posData, const void* remainderData, uint32_t vertexCount, const VertexEncoding& encoding, const uint32_t* indicesData, uint32_t indexCount) {
+		setGpuOnlyLayout(vertexCount, encoding, indexCount, selectIndexType(vertexCount));
+		uploadStreams(posData, remainderData, indicesData);
+	}
+
+	void Mesh::setEncodedData(const void* posData, const void* remainderData, uint32_t vertexCount, const VertexEncoding& encoding, const void* indexData, uint32_t indexCount, IndexType indexType) {
+		setGpuOnlyLayout(vertexCount, encoding, indexCount, indexType);
+		uploadStreams(posData, remainderData, indexData);
+	}
+
+	void Mesh::setData(const MeshFile& meshFile) {
+		setEncodedData(
+			meshFile.getStreamData(MeshFile::StreamType::Positions),
+			meshFile.getStreamData(MeshFile::StreamType::Remainders),
+			meshFile.getVertexCount(), meshFile.getEncoding(),
+			meshFile.getStreamData(MeshFile::StreamType::Indices),
+			meshFile.getIndexCount(), meshFile.getIndexType()
+		);
+	}
+
+	void Mesh::setGpuOnlyLayout(uint32_t vertexCount, const VertexEncoding& encoding, uint32_t indexCount, IndexType indexType) {
+		storage = StorageInfo::GpuOnly;
+		this->vertexCount = vertexCount;
+		this->indexCount = indexCount;
+		this->encoding = encoding;
+		this->indexType = indexType;
+
+		std::vector<glm::vec3>().swap(pos);
+		std::vector<Remainder>().swap(remainder);
+		std::vector<uint32_t>().swap(indices);
+	}
+
+	void Mesh::uploadStreams(const void* posData, const void* remainderData, const uint32_t* indicesData) {
+		if (indexType == IndexType::Uint16) {
+			const std::vector<uint16_t> narrowed = narrowIndices(indicesData, indexCount);
+			uploadStreams(posData, remainderData, static_cast<const void*>(narrowed.data()));
 		}
+		else {
+			uploadStreams(posData, remainderData, static_cast<const void*>(indicesData));
+		}
+	}
+
+	void Mesh::uploadStreams(const void* posData, const void* remainderData, const void* indexData) {
+		const size_t posSize = static_cast<size_t>(encoding.getPositionStride()) * vertexCount;
+		const size_t remainderSize = static_cast<size_t>(encoding.getRemainderStride()) * vertexCount;
+		const size_t indexSize = static_cast<size_t>(getIndexSize(indexType)) * indexCount;
 
 		switch(gfxContext->getGfxBackend())
 		{
 #if VSV_GFX_BACKEND(VULKAN)
 			case GfxContext::GfxBackend::Vulkan:
-				vkImpl.setData(posData, remainderData, vertexCount, indicesData, indexCount, storageInfo);
+				vkImpl.setData(posData, posSize, remainderData, remainderSize, indexData, indexSize, indexType);
 				break;
 #endif
 			default:
@@ -50,43 +110,81 @@ namespace vesuvio {
 		}
 	}
 
-	void Mesh::VulkanImpl::setData(const glm::vec3* posData, const Remainder* remainderData, uint16_t vertexCount, const uint16_t* indicesData, uint32_t indexCount, StorageInfo storageInfo) {
+#if VSV_GFX_BACKEND(VULKAN)
+	void Mesh::VulkanImpl::setData(const void* posData, vk::DeviceSize posSize, const void* remainderData, vk::DeviceSize remainderSize, const void* indexData, vk::DeviceSize indexSize, IndexType indexType) {
+		destroy();
+		this->indexType = indexType;
+
+		// The data is copied straight from the caller (or a file mapping) into staging memory, the CPU copies are not involved
+		posAllocation = context->uploadGeometry(context->getStreamArena(), posData, posSize);
+		remainderAllocation = context->uploadGeometry(context->getStreamArena(), remainderData, remainderSize);
+		indexAllocation = context->uploadGeometry(context->getIndexArena(indexType), indexData, indexSize);
+	}
 
+	void Mesh::VulkanImpl::destroy() {
+		if (posAllocation.buffer) {
+			context->freeGeometry(context->getStreamArena(), posAllocation);
+			context->freeGeometry(context->getStreamArena(), remainderAllocation);
+			context->freeGeometry(context->getIndexArena(indexType), indexAllocation);
+		}
 	}
 
-	inline std::array<vk::VertexInputBindingDescription, 2> Mesh::getBindingDescriptions() {
-		std::array<vk::VertexInputBindingDescription, 2> bindingDescriptions{};
-		bindingDescriptions[0].binding = 0;
-		bindingDescriptions[0].stride = sizeof(pos);
-		bindingDescriptions[0].inputRate = vk::VertexInputRate::eVertex;
+	static vk::Format getPositionFormat(VertexEncoding::Position position) {
+		return position == VertexEncoding::Position::Float16 ? vk::Format::eR16G16B16A16Sfloat : vk::Format::eR32G32B32Sfloat;
+	}
 
+	static vk::Format getColorFormat(VertexEncoding::Color color) {
+		return color == VertexEncoding::Color::Unorm8 ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR32G32B32Sfloat;
+	}
+
+	static vk::Format getTexCoordFormat(VertexEncoding::TexCoord texCoord) {
+		return texCoord == VertexEncoding::TexCoord::Unorm16 ? vk::Format::eR16G16Unorm : vk::Format::eR32G32Sfloat;
+	}
+
+	std::array<vk::VertexInputBindingDescription, 2> Mesh::getBindingDescriptions(const VertexEncoding& encoding) {
+		std::array<vk::VertexInputBindingDescription, 2> bindingDescriptions{};
+		bindingDescriptions[0] = getPositionBindingDescription(encoding);
 
-		vk::VertexInputBindingDescription bindingDescriptionRemainder{};
 		bindingDescriptions[1].binding = 1;
-		bindingDescriptions[1].stride = sizeof(Remainder);
+		bindingDescriptions[1].stride = encoding.getRemainderStride();
 		bindingDescriptions[1].inputRate = vk::VertexInputRate::eVertex;
 
 		return bindingDescriptions;
 	}
 
-	inline std::array<vk::VertexInputAttributeDescription, 3> Mesh::getAttributeDescriptions() {
+	std::array<vk::VertexInputAttributeDescription, 3> Mesh::getAttributeDescriptions(const VertexEncoding& encoding) {
 		std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions{};
 
-		attributeDescriptions[0].binding = 1;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = vk::Format::eR32G32B32Sfloat;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
+		attributeDescriptions[0] = getPositionAttributeDescription(encoding);
 
-		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].binding = 1;
 		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = vk::Format::eR32G32B32Sfloat;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+		attributeDescriptions[1].format = getColorFormat(encoding.color);
+		attributeDescriptions[1].offset = 0;
 
-		attributeDescriptions[2].binding = 0;
+		attributeDescriptions[2].binding = 1;
 		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = vk::Format::eR32G32Sfloat;
-		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+		attributeDescriptions[2].format = getTexCoordFormat(encoding.texCoord);
+		attributeDescriptions[2].offset = encoding.getColorSize();
 
 		return attributeDescriptions;
 	}
+
+	vk::VertexInputBindingDescription Mesh::getPositionBindingDescription(const VertexEncoding& encoding) {
+		vk::VertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = encoding.getPositionStride();
+		bindingDescription.inputRate = vk::VertexInputRate::eVertex;
+		return bindingDescription;
+	}
+
+	vk::VertexInputAttributeDescription Mesh::getPositionAttributeDescription(const VertexEncoding& encoding) {
+		vk::VertexInputAttributeDescription attributeDescription{};
+		attributeDescription.binding = 0;
+		attributeDescription.location = 0;
+		attributeDescription.format = getPositionFormat(encoding.position);
+		attributeDescription.offset = 0;
+		return attributeDescription;
+	}
+#endif
 }
\ No newline at end of file
@@ -4,45 +4,99 @@
 
 #if VSV_GFX_BACKEND(VULKAN)
 #include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+#include "GeometryArena.hpp"
 #endif
 
 #include "Vertex.hpp"
+#include "IndexType.hpp"
+#include "VertexEncoding.hpp"
 
 namespace vesuvio {
 	class GfxContext;
+	class VulkanContext;
+	class MeshFile;
 
+	// Vertex data split into a position stream and a stream with the remaining attributes,
+	// so passes which only need positions (depth prepass, shadows) read less memory per vertex.
+	// Every stream lives in its own GPU buffer.
 	class Mesh
 	{
+	public:
 		enum class StorageInfo
 		{
 			Synced, // mesh data will be present on CPU and GPU side and can be modified
 			GpuOnly, // mesh data is only present on GPU and cannot be easily modified
 		};
 
-		std::vector<glm::vec3> pos;
 		struct Remainder {
 			glm::vec3 color;
 			glm::vec2 texCoord;
 		};
-		std::vector<Remainder> remainder;
-		std::vector<uint16_t> indices;
 
+	public:
 		Mesh(GfxContext* gfxContext);
 		~Mesh();
 
-		static std::array<vk::VertexInputBindingDescription, 2> getBindingDescriptions();
-		static std::array<vk::VertexInputAttributeDescription, 3> getAttributeDescriptions();
-		// void create(const glm::vec3* posData, uint16_t posCount);
-		void setData(const glm::vec3* posData, const Remainder* remainderData, uint16_t vertexCount, const uint16_t* indicesData, uint32_t indexCount, StorageInfo storageInfo);
+#if VSV_GFX_BACKEND(VULKAN)
+		// binding 0: positions, binding 1: remainder
+		static std::array<vk::VertexInputBindingDescription, 2> getBindingDescriptions(const VertexEncoding& encoding = VertexEncoding());
+		static std::array<vk::VertexInputAttributeDescription, 3> getAttributeDescriptions(const VertexEncoding& encoding = VertexEncoding());
+		// Position stream only
+		static vk::VertexInputBindingDescription getPositionBindingDescription(const VertexEncoding& encoding = VertexEncoding());
+		static vk::VertexInputAttributeDescription getPositionAttributeDescription(const VertexEncoding& encoding = VertexEncoding());
+#endif
+
+		// Indices are stored with 16 bits on the GPU if vertexCount allows it
+		void setData(const glm::vec3* posData, const Remainder* remainderData, uint32_t vertexCount, const uint32_t* indicesData, uint32_t indexCount, StorageInfo storageInfo);
+		// Streams which are already laid out in the given encoding (see processMesh()), always StorageInfo::GpuOnly
+		void setEncodedData(const void* posData, const void* remainderData, uint32_t vertexCount, const VertexEncoding& encoding, const uint32_t* indicesData, uint32_t indexCount);
+		// Index data which already has the given type, nothing is converted on the way to the staging memory
+		void setEncodedData(const void* posData, const void* remainderData, uint32_t vertexCount, const VertexEncoding& encoding, const void* indexData, uint32_t indexCount, IndexType indexType);
+		// Uploads straight from the file mapping, the file can be closed afterwards
+		void setData(const MeshFile& meshFile);
 
-	private:
+		// Empty with StorageInfo::GpuOnly
+		const std::vector<glm::vec3>& getPositions() const { return pos; }
+		const std::vector<Remainder>& getRemainders() const { return remainder; }
+		const std::vector<uint32_t>& getIndices() const { return indices; }
+		uint32_t getVertexCount() const { return vertexCount; }
+		uint32_t getIndexCount() const { return indexCount; }
+		IndexType getIndexType() const { return indexType; }
+		const VertexEncoding& getEncoding() const { return encoding; }
+		StorageInfo getStorageInfo() const { return storage; }
 
+#if VSV_GFX_BACKEND(VULKAN)
 		struct VulkanImpl
 		{
-			vk::Buffer posBuffer;
-			vk::Buffer remainderBuffer;
-			void setData(const glm::vec3* posData, const Remainder* remainderData, uint16_t vertexCount, const uint16_t* indicesData, uint32_t indexCount, StorageInfo storageInfo);
+			VulkanContext* context = nullptr;
+			// The streams are bound at their byte offsets, the indices are drawn from allocation.first on
+			GeometryArena::Allocation posAllocation{};
+			GeometryArena::Allocation remainderAllocation{};
+			GeometryArena::Allocation indexAllocation{};
+			IndexType indexType = IndexType::Uint16;
+
+			void setData(const void* posData, vk::DeviceSize posSize, const void* remainderData, vk::DeviceSize remainderSize, const void* indexData, vk::DeviceSize indexSize, IndexType indexType);
+			void destroy();
 		};
+		const VulkanImpl& getVulkanImpl() const { return vkImpl; }
+#endif
+
+	private:
+		void setGpuOnlyLayout(uint32_t vertexCount, const VertexEncoding& encoding, uint32_t indexCount, IndexType indexType);
+		// Narrows the indices if indexType is IndexType::Uint16
+		void uploadStreams(const void* posData, const void* remainderData, const uint32_t* indicesData);
+		void uploadStreams(const void* posData, const void* remainderData, const void* indexData);
+
+	private:
+		std::vector<glm::vec3> pos;
+		std::vector<Remainder> remainder;
+		std::vector<uint32_t> indices;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		IndexType indexType;
+		VertexEncoding encoding;
+
 #if VSV_GFX_BACKEND(VULKAN)
 		VulkanImpl vkImpl;
 #endif
@@ -0,0 +1,264 @@
+#include "MeshFile.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MeshProcessing.hpp"
+
+namespace vesuvio {
+
+	MappedFile::MappedFile()
+	: data(nullptr)
+	, size(0)
+#if defined(_WIN32)
+	, fileHandle(INVALID_HANDLE_VALUE)
+	, mappingHandle(nullptr)
+#else
+	, fileDescriptor(-1)
+#endif
+	{
+
+	}
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+	bool MappedFile::open(const std::string& fileName) {
+		close();
+#if defined(_WIN32)
+		fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+			close();
+			return false;
+		}
+		size = static_cast<uint64_t>(fileSize.QuadPart);
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mappingHandle) {
+			close();
+			return false;
+		}
+		data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+		fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) {
+			return false;
+		}
+		struct stat fileStat;
+		if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+			close();
+			return false;
+		}
+		size = static_cast<uint64_t>(fileStat.st_size);
+		void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapping != MAP_FAILED) {
+			// The whole file is read front to back by the upload, start the read ahead right away
+			madvise(mapping, size, MADV_SEQUENTIAL);
+			madvise(mapping, size, MADV_WILLNEED);
+			data = static_cast<const uint8_t*>(mapping);
+		}
+#endif
+		if (!data) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::close() {
+#if defined(_WIN32)
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mappingHandle) {
+			CloseHandle(mappingHandle);
+			mappingHandle = nullptr;
+		}
+		if (fileHandle != INVALID_HANDLE_VALUE) {
+			CloseHandle(fileHandle);
+			fileHandle = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (data) {
+			munmap(const_cast<uint8_t*>(data), size);
+		}
+		if (fileDescriptor >= 0) {
+			::close(fileDescriptor);
+			fileDescriptor = -1;
+		}
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	MeshFile::MeshFile()
+	: file()
+	, header(nullptr)
+	, streams(nullptr)
+	, loadStats()
+	{
+
+	}
+
+	bool MeshFile::open(const std::string& fileName) {
+		close();
+		auto start = std::chrono::high_resolution_clock::now();
+
+		if (!file.open(fileName)) {
+			printf("Mesh file '%s' could not be opened\n", fileName.data());
+			return false;
+		}
+		if (!validate(fileName)) {
+			file.close();
+			return false;
+		}
+		header = reinterpret_cast<const Header*>(file.getData());
+		streams = reinterpret_cast<const StreamDescriptor*>(file.getData() + sizeof(Header));
+
+		auto end = std::chrono::high_resolution_clock::now();
+		loadStats.bytesMapped = file.getSize();
+		loadStats.openSeconds = std::chrono::duration<double, std::chrono::seconds::period>(end - start).count();
+		return true;
+	}
+
+	void MeshFile::close() {
+		file.close();
+		header = nullptr;
+		streams = nullptr;
+	}
+
+	bool MeshFile::validate(const std::string& fileName) const {
+		const uint8_t* data = file.getData();
+		const uint64_t size = file.getSize();
+		if (size < sizeof(Header) + sizeof(StreamDescriptor) * STREAM_COUNT) {
+			printf("Mesh file '%s' is truncated\n", fileName.data());
+			return false;
+		}
+
+		const Header* fileHeader = reinterpret_cast<const Header*>(data);
+		if (fileHeader->magic != MAGIC || fileHeader->version != VERSION || fileHeader->streamCount != STREAM_COUNT) {
+			printf("Mesh file '%s' has an unsupported format (version %u, expected %u)\n", fileName.data(), fileHeader->version, VERSION);
+			return false;
+		}
+		if (fileHeader->indexType > static_cast<uint8_t>(IndexType::Uint32)
+			|| fileHeader->positionEncoding > static_cast<uint8_t>(VertexEncoding::Position::Float16)
+			|| fileHeader->colorEncoding > static_cast<uint8_t>(VertexEncoding::Color::Unorm8)
+			|| fileHeader->texCoordEncoding > static_cast<uint8_t>(VertexEncoding::TexCoord::Unorm16)) {
+			printf("Mesh file '%s' has an invalid stream layout\n", fileName.data());
+			return false;
+		}
+
+		VertexEncoding encoding;
+		encoding.position = static_cast<VertexEncoding::Position>(fileHeader->positionEncoding);
+		encoding.color = static_cast<VertexEncoding::Color>(fileHeader->colorEncoding);
+		encoding.texCoord = static_cast<VertexEncoding::TexCoord>(fileHeader->texCoordEncoding);
+		const uint64_t expectedSizes[STREAM_COUNT] = {
+			static_cast<uint64_t>(encoding.getPositionStride()) * fileHeader->vertexCount,
+			static_cast<uint64_t>(encoding.getRemainderStride()) * fileHeader->vertexCount,
+			static_cast<uint64_t>(getIndexSize(static_cast<IndexType>(fileHeader->indexType))) * fileHeader->indexCount,
+		};
+
+		const StreamDescriptor* fileStreams = reinterpret_cast<const StreamDescriptor*>(data + sizeof(Header));
+		for (uint32_t i = 0; i < STREAM_COUNT; i++) {
+			const StreamDescriptor& stream = fileStreams[i];
+			if (stream.type != i || stream.size != expectedSizes[i] || stream.offset % STREAM_ALIGNMENT != 0
+				|| stream.offset > size || stream.size > size - stream.offset) {
+				printf("Mesh file '%s' has an invalid stream descriptor %u\n", fileName.data(), i);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	VertexEncoding MeshFile::getEncoding() const {
+		VertexEncoding encoding;
+		encoding.position = static_cast<VertexEncoding::Position>(header->positionEncoding);
+		encoding.color = static_cast<VertexEncoding::Color>(header->colorEncoding);
+		encoding.texCoord = static_cast<VertexEncoding::TexCoord>(header->texCoordEncoding);
+		return encoding;
+	}
+
+	const void* MeshFile::getStreamData(StreamType type) const {
+		return file.getData() + streams[static_cast<uint32_t>(type)].offset;
+	}
+
+	bool MeshFile::write(const std::string& fileName, const ProcessedMesh& mesh) {
+		const IndexType indexType = selectIndexType(mesh.vertexCount);
+		const uint32_t indexCount = static_cast<uint32_t>(mesh.indices.size());
+		std::vector<uint16_t> narrowedIndices;
+		const void* indexData = mesh.indices.data();
+		if (indexType == IndexType::Uint16) {
+			narrowedIndices = narrowIndices(mesh.indices.data(), indexCount);
+			indexData = narrowedIndices.data();
+		}
+
+		Header fileHeader{};
+		fileHeader.magic = MAGIC;
+		fileHeader.version = VERSION;
+		fileHeader.vertexCount = mesh.vertexCount;
+		fileHeader.indexCount = indexCount;
+		fileHeader.indexType = static_cast<uint8_t>(indexType);
+		fileHeader.positionEncoding = static_cast<uint8_t>(mesh.encoding.position);
+		fileHeader.colorEncoding = static_cast<uint8_t>(mesh.encoding.color);
+		fileHeader.texCoordEncoding = static_cast<uint8_t>(mesh.encoding.texCoord);
+		fileHeader.streamCount = STREAM_COUNT;
+		for (uint32_t i = 0; i < 3; i++) {
+			fileHeader.boundsMin[i] = mesh.boundsMin[i];
+			fileHeader.boundsMax[i] = mesh.boundsMax[i];
+		}
+
+		const void* streamData[STREAM_COUNT] = { mesh.positions.data(), mesh.remainders.data(), indexData };
+		StreamDescriptor fileStreams[STREAM_COUNT] = {
+			{ static_cast<uint32_t>(StreamType::Positions), mesh.encoding.getPositionStride(), 0, mesh.positions.size() },
+			{ static_cast<uint32_t>(StreamType::Remainders), mesh.encoding.getRemainderStride(), 0, mesh.remainders.size() },
+			{ static_cast<uint32_t>(StreamType::Indices), getIndexSize(indexType), 0, static_cast<uint64_t>(getIndexSize(indexType)) * indexCount },
+		};
+		uint64_t offset = sizeof(Header) + sizeof(fileStreams);
+		for (StreamDescriptor& stream : fileStreams) {
+			offset = (offset + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+			stream.offset = offset;
+			offset += stream.size;
+		}
+
+		std::ofstream output(fileName, std::ios::binary | std::ios::trunc);
+		if (!output.is_open()) {
+			printf("Mesh file '%s' could not be created\n", fileName.data());
+			return false;
+		}
+		output.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+		output.write(reinterpret_cast<const char*>(fileStreams), sizeof(fileStreams));
+
+		const char padding[STREAM_ALIGNMENT] = {};
+		uint64_t written = sizeof(Header) + sizeof(fileStreams);
+		for (uint32_t i = 0; i < STREAM_COUNT; i++) {
+			output.write(padding, static_cast<std::streamsize>(fileStreams[i].offset - written));
+			output.write(static_cast<const char*>(streamData[i]), static_cast<std::streamsize>(fileStreams[i].size));
+			written = fileStreams[i].offset + fileStreams[i].size;
+		}
+
+		const bool success = output.good();
+		if (!success) {
+			printf("Mesh file '%s' could not be written\n", fileName.data());
+		}
+		return success;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "IndexType.hpp"
+#include "VertexEncoding.hpp"
+
+namespace vesuvio {
+	struct ProcessedMesh;
+
+	// Read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& fileName);
+		void close();
+
+		const uint8_t* getData() const { return data; }
+		uint64_t getSize() const { return size; }
+
+	private:
+		const uint8_t* data;
+		uint64_t size;
+#if defined(_WIN32)
+		void* fileHandle;
+		void* mappingHandle;
+#else
+		int fileDescriptor;
+#endif
+	};
+
+	// Binary mesh container (.vsm) which is laid out to be uploaded straight from a file mapping:
+	// Header | StreamDescriptor[STREAM_COUNT] | streams, every stream starts at a STREAM_ALIGNMENT boundary.
+	// Streams are stored in their final GPU layout (vertex encoding and index type), so loading is
+	// mapping the file and handing the stream pointers to Mesh::setData(const MeshFile&).
+	class MeshFile
+	{
+	public:
+		static const uint32_t MAGIC = 0x464D5356; // "VSMF"
+		static const uint32_t VERSION = 1;
+		static const uint64_t STREAM_ALIGNMENT = 64;
+
+		enum class StreamType : uint32_t
+		{
+			Positions,
+			Remainders,
+			Indices,
+		};
+		static const uint32_t STREAM_COUNT = 3;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint8_t indexType; // IndexType
+			uint8_t positionEncoding; // VertexEncoding::Position
+			uint8_t colorEncoding; // VertexEncoding::Color
+			uint8_t texCoordEncoding; // VertexEncoding::TexCoord
+			uint32_t streamCount;
+			float boundsMin[3];
+			float boundsMax[3];
+		};
+
+		struct StreamDescriptor
+		{
+			uint32_t type; // StreamType
+			uint32_t stride;
+			uint64_t offset; // from the start of the file
+			uint64_t size;
+		};
+
+		struct LoadStats
+		{
+			uint64_t bytesMapped;
+			double openSeconds; // mapping and validation, the pages are faulted in by the upload
+		};
+
+	public:
+		MeshFile();
+
+		// Returns false if the file is missing or not a valid mesh file of this version
+		bool open(const std::string& fileName);
+		void close();
+
+		static bool write(const std::string& fileName, const ProcessedMesh& mesh);
+
+		uint32_t getVertexCount() const { return header->vertexCount; }
+		uint32_t getIndexCount() const { return header->indexCount; }
+		IndexType getIndexType() const { return static_cast<IndexType>(header->indexType); }
+		VertexEncoding getEncoding() const;
+		glm::vec3 getBoundsMin() const { return glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]); }
+		glm::vec3 getBoundsMax() const { return glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]); }
+
+		// Points into the file mapping, valid until close()
+		const void* getStreamData(StreamType type) const;
+		uint64_t getStreamSize(StreamType type) const { return streams[static_cast<uint32_t>(type)].size; }
+
+		const LoadStats& getLoadStats() const { return loadStats; }
+
+	private:
+		bool validate(const std::string& fileName) const;
+
+	private:
+		MappedFile file;
+		const Header* header;
+		const StreamDescriptor* streams;
+		LoadStats loadStats;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include "MeshProcessing.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/gtc/packing.hpp>
+
+namespace vesuvio {
+
+	namespace {
+		// Scoring parameters from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+		const uint32_t FORSYTH_CACHE_SIZE = 32;
+		const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+		const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+		const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+		const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+		// Clusters below this size are not worth reordering
+		const uint32_t MIN_CLUSTER_TRIANGLES = 16;
+		const uint32_t UNUSED_VERTEX = UINT32_MAX;
+
+		float forsythVertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+			if (remainingTriangles == 0) {
+				return -1.0f;
+			}
+
+			float score = 0.0f;
+			if (cachePosition >= 0) {
+				if (cachePosition < 3) {
+					// Used by the last triangle, a fixed score keeps the algorithm from favouring strips
+					score = FORSYTH_LAST_TRIANGLE_SCORE;
+				}
+				else {
+					const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+					score = powf(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+				}
+			}
+
+			// Vertices with few remaining triangles are finished first so they drop out of the working set
+			score += FORSYTH_VALENCE_BOOST_SCALE * powf(static_cast<float>(remainingTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+			return score;
+		}
+
+		template<typename T>
+		void remapStream(std::vector<T>& destination, const T* source, const std::vector<uint32_t>& remap, uint32_t usedVertexCount) {
+			destination.resize(usedVertexCount);
+			for (size_t i = 0; i < remap.size(); i++) {
+				if (remap[i] != UNUSED_VERTEX) {
+					destination[remap[i]] = source[i];
+				}
+			}
+		}
+	}
+
+	void MeshProcessingReport::print() const {
+		printf("Mesh processing: %u -> %u vertices, %u -> %u bytes per vertex, ACMR %.3f -> %.3f\n",
+			   vertexCountBefore, vertexCountAfter, bytesPerVertexBefore, bytesPerVertexAfter, acmrBefore, acmrAfter);
+	}
+
+	ProcessedMesh processMesh(const glm::vec3* positions, const Mesh::Remainder* remainders, uint32_t vertexCount,
+							  const uint32_t* indices, uint32_t indexCount,
+							  const MeshProcessingSettings& settings, MeshProcessingReport* report) {
+		assert(indexCount % 3 == 0);
+
+		ProcessedMesh mesh;
+		mesh.encoding = settings.encoding;
+		mesh.boundsMin = vertexCount > 0 ? positions[0] : glm::vec3(0.0f);
+		mesh.boundsMax = mesh.boundsMin;
+		for (uint32_t v = 1; v < vertexCount; v++) {
+			mesh.boundsMin = glm::min(mesh.boundsMin, positions[v]);
+			mesh.boundsMax = glm::max(mesh.boundsMax, positions[v]);
+		}
+		mesh.indices.assign(indices, indices + indexCount);
+		const float acmrBefore = report ? computeAcmr(indices, indexCount, vertexCount, settings.cacheSize) : 0.0f;
+
+		if (settings.optimizeVertexCache) {
+			optimizeVertexCache(mesh.indices.data(), mesh.indices.data(), indexCount, vertexCount);
+		}
+		if (settings.optimizeOverdraw) {
+			optimizeOverdraw(mesh.indices.data(), indexCount, positions, vertexCount, settings.cacheSize, settings.overdrawThreshold);
+		}
+
+		if (settings.optimizeVertexFetch) {
+			std::vector<uint32_t> remap;
+			mesh.vertexCount = optimizeVertexFetch(remap, mesh.indices.data(), indexCount, vertexCount);
+
+			std::vector<glm::vec3> remappedPositions;
+			std::vector<Mesh::Remainder> remappedRemainders;
+			remapStream(remappedPositions, positions, remap, mesh.vertexCount);
+			remapStream(remappedRemainders, remainders, remap, mesh.vertexCount);
+			encodeVertices(remappedPositions.data(), remappedRemainders.data(), mesh.vertexCount, mesh.encoding, mesh.positions, mesh.remainders);
+		}
+		else {
+			mesh.vertexCount = vertexCount;
+			encodeVertices(positions, remainders, vertexCount, mesh.encoding, mesh.positions, mesh.remainders);
+		}
+
+		if (report) {
+			report->vertexCountBefore = vertexCount;
+			report->vertexCountAfter = mesh.vertexCount;
+			report->bytesPerVertexBefore = VertexEncoding().getBytesPerVertex();
+			report->bytesPerVertexAfter = mesh.encoding.getBytesPerVertex();
+			report->acmrBefore = acmrBefore;
+			report->acmrAfter = computeAcmr(mesh.indices.data(), indexCount, mesh.vertexCount, settings.cacheSize);
+		}
+
+		return mesh;
+	}
+
+	void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount) {
+		assert(indexCount % 3 == 0);
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// Copy of the input, destination is allowed to alias it
+		const std::vector<uint32_t> source(indices, indices + indexCount);
+
+		// Triangles adjacent to every vertex, the first remainingTriangles[v] entries are the ones not emitted yet
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (uint32_t i = 0; i < indexCount; i++) {
+			assert(source[i] < vertexCount);
+			adjacencyOffsets[source[i] + 1]++;
+		}
+		std::vector<uint32_t> remainingTriangles(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			remainingTriangles[v] = adjacencyOffsets[v + 1];
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		std::vector<uint32_t> adjacency(indexCount);
+		{
+			std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t i = 0; i < indexCount; i++) {
+				adjacency[cursor[source[i]]++] = i / 3;
+			}
+		}
+
+		std::vector<int32_t> cachePositions(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			vertexScores[v] = forsythVertexScore(-1, remainingTriangles[v]);
+		}
+
+		std::vector<float> triangleScores(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		int64_t bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (uint32_t t = 0; t < triangleCount; t++) {
+			triangleScores[t] = vertexScores[source[t * 3]] + vertexScores[source[t * 3 + 1]] + vertexScores[source[t * 3 + 2]];
+			if (triangleScores[t] > bestScore) {
+				bestScore = triangleScores[t];
+				bestTriangle = t;
+			}
+		}
+
+		std::vector<uint32_t> cache;
+		std::vector<uint32_t> newCache;
+		cache.reserve(FORSYTH_CACHE_SIZE + 3);
+		newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+		uint32_t scanCursor = 0;
+
+		for (uint32_t output = 0; output < triangleCount; output++) {
+			if (bestTriangle < 0) {
+				// Nothing adjacent to the cache is left, continue with the next triangle in input order
+				while (emitted[scanCursor]) {
+					scanCursor++;
+				}
+				bestTriangle = scanCursor;
+			}
+
+			const uint32_t triangle = static_cast<uint32_t>(bestTriangle);
+			const uint32_t* triangleIndices = &source[triangle * 3];
+			memcpy(destination + output * 3, triangleIndices, 3 * sizeof(uint32_t));
+			emitted[triangle] = true;
+
+			newCache.clear();
+			for (uint32_t k = 0; k < 3; k++) {
+				const uint32_t v = triangleIndices[k];
+				uint32_t* begin = &adjacency[adjacencyOffsets[v]];
+				uint32_t* end = begin + remainingTriangles[v];
+				uint32_t* it = std::find(begin, end, triangle);
+				assert(it != end);
+				std::swap(*it, *(end - 1));
+				remainingTriangles[v]--;
+
+				if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+					newCache.push_back(v);
+				}
+			}
+			for (uint32_t v : cache) {
+				if (v != triangleIndices[0] && v != triangleIndices[1] && v != triangleIndices[2]) {
+					newCache.push_back(v);
+				}
+			}
+
+			// Entries beyond the cache size have just been evicted, their scores drop as well
+			for (size_t i = 0; i < newCache.size(); i++) {
+				const uint32_t v = newCache[i];
+				cachePositions[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+				vertexScores[v] = forsythVertexScore(cachePositions[v], remainingTriangles[v]);
+			}
+
+			bestTriangle = -1;
+			bestScore = -1.0f;
+			for (uint32_t v : newCache) {
+				const uint32_t* begin = &adjacency[adjacencyOffsets[v]];
+				for (uint32_t i = 0; i < remainingTriangles[v]; i++) {
+					const uint32_t t = begin[i];
+					triangleScores[t] = vertexScores[source[t * 3]] + vertexScores[source[t * 3 + 1]] + vertexScores[source[t * 3 + 2]];
+					if (triangleScores[t] > bestScore) {
+						bestScore = triangleScores[t];
+						bestTriangle = t;
+					}
+				}
+			}
+
+			if (newCache.size() > FORSYTH_CACHE_SIZE) {
+				newCache.resize(FORSYTH_CACHE_SIZE);
+			}
+			std::swap(cache, newCache);
+		}
+	}
+
+	void optimizeOverdraw(uint32_t* indices, uint32_t indexCount, const glm::vec3* positions, uint32_t vertexCount, uint32_t cacheSize, float threshold) {
+		assert(indexCount % 3 == 0);
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount < MIN_CLUSTER_TRIANGLES * 2) {
+			return;
+		}
+
+		const float meshAcmr = computeAcmr(indices, indexCount, vertexCount, cacheSize);
+
+		// Cut the triangle list wherever the cluster up to that point is about as cache efficient as the whole mesh,
+		// every cluster starts with a cold cache because the clusters are reordered afterwards
+		std::vector<uint32_t> clusterStarts;
+		std::vector<uint32_t> timestamps(vertexCount, 0);
+		uint32_t time = cacheSize + 1;
+		uint32_t clusterStart = 0;
+		uint32_t clusterMisses = 0;
+		for (uint32_t t = 0; t < triangleCount; t++) {
+			for (uint32_t k = 0; k < 3; k++) {
+				const uint32_t v = indices[t * 3 + k];
+				if (time - timestamps[v] > cacheSize) {
+					timestamps[v] = time++;
+					clusterMisses++;
+				}
+			}
+
+			const uint32_t clusterTriangles = t + 1 - clusterStart;
+			if (clusterTriangles >= MIN_CLUSTER_TRIANGLES && static_cast<float>(clusterMisses) / clusterTriangles <= meshAcmr * threshold) {
+				clusterStarts.push_back(clusterStart);
+				clusterStart = t + 1;
+				clusterMisses = 0;
+				time += cacheSize + 1;
+			}
+		}
+		if (clusterStart < triangleCount) {
+			clusterStarts.push_back(clusterStart);
+		}
+		if (clusterStarts.size() < 2) {
+			return;
+		}
+
+		struct Cluster
+		{
+			uint32_t start;
+			uint32_t end;
+			glm::vec3 centroid;
+			glm::vec3 normal;
+			float area;
+			float sortKey;
+		};
+
+		std::vector<Cluster> clusters(clusterStarts.size());
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t c = 0; c < clusters.size(); c++) {
+			Cluster& cluster = clusters[c];
+			cluster.start = clusterStarts[c];
+			cluster.end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+			cluster.centroid = glm::vec3(0.0f);
+			cluster.normal = glm::vec3(0.0f);
+			cluster.area = 0.0f;
+
+			for (uint32_t t = cluster.start; t < cluster.end; t++) {
+				const glm::vec3& p0 = positions[indices[t * 3]];
+				const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+				const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+				const glm::vec3 crossProduct = glm::cross(p1 - p0, p2 - p0);
+				const float area = glm::length(crossProduct) * 0.5f;
+
+				cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+				cluster.normal += crossProduct;
+				cluster.area += area;
+			}
+
+			meshCentroid += cluster.centroid;
+			meshArea += cluster.area;
+			if (cluster.area > 0.0f) {
+				cluster.centroid /= cluster.area;
+			}
+		}
+		if (meshArea > 0.0f) {
+			meshCentroid /= meshArea;
+		}
+
+		// Clusters which face away from the center occlude the ones facing towards it, so they are drawn first
+		for (Cluster& cluster : clusters) {
+			const float normalLength = glm::length(cluster.normal);
+			const glm::vec3 normal = normalLength > 0.0f ? cluster.normal / normalLength : glm::vec3(0.0f);
+			cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, normal);
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+			return a.sortKey > b.sortKey;
+		});
+
+		const std::vector<uint32_t> source(indices, indices + indexCount);
+		uint32_t* destination = indices;
+		for (const Cluster& cluster : clusters) {
+			const uint32_t count = (cluster.end - cluster.start) * 3;
+			memcpy(destination, &source[cluster.start * 3], count * sizeof(uint32_t));
+			destination += count;
+		}
+	}
+
+	uint32_t optimizeVertexFetch(std::vector<uint32_t>& remap, uint32_t* indices, uint32_t indexCount, uint32_t vertexCount) {
+		remap.assign(vertexCount, UNUSED_VERTEX);
+		uint32_t nextVertex = 0;
+		for (uint32_t i = 0; i < indexCount; i++) {
+			uint32_t& newIndex = remap[indices[i]];
+			if (newIndex == UNUSED_VERTEX) {
+				newIndex = nextVertex++;
+			}
+			indices[i] = newIndex;
+		}
+		return nextVertex;
+	}
+
+	float computeAcmr(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+		const uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return 0.0f;
+		}
+
+		// A vertex is in the FIFO if it was inserted less than cacheSize insertions ago
+		std::vector<uint32_t> timestamps(vertexCount, 0);
+		uint32_t time = cacheSize + 1;
+		uint32_t misses = 0;
+		for (uint32_t i = 0; i < indexCount; i++) {
+			const uint32_t v = indices[i];
+			if (time - timestamps[v] > cacheSize) {
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		return static_cast<float>(misses) / triangleCount;
+	}
+
+	void encodeVertices(const glm::vec3* positions, const Mesh::Remainder* remainders, uint32_t vertexCount, const VertexEncoding& encoding,
+						std::vector<uint8_t>& encodedPositions, std::vector<uint8_t>& encodedRemainders) {
+		const uint32_t positionStride = encoding.getPositionStride();
+		const uint32_t remainderStride = encoding.getRemainderStride();
+		const uint32_t colorSize = encoding.getColorSize();
+		encodedPositions.resize(static_cast<size_t>(positionStride) * vertexCount);
+		encodedRemainders.resize(static_cast<size_t>(remainderStride) * vertexCount);
+
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			uint8_t* position = &encodedPositions[static_cast<size_t>(positionStride) * v];
+			if (encoding.position == VertexEncoding::Position::Float16) {
+				const uint64_t packed = glm::packHalf4x16(glm::vec4(positions[v], 1.0f));
+				memcpy(position, &packed, sizeof(packed));
+			}
+			else {
+				memcpy(position, &positions[v], sizeof(glm::vec3));
+			}
+
+			uint8_t* color = &encodedRemainders[static_cast<size_t>(remainderStride) * v];
+			if (encoding.color == VertexEncoding::Color::Unorm8) {
+				const uint32_t packed = glm::packUnorm4x8(glm::vec4(remainders[v].color, 1.0f));
+				memcpy(color, &packed, sizeof(packed));
+			}
+			else {
+				memcpy(color, &remainders[v].color, sizeof(glm::vec3));
+			}
+
+			uint8_t* texCoord = color + colorSize;
+			if (encoding.texCoord == VertexEncoding::TexCoord::Unorm16) {
+				const uint32_t packed = glm::packUnorm2x16(remainders[v].texCoord);
+				memcpy(texCoord, &packed, sizeof(packed));
+			}
+			else {
+				memcpy(texCoord, &remainders[v].texCoord, sizeof(glm::vec2));
+			}
+		}
+	}
+}
\ No newline at end of file
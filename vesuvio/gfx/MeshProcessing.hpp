@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.hpp"
+#include "VertexEncoding.hpp"
+
+namespace vesuvio {
+	// Offline preparation of mesh data, nothing in here touches the GPU.
+	// The output of processMesh() can be passed to Mesh::setEncodedData() as is.
+
+	struct MeshProcessingSettings
+	{
+		bool optimizeVertexCache = true; // triangle order for post-transform vertex cache hits
+		bool optimizeOverdraw = true; // cluster order which draws outer surfaces first, trades a bit of cache efficiency
+		bool optimizeVertexFetch = true; // vertex order of first use, drops unreferenced vertices
+		float overdrawThreshold = 1.05f; // allowed ACMR degradation of a cluster relative to the whole mesh
+		uint32_t cacheSize = 16; // FIFO size of the simulated post-transform cache used for ACMR
+		VertexEncoding encoding;
+	};
+
+	struct MeshProcessingReport
+	{
+		uint32_t vertexCountBefore;
+		uint32_t vertexCountAfter;
+		uint32_t bytesPerVertexBefore;
+		uint32_t bytesPerVertexAfter;
+		float acmrBefore; // average cache miss ratio, transformed vertices per triangle
+		float acmrAfter;
+
+		void print() const;
+	};
+
+	struct ProcessedMesh
+	{
+		std::vector<uint8_t> positions; // encoding.getPositionStride() bytes per vertex
+		std::vector<uint8_t> remainders; // encoding.getRemainderStride() bytes per vertex
+		std::vector<uint32_t> indices;
+		uint32_t vertexCount;
+		VertexEncoding encoding;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	ProcessedMesh processMesh(const glm::vec3* positions, const Mesh::Remainder* remainders, uint32_t vertexCount,
+							  const uint32_t* indices, uint32_t indexCount,
+							  const MeshProcessingSettings& settings, MeshProcessingReport* report = nullptr);
+
+	// Tom Forsyth's linear-speed vertex cache optimization, destination may alias indices
+	void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+	// Splits the triangle list into clusters with acceptable cache efficiency and sorts them front to back
+	// from the viewpoint of a camera outside the mesh
+	void optimizeOverdraw(uint32_t* indices, uint32_t indexCount, const glm::vec3* positions, uint32_t vertexCount, uint32_t cacheSize, float threshold);
+	// Renumbers the vertices in order of first use and fills remap (old -> new, UINT32_MAX for unused ones).
+	// Returns the number of used vertices
+	uint32_t optimizeVertexFetch(std::vector<uint32_t>& remap, uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+	// Transformed vertices per triangle with a FIFO cache, 3.0 is the worst case, 0.5 the best for regular grids
+	float computeAcmr(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize);
+
+	void encodeVertices(const glm::vec3* positions, const Mesh::Remainder* remainders, uint32_t vertexCount, const VertexEncoding& encoding,
+						std::vector<uint8_t>& encodedPositions, std::vector<uint8_t>& encodedRemainders);
+}
\ No newline at end of file
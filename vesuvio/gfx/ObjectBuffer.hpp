@@ -0,0 +1,74 @@
+#pragma once
+
+#include "GfxContext.hpp"
+
+#if VSV_GFX_BACKEND(VULKAN)
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+#endif
+
+#include <glm/glm.hpp>
+
+namespace vesuvio {
+	// One entry of a GPU driven draw list, culled against the view frustum on the GPU
+	struct DrawObject
+	{
+		VertexBufferHandle vertexBuffer;
+		IndexBufferHandle indexBuffer;
+		glm::mat4 transform;
+		glm::vec4 boundingSphere; // xyz center in object space, w radius
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+	};
+
+	// Layout of an object in the object buffer (std430), read by the cull shader and the indirect vertex shader.
+	// firstIndex and vertexOffset are absolute within the shared geometry arena blocks
+	struct GpuObject
+	{
+		glm::mat4 transform;
+		glm::vec4 boundingSphere;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t padding;
+	};
+	static_assert(sizeof(GpuObject) == 96, "GpuObject has to match the std430 layout of the shaders");
+
+	// Objects which are culled and drawn without a draw call per object: a compute shader writes the
+	// draw commands of the visible objects which are then executed with a single indirect draw
+	struct ObjectBuffer
+	{
+		uint32_t capacity;
+		uint32_t objectCount;
+		std::vector<GpuObject> objects; // CPU copy, the reference for the cull validation
+		uint32_t visibleCount; // of the last culled frame which has finished on the GPU
+#if VSV_GFX_BACKEND(VULKAN)
+		struct
+		{
+			vk::Buffer objectBuffer;
+			VmaAllocation objectBufferAlloc;
+			vk::DescriptorSet objectSet; // read by the vertex shader, indexed with the instance index
+			// all objects share the arena blocks, so the draw needs a single bind
+			vk::Buffer vertexBuffer;
+			vk::Buffer indexBuffer;
+			vk::IndexType indexType;
+			// per frame in flight
+			std::vector<vk::Buffer> commandBuffers; // VkDrawIndexedIndirectCommand per object
+			std::vector<VmaAllocation> commandBufferAllocs;
+			std::vector<vk::Buffer> countBuffers;
+			std::vector<VmaAllocation> countBufferAllocs;
+			std::vector<vk::DescriptorSet> cullSets;
+			std::vector<uint64_t> culledFrames;
+			std::vector<std::vector<uint32_t>> expectedVisible; // sorted CPU reference set, only filled if validated
+			std::vector<std::vector<uint32_t>> uncertainObjects; // sorted, too close to a plane to be validated
+			// visible count of every frame in flight, followed by a copy of the draw commands if validated
+			vk::Buffer readbackBuffer;
+			VmaAllocation readbackBufferAlloc;
+			uint8_t* readbackData;
+			vk::DeviceSize readbackStride; // per frame in flight
+			bool validated;
+		} vk;
+#endif
+	};
+}
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "PipelineCache.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include "VulkanContext.hpp"
+#include "Hasher.hpp"
+
+namespace vesuvio {
+
+	namespace {
+		// Same interface as Hasher, but keeps the bytes
+		struct KeyWriter
+		{
+			std::vector<uint8_t> bytes;
+
+			void addBytes(const void* data, size_t size) {
+				const uint8_t* begin = static_cast<const uint8_t*>(data);
+				bytes.insert(bytes.end(), begin, begin + size);
+			}
+
+			// Only for types without padding
+			template<typename T>
+			void add(const T& data) {
+				addBytes(&data, sizeof(T));
+			}
+
+			void addString(const char* string) {
+				addBytes(string, string ? strlen(string) : 0);
+				add('\0');
+			}
+		};
+
+		void writeShaderStage(KeyWriter& writer, const vk::PipelineShaderStageCreateInfo& stage) {
+			writer.add(stage.flags);
+			writer.add(stage.stage);
+			writer.add(static_cast<VkShaderModule>(stage.module));
+			writer.addString(stage.pName);
+			if (stage.pSpecializationInfo) {
+				const vk::SpecializationInfo& specialization = *stage.pSpecializationInfo;
+				for (uint32_t j = 0; j < specialization.mapEntryCount; j++) {
+					writer.add(specialization.pMapEntries[j].constantID);
+					writer.add(specialization.pMapEntries[j].offset);
+					writer.add(static_cast<uint64_t>(specialization.pMapEntries[j].size));
+				}
+				writer.addBytes(specialization.pData, specialization.dataSize);
+			}
+		}
+	}
+
+	PipelineCache::PipelineCache()
+	: device()
+	, properties()
+	, cache()
+	, stats()
+	{
+
+	}
+
+	void PipelineCache::create(vk::Device device, const vk::PhysicalDeviceProperties& properties, const std::string& fileName) {
+		this->device = device;
+		this->properties = properties;
+		this->fileName = fileName;
+
+		std::vector<uint8_t> initialData = loadFile();
+		stats.loadedFromDisk = !initialData.empty();
+
+		vk::PipelineCacheCreateInfo createInfo{};
+		createInfo.initialDataSize = initialData.size();
+		createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+		cache = device.createPipelineCache(createInfo);
+		assert(cache);
+
+		printf("Created pipeline cache (%s, %llu bytes)\n", stats.loadedFromDisk ? "warm" : "cold", (unsigned long long)initialData.size());
+	}
+
+	void PipelineCache::destroy() {
+		if (!cache) {
+			return;
+		}
+
+		save();
+		printf("Pipeline cache: %llu hits, %llu misses, %.2f ms creating pipelines\n",
+			(unsigned long long)stats.pipelineHits, (unsigned long long)stats.pipelineMisses, stats.pipelineCreateSeconds * 1000.0);
+
+		for (auto& pipeline : pipelines) {
+			device.destroyPipeline(pipeline.second.pipeline);
+		}
+		pipelines.clear();
+		for (auto& shaderModule : shaderModules) {
+			device.destroyShaderModule(shaderModule.second);
+		}
+		shaderModules.clear();
+
+		device.destroyPipelineCache(cache);
+		cache = nullptr;
+	}
+
+	bool PipelineCache::save() {
+		std::vector<uint8_t> data = device.getPipelineCacheData(cache);
+
+		FileHeader header{};
+		header.magic = FILE_MAGIC;
+		header.version = FILE_VERSION;
+		header.vendorID = properties.vendorID;
+		header.deviceID = properties.deviceID;
+		header.driverVersion = properties.driverVersion;
+		memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+		header.dataSize = data.size();
+
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			printf("Could not write pipeline cache '%s'\n", fileName.c_str());
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return file.good();
+	}
+
+	std::vector<uint8_t> PipelineCache::loadFile() {
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file.is_open()) {
+			return {};
+		}
+
+		file.seekg(0, std::ios::end);
+		const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+		file.seekg(0, std::ios::beg);
+
+		FileHeader header{};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file.good() || header.magic != FILE_MAGIC || header.version != FILE_VERSION) {
+			printf("Discarding pipeline cache '%s': invalid header\n", fileName.c_str());
+			return {};
+		}
+		// A cache of another device or driver would be ignored by the driver at best
+		if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+			header.driverVersion != properties.driverVersion ||
+			memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0) {
+			printf("Discarding pipeline cache '%s': written by another device or driver\n", fileName.c_str());
+			return {};
+		}
+
+		// Checked before the allocation, a corrupted size must not make it allocate gigabytes
+		if (header.dataSize != fileSize - sizeof(header)) {
+			printf("Discarding pipeline cache '%s': header claims %llu bytes, the file holds %llu\n",
+				fileName.c_str(), (unsigned long long)header.dataSize, (unsigned long long)(fileSize - sizeof(header)));
+			return {};
+		}
+
+		std::vector<uint8_t> data(header.dataSize);
+		file.read(reinterpret_cast<char*>(data.data()), data.size());
+		if (!file.good()) {
+			printf("Discarding pipeline cache '%s': truncated\n", fileName.c_str());
+			return {};
+		}
+		return data;
+	}
+
+	vk::ShaderModule PipelineCache::getShaderModule(const std::string& fileName) {
+		auto it = shaderModules.find(fileName);
+		if (it != shaderModules.end()) {
+			return it->second;
+		}
+
+		std::vector<char> shaderCode = readFile(fileName);
+		if (shaderCode.empty()) {
+			// Not cached, so a shader which shows up later on is picked up
+			return nullptr;
+		}
+		vk::ShaderModuleCreateInfo createInfo{};
+		createInfo.codeSize = shaderCode.size();
+		createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+		vk::ShaderModule shaderModule = device.createShaderModule(createInfo);
+		assert(shaderModule);
+
+		shaderModules.emplace(fileName, shaderModule);
+		return shaderModule;
+	}
+
+	vk::Pipeline PipelineCache::getGraphicsPipeline(const vk::GraphicsPipelineCreateInfo& createInfo) {
+		PipelineKey key = graphicsPipelineKey(createInfo);
+		Hasher hasher;
+		hasher.addBytes(key.data(), key.size());
+		if (vk::Pipeline pipeline = findPipeline(hasher.value, key)) {
+			stats.pipelineHits++;
+			return pipeline;
+		}
+
+		auto createStart = std::chrono::high_resolution_clock::now();
+		vk::ResultValue<vk::Pipeline> result = device.createGraphicsPipeline(cache, createInfo);
+		assert(result.result == vk::Result::eSuccess);
+		auto createEnd = std::chrono::high_resolution_clock::now();
+		stats.pipelineCreateSeconds += std::chrono::duration<double, std::chrono::seconds::period>(createEnd - createStart).count();
+		stats.pipelineMisses++;
+
+		pipelines.emplace(hasher.value, CachedPipeline{ std::move(key), result.value });
+		return result.value;
+	}
+
+	vk::Pipeline PipelineCache::getComputePipeline(const vk::ComputePipelineCreateInfo& createInfo) {
+		PipelineKey key = computePipelineKey(createInfo);
+		Hasher hasher;
+		hasher.addBytes(key.data(), key.size());
+		if (vk::Pipeline pipeline = findPipeline(hasher.value, key)) {
+			stats.pipelineHits++;
+			return pipeline;
+		}
+
+		auto createStart = std::chrono::high_resolution_clock::now();
+		vk::ResultValue<vk::Pipeline> result = device.createComputePipeline(cache, createInfo);
+		assert(result.result == vk::Result::eSuccess);
+		auto createEnd = std::chrono::high_resolution_clock::now();
+		stats.pipelineCreateSeconds += std::chrono::duration<double, std::chrono::seconds::period>(createEnd - createStart).count();
+		stats.pipelineMisses++;
+
+		pipelines.emplace(hasher.value, CachedPipeline{ std::move(key), result.value });
+		return result.value;
+	}
+
+	vk::Pipeline PipelineCache::findPipeline(uint64_t hash, const PipelineKey& key) {
+		auto candidates = pipelines.equal_range(hash);
+		for (auto it = candidates.first; it != candidates.second; ++it) {
+			if (it->second.key == key) {
+				return it->second.pipeline;
+			}
+		}
+		return nullptr;
+	}
+
+	PipelineCache::PipelineKey PipelineCache::graphicsPipelineKey(const vk::GraphicsPipelineCreateInfo& createInfo) {
+		KeyWriter writer;
+		writer.add(createInfo.flags);
+		for (uint32_t i = 0; i < createInfo.stageCount; i++) {
+			writeShaderStage(writer, createInfo.pStages[i]);
+		}
+
+		if (const vk::PipelineVertexInputStateCreateInfo* vertexInput = createInfo.pVertexInputState) {
+			for (uint32_t i = 0; i < vertexInput->vertexBindingDescriptionCount; i++) {
+				writer.add(vertexInput->pVertexBindingDescriptions[i]);
+			}
+			for (uint32_t i = 0; i < vertexInput->vertexAttributeDescriptionCount; i++) {
+				writer.add(vertexInput->pVertexAttributeDescriptions[i]);
+			}
+		}
+		if (const vk::PipelineInputAssemblyStateCreateInfo* inputAssembly = createInfo.pInputAssemblyState) {
+			writer.add(inputAssembly->topology);
+			writer.add(inputAssembly->primitiveRestartEnable);
+		}
+		if (const vk::PipelineViewportStateCreateInfo* viewport = createInfo.pViewportState) {
+			writer.add(viewport->viewportCount);
+			writer.add(viewport->scissorCount);
+			for (uint32_t i = 0; viewport->pViewports && i < viewport->viewportCount; i++) {
+				writer.add(viewport->pViewports[i]);
+			}
+			for (uint32_t i = 0; viewport->pScissors && i < viewport->scissorCount; i++) {
+				writer.add(viewport->pScissors[i]);
+			}
+		}
+		if (const vk::PipelineRasterizationStateCreateInfo* rasterization = createInfo.pRasterizationState) {
+			writer.add(rasterization->depthClampEnable);
+			writer.add(rasterization->rasterizerDiscardEnable);
+			writer.add(rasterization->polygonMode);
+			writer.add(rasterization->cullMode);
+			writer.add(rasterization->frontFace);
+			writer.add(rasterization->depthBiasEnable);
+			writer.add(rasterization->depthBiasConstantFactor);
+			writer.add(rasterization->depthBiasClamp);
+			writer.add(rasterization->depthBiasSlopeFactor);
+			writer.add(rasterization->lineWidth);
+		}
+		if (const vk::PipelineMultisampleStateCreateInfo* multisample = createInfo.pMultisampleState) {
+			writer.add(multisample->rasterizationSamples);
+			writer.add(multisample->sampleShadingEnable);
+			writer.add(multisample->minSampleShading);
+			writer.add(multisample->alphaToCoverageEnable);
+			writer.add(multisample->alphaToOneEnable);
+			if (multisample->pSampleMask) {
+				writer.addBytes(multisample->pSampleMask, (static_cast<uint32_t>(multisample->rasterizationSamples) + 31) / 32 * sizeof(uint32_t));
+			}
+		}
+		if (const vk::PipelineDepthStencilStateCreateInfo* depthStencil = createInfo.pDepthStencilState) {
+			writer.add(depthStencil->depthTestEnable);
+			writer.add(depthStencil->depthWriteEnable);
+			writer.add(depthStencil->depthCompareOp);
+			writer.add(depthStencil->depthBoundsTestEnable);
+			writer.add(depthStencil->stencilTestEnable);
+			writer.add(depthStencil->front);
+			writer.add(depthStencil->back);
+			writer.add(depthStencil->minDepthBounds);
+			writer.add(depthStencil->maxDepthBounds);
+		}
+		if (const vk::PipelineColorBlendStateCreateInfo* colorBlend = createInfo.pColorBlendState) {
+			writer.add(colorBlend->logicOpEnable);
+			writer.add(colorBlend->logicOp);
+			for (uint32_t i = 0; i < colorBlend->attachmentCount; i++) {
+				writer.add(colorBlend->pAttachments[i]);
+			}
+			writer.add(colorBlend->blendConstants);
+		}
+		if (const vk::PipelineDynamicStateCreateInfo* dynamicState = createInfo.pDynamicState) {
+			for (uint32_t i = 0; i < dynamicState->dynamicStateCount; i++) {
+				writer.add(dynamicState->pDynamicStates[i]);
+			}
+		}
+
+		writer.add(static_cast<VkPipelineLayout>(createInfo.layout));
+		writer.add(static_cast<VkRenderPass>(createInfo.renderPass));
+		writer.add(createInfo.subpass);
+		return std::move(writer.bytes);
+	}
+
+	PipelineCache::PipelineKey PipelineCache::computePipelineKey(const vk::ComputePipelineCreateInfo& createInfo) {
+		KeyWriter writer;
+		// Keeps compute and graphics pipelines apart in the shared map
+		writer.add(vk::PipelineBindPoint::eCompute);
+		writer.add(createInfo.flags);
+		writeShaderStage(writer, createInfo.stage);
+		writer.add(static_cast<VkPipelineLayout>(createInfo.layout));
+		return std::move(writer.bytes);
+	}
+}
\ No newline at end of file
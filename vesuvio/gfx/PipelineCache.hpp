@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vesuvio {
+	// Wraps a vk::PipelineCache which is loaded from and saved to disk,
+	// the file is only used if it was written for the same device and driver.
+	// On top of it identical pipeline state returns the pipeline which has already been created.
+	// Shader modules are kept alive by the cache, so their handles can be part of the pipeline state key.
+	class PipelineCache
+	{
+	public:
+		struct Stats
+		{
+			bool loadedFromDisk;
+			uint64_t pipelineHits;
+			uint64_t pipelineMisses;
+			double pipelineCreateSeconds; // time spent in vkCreateGraphicsPipelines/vkCreateComputePipelines
+		};
+
+	public:
+		PipelineCache();
+		void create(vk::Device device, const vk::PhysicalDeviceProperties& properties, const std::string& fileName);
+		// Saves the cache to disk and destroys all pipelines and shader modules
+		void destroy();
+		bool save();
+
+		// nullptr if the file can't be read
+		vk::ShaderModule getShaderModule(const std::string& fileName);
+		// The pipeline is owned by the cache, pNext chains are not part of the state key
+		vk::Pipeline getGraphicsPipeline(const vk::GraphicsPipelineCreateInfo& createInfo);
+		vk::Pipeline getComputePipeline(const vk::ComputePipelineCreateInfo& createInfo);
+
+		vk::PipelineCache getCache() const { return cache; }
+		const Stats& getStats() const { return stats; }
+
+	private:
+		// Precedes the driver's cache data in the file
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+			uint64_t dataSize;
+		};
+		static constexpr uint32_t FILE_MAGIC = 0x43505356; // "VSPC"
+		static constexpr uint32_t FILE_VERSION = 1;
+
+	private:
+		// The pipeline state serialized into bytes, pipelines are looked up by its hash and then compared in full
+		using PipelineKey = std::vector<uint8_t>;
+		struct CachedPipeline
+		{
+			PipelineKey key;
+			vk::Pipeline pipeline;
+		};
+
+	private:
+		std::vector<uint8_t> loadFile();
+		vk::Pipeline findPipeline(uint64_t hash, const PipelineKey& key);
+		static PipelineKey graphicsPipelineKey(const vk::GraphicsPipelineCreateInfo& createInfo);
+		static PipelineKey computePipelineKey(const vk::ComputePipelineCreateInfo& createInfo);
+
+	private:
+		vk::Device device;
+		vk::PhysicalDeviceProperties properties;
+		std::string fileName;
+		vk::PipelineCache cache;
+		std::unordered_map<std::string, vk::ShaderModule> shaderModules;
+		std::unordered_multimap<uint64_t, CachedPipeline> pipelines;
+		Stats stats;
+	};
+}
\ No newline at end of file
@@ -12,8 +12,8 @@
 namespace vesuvio {
 	struct RenderPass
 	{
-		std::vector<Texture*> colorAttachments;
-		Texture* depthAttachment;
+		std::vector<TextureHandle> colorAttachments;
+		TextureHandle depthAttachment;
 #if VSV_GFX_BACKEND(VULKAN)
 		struct
 		{
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include "Handle.hpp"
+
+namespace vesuvio {
+	// Dense storage for the resources behind handles. Slots live in fixed size chunks which never move,
+	// so a resource costs no allocation of its own (only every CHUNK_SIZE-th one adds a chunk) and the backend
+	// can keep plain pointers to it until it is destroyed. Lookups are a shift and a generation compare.
+	// Not thread safe, concurrent get() calls are fine as long as nothing is created or destroyed meanwhile.
+	template<typename T>
+	class ResourcePool
+	{
+	public:
+		ResourcePool()
+		: usedSlots(0)
+		, count(0)
+		{
+
+		}
+
+		// The resource is value initialized
+		Handle<T> create() {
+			uint32_t index;
+			if (!freeIndices.empty()) {
+				index = freeIndices.back();
+				freeIndices.pop_back();
+			}
+			else {
+				index = usedSlots++;
+				if (index / CHUNK_SIZE == chunks.size()) {
+					chunks.push_back(std::make_unique<Slot[]>(CHUNK_SIZE));
+				}
+			}
+
+			Slot& slot = getSlot(index);
+			assert(!slot.alive);
+			slot.value = T{};
+			slot.alive = true;
+			count++;
+			return Handle<T>{ index, slot.generation };
+		}
+
+		// Stale handles are ignored
+		void destroy(Handle<T> handle) {
+			if (!get(handle)) {
+				return;
+			}
+			Slot& slot = getSlot(handle.index);
+			slot.alive = false;
+			slot.generation++;
+			freeIndices.push_back(handle.index);
+			count--;
+		}
+
+		// nullptr for invalid and stale handles
+		T* get(Handle<T> handle) {
+			if (handle.index >= usedSlots) {
+				return nullptr;
+			}
+			Slot& slot = getSlot(handle.index);
+			return slot.alive && slot.generation == handle.generation ? &slot.value : nullptr;
+		}
+		const T* get(Handle<T> handle) const {
+			return const_cast<ResourcePool*>(this)->get(handle);
+		}
+
+		uint32_t getCount() const { return count; }
+
+	private:
+		struct Slot
+		{
+			T value{};
+			uint32_t generation = 1; // so default constructed handles never match
+			bool alive = false;
+		};
+
+		Slot& getSlot(uint32_t index) { return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+
+	private:
+		std::vector<std::unique_ptr<Slot[]>> chunks;
+		std::vector<uint32_t> freeIndices;
+		uint32_t usedSlots; // slots handed out at least once, the ones after them are unused
+		uint32_t count;
+
+		static constexpr uint32_t CHUNK_SIZE = 256;
+	};
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cmath>
+#include <algorithm>
+
 #include "GfxContext.hpp"
 
 #if VSV_GFX_BACKEND(VULKAN)
@@ -15,7 +18,16 @@ namespace vesuvio {
 		enum class Format
 		{
 			R8G8B8A8Srgb,
-			D32Sfloat
+			D32Sfloat,
+			R8G8B8A8Unorm,
+			// Block compressed, 4x4 texels per block
+			BC1RgbaUnorm, // 8 bytes per block, 1 bit alpha
+			BC1RgbaSrgb,
+			BC3Unorm, // 16 bytes per block, interpolated alpha
+			BC3Srgb,
+			BC5Unorm, // 16 bytes per block, two channels (normal maps)
+			BC7Unorm, // 16 bytes per block, high quality rgba
+			BC7Srgb,
 		};
 		union Flags
 		{
@@ -58,10 +70,60 @@ namespace vesuvio {
 		uint32_t width;
 		uint32_t height;
 		uint32_t depth;
+		uint32_t mipLevels;
+		uint32_t residentMip; // first level in memory, only streamed textures drop their finest levels
+		// Slot in the global texture table shaders index directly, sampled textures keep it for their lifetime.
+		// Only streamed textures move to a new slot when their resident levels change
+		uint32_t bindlessIndex = NO_BINDLESS_INDEX;
+		static constexpr uint32_t NO_BINDLESS_INDEX = UINT32_MAX;
 		Format format;
 		Flags flags;
 		SampleCount sampleCount;
 		MemoryUsage memoryUsage;
+
+		static bool isBlockCompressed(Format format) {
+			return format >= Format::BC1RgbaUnorm && format <= Format::BC7Srgb;
+		}
+
+		// Bytes per texel, or per 4x4 block for block compressed formats
+		static uint32_t getBlockSize(Format format) {
+			switch (format) {
+				case Format::BC1RgbaUnorm:
+				case Format::BC1RgbaSrgb:
+					return 8;
+				case Format::BC3Unorm:
+				case Format::BC3Srgb:
+				case Format::BC5Unorm:
+				case Format::BC7Unorm:
+				case Format::BC7Srgb:
+					return 16;
+				default:
+					return 4;
+			}
+		}
+
+		static uint64_t getLevelSize(Format format, uint32_t width, uint32_t height) {
+			if (isBlockCompressed(format)) {
+				return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+			}
+			return static_cast<uint64_t>(width) * height * getBlockSize(format);
+		}
+
+		// Full chain down to 1x1
+		static uint32_t getMaxMipLevels(uint32_t width, uint32_t height) {
+			uint32_t levels = 1;
+			for (uint32_t size = width > height ? width : height; size > 1; size >>= 1) {
+				levels++;
+			}
+			return levels;
+		}
+
+		// Level whose texel density matches a screen footprint of the given size in pixels
+		static uint32_t selectMipLevel(uint32_t width, uint32_t height, float screenWidth, float screenHeight) {
+			const float ratio = std::max(width / std::max(screenWidth, 1.0f), height / std::max(screenHeight, 1.0f));
+			return ratio > 1.0f ? static_cast<uint32_t>(std::log2(ratio)) : 0;
+		}
+
 #if VSV_GFX_BACKEND(VULKAN)
 		struct
 		{
@@ -0,0 +1,269 @@
+#include "TextureFile.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace vesuvio {
+
+	namespace {
+		const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+		struct Ktx2Header
+		{
+			uint8_t identifier[12];
+			uint32_t vkFormat;
+			uint32_t typeSize;
+			uint32_t pixelWidth;
+			uint32_t pixelHeight;
+			uint32_t pixelDepth;
+			uint32_t layerCount;
+			uint32_t faceCount;
+			uint32_t levelCount;
+			uint32_t supercompressionScheme;
+			uint32_t dfdByteOffset;
+			uint32_t dfdByteLength;
+			uint32_t kvdByteOffset;
+			uint32_t kvdByteLength;
+			uint64_t sgdByteOffset;
+			uint64_t sgdByteLength;
+		};
+
+		struct Ktx2Level
+		{
+			uint64_t byteOffset;
+			uint64_t byteLength;
+			uint64_t uncompressedByteLength;
+		};
+
+		const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+		const uint32_t DDS_PIXEL_FORMAT_FOURCC = 0x4;
+
+		struct DdsPixelFormat
+		{
+			uint32_t size;
+			uint32_t flags;
+			uint32_t fourCC;
+			uint32_t rgbBitCount;
+			uint32_t rBitMask;
+			uint32_t gBitMask;
+			uint32_t bBitMask;
+			uint32_t aBitMask;
+		};
+
+		struct DdsHeader
+		{
+			uint32_t size;
+			uint32_t flags;
+			uint32_t height;
+			uint32_t width;
+			uint32_t pitchOrLinearSize;
+			uint32_t depth;
+			uint32_t mipMapCount;
+			uint32_t reserved1[11];
+			DdsPixelFormat pixelFormat;
+			uint32_t caps;
+			uint32_t caps2;
+			uint32_t caps3;
+			uint32_t caps4;
+			uint32_t reserved2;
+		};
+
+		struct DdsHeaderDxt10
+		{
+			uint32_t dxgiFormat;
+			uint32_t resourceDimension;
+			uint32_t miscFlag;
+			uint32_t arraySize;
+			uint32_t miscFlags2;
+		};
+
+		constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+			return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+		}
+
+		// VkFormat values, the container parsing does not depend on the Vulkan headers
+		bool convertFromVkFormat(uint32_t vkFormat, Texture::Format& format) {
+			switch (vkFormat) {
+				case 37: format = Texture::Format::R8G8B8A8Unorm; return true;
+				case 43: format = Texture::Format::R8G8B8A8Srgb; return true;
+				case 133: format = Texture::Format::BC1RgbaUnorm; return true;
+				case 134: format = Texture::Format::BC1RgbaSrgb; return true;
+				case 137: format = Texture::Format::BC3Unorm; return true;
+				case 138: format = Texture::Format::BC3Srgb; return true;
+				case 141: format = Texture::Format::BC5Unorm; return true;
+				case 145: format = Texture::Format::BC7Unorm; return true;
+				case 146: format = Texture::Format::BC7Srgb; return true;
+				default: return false;
+			}
+		}
+
+		bool convertFromDxgiFormat(uint32_t dxgiFormat, Texture::Format& format) {
+			switch (dxgiFormat) {
+				case 28: format = Texture::Format::R8G8B8A8Unorm; return true;
+				case 29: format = Texture::Format::R8G8B8A8Srgb; return true;
+				case 71: format = Texture::Format::BC1RgbaUnorm; return true;
+				case 72: format = Texture::Format::BC1RgbaSrgb; return true;
+				case 77: format = Texture::Format::BC3Unorm; return true;
+				case 78: format = Texture::Format::BC3Srgb; return true;
+				case 83: format = Texture::Format::BC5Unorm; return true;
+				case 98: format = Texture::Format::BC7Unorm; return true;
+				case 99: format = Texture::Format::BC7Srgb; return true;
+				default: return false;
+			}
+		}
+	}
+
+	TextureFile::TextureFile()
+	: file()
+	, format(Texture::Format::R8G8B8A8Srgb)
+	, levels()
+	{
+
+	}
+
+	bool TextureFile::isContainer(const std::string& fileName) {
+		auto hasExtension = [&fileName](const char* extension) {
+			const size_t length = strlen(extension);
+			if (fileName.size() < length) {
+				return false;
+			}
+			return std::equal(fileName.end() - length, fileName.end(), extension, [](char a, char b) {
+				return tolower(static_cast<unsigned char>(a)) == b;
+			});
+		};
+		return hasExtension(".ktx2") || hasExtension(".dds");
+	}
+
+	bool TextureFile::open(const std::string& fileName) {
+		close();
+		if (!file.open(fileName)) {
+			printf("Texture file '%s' could not be opened\n", fileName.data());
+			return false;
+		}
+
+		const bool valid = file.getSize() >= sizeof(KTX2_IDENTIFIER) && memcmp(file.getData(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0
+			? parseKtx2(fileName)
+			: parseDds(fileName);
+		if (!valid) {
+			close();
+		}
+		return valid;
+	}
+
+	void TextureFile::close() {
+		file.close();
+		levels.clear();
+	}
+
+	bool TextureFile::parseKtx2(const std::string& fileName) {
+		if (file.getSize() < sizeof(Ktx2Header)) {
+			printf("Texture file '%s' is truncated\n", fileName.data());
+			return false;
+		}
+		Ktx2Header header;
+		memcpy(&header, file.getData(), sizeof(header));
+
+		if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+			printf("Texture file '%s' is not a plain 2D texture (supercompressed, 3D, array or cube)\n", fileName.data());
+			return false;
+		}
+		if (!convertFromVkFormat(header.vkFormat, format)) {
+			printf("Texture file '%s' has an unsupported format (VkFormat %u)\n", fileName.data(), header.vkFormat);
+			return false;
+		}
+
+		// levelCount 0 asks the loader to generate the mips, the file only holds the base level then
+		const uint32_t mipLevels = std::max(header.levelCount, 1u);
+		if (file.getSize() < sizeof(Ktx2Header) + sizeof(Ktx2Level) * mipLevels) {
+			printf("Texture file '%s' is truncated\n", fileName.data());
+			return false;
+		}
+
+		std::vector<uint64_t> offsets(mipLevels);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			Ktx2Level level;
+			memcpy(&level, file.getData() + sizeof(Ktx2Header) + sizeof(Ktx2Level) * i, sizeof(level));
+			offsets[i] = level.byteOffset;
+		}
+		return buildLevels(fileName, header.pixelWidth, header.pixelHeight, mipLevels, offsets.data());
+	}
+
+	bool TextureFile::parseDds(const std::string& fileName) {
+		uint32_t magic = 0;
+		DdsHeader header;
+		if (file.getSize() < sizeof(magic) + sizeof(DdsHeader)) {
+			printf("Texture file '%s' is truncated\n", fileName.data());
+			return false;
+		}
+		memcpy(&magic, file.getData(), sizeof(magic));
+		memcpy(&header, file.getData() + sizeof(magic), sizeof(header));
+		if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader)) {
+			printf("Texture file '%s' is neither KTX2 nor DDS\n", fileName.data());
+			return false;
+		}
+		if (!(header.pixelFormat.flags & DDS_PIXEL_FORMAT_FOURCC)) {
+			printf("Texture file '%s' has an unsupported uncompressed DDS layout\n", fileName.data());
+			return false;
+		}
+
+		uint64_t dataOffset = sizeof(magic) + sizeof(DdsHeader);
+		bool knownFormat = true;
+		switch (header.pixelFormat.fourCC) {
+			case makeFourCC('D', 'X', 'T', '1'): format = Texture::Format::BC1RgbaUnorm; break;
+			case makeFourCC('D', 'X', 'T', '5'): format = Texture::Format::BC3Unorm; break;
+			case makeFourCC('A', 'T', 'I', '2'):
+			case makeFourCC('B', 'C', '5', 'U'): format = Texture::Format::BC5Unorm; break;
+			case makeFourCC('D', 'X', '1', '0'): {
+				DdsHeaderDxt10 headerDxt10;
+				if (file.getSize() < dataOffset + sizeof(DdsHeaderDxt10)) {
+					printf("Texture file '%s' is truncated\n", fileName.data());
+					return false;
+				}
+				memcpy(&headerDxt10, file.getData() + dataOffset, sizeof(headerDxt10));
+				dataOffset += sizeof(DdsHeaderDxt10);
+				if (headerDxt10.arraySize > 1) {
+					printf("Texture file '%s' is a texture array\n", fileName.data());
+					return false;
+				}
+				knownFormat = convertFromDxgiFormat(headerDxt10.dxgiFormat, format);
+				break;
+			}
+			default: knownFormat = false; break;
+		}
+		if (!knownFormat) {
+			printf("Texture file '%s' has an unsupported DDS format\n", fileName.data());
+			return false;
+		}
+
+		// The mips follow each other without padding, largest first
+		const uint32_t mipLevels = std::max(header.mipMapCount, 1u);
+		std::vector<uint64_t> offsets(mipLevels);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			offsets[i] = dataOffset;
+			dataOffset += Texture::getLevelSize(format, std::max(header.width >> i, 1u), std::max(header.height >> i, 1u));
+		}
+		return buildLevels(fileName, header.width, header.height, mipLevels, offsets.data());
+	}
+
+	bool TextureFile::buildLevels(const std::string& fileName, uint32_t width, uint32_t height, uint32_t mipLevels, const uint64_t* offsets) {
+		if (width == 0 || height == 0 || mipLevels > Texture::getMaxMipLevels(width, height)) {
+			printf("Texture file '%s' has invalid dimensions (%ux%u, %u mips)\n", fileName.data(), width, height, mipLevels);
+			return false;
+		}
+
+		levels.resize(mipLevels);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			Level& level = levels[i];
+			level.width = std::max(width >> i, 1u);
+			level.height = std::max(height >> i, 1u);
+			level.offset = offsets[i];
+			level.size = Texture::getLevelSize(format, level.width, level.height);
+			// Copies from staging memory need offsets aligned to the block size
+			if (level.offset % 4 != 0 || level.offset > file.getSize() || level.size > file.getSize() - level.offset) {
+				printf("Texture file '%s' has an invalid mip level %u\n", fileName.data(), i);
+				return false;
+			}
+		}
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Texture.hpp"
+#include "MeshFile.hpp"
+
+namespace vesuvio {
+	// Memory mapped KTX2 or DDS container with a precomputed mip chain.
+	// Only 2D textures without supercompression and with formats known to Texture::Format are supported.
+	class TextureFile
+	{
+	public:
+		struct Level
+		{
+			uint32_t width;
+			uint32_t height;
+			uint64_t offset; // from getData()
+			uint64_t size;
+		};
+
+	public:
+		TextureFile();
+
+		// Decided by the extension (.ktx2, .dds)
+		static bool isContainer(const std::string& fileName);
+
+		// Returns false if the file is missing, malformed or uses an unsupported format
+		bool open(const std::string& fileName);
+		void close();
+
+		Texture::Format getFormat() const { return format; }
+		uint32_t getWidth() const { return levels.front().width; }
+		uint32_t getHeight() const { return levels.front().height; }
+		uint32_t getMipLevels() const { return static_cast<uint32_t>(levels.size()); }
+		const std::vector<Level>& getLevels() const { return levels; }
+		// Points into the file mapping, valid until close()
+		const uint8_t* getData() const { return file.getData(); }
+		uint64_t getSize() const { return file.getSize(); }
+
+	private:
+		bool parseKtx2(const std::string& fileName);
+		bool parseDds(const std::string& fileName);
+		bool buildLevels(const std::string& fileName, uint32_t width, uint32_t height, uint32_t mipLevels, const uint64_t* offsets);
+
+	private:
+		MappedFile file;
+		Texture::Format format;
+		std::vector<Level> levels;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,320 @@
+#include "TextureStreamer.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <algorithm>
+
+namespace vesuvio {
+
+	TextureStreamer::TextureStreamer()
+	: device()
+	, allocator(nullptr)
+	, uploadManager(nullptr)
+	, maxFramesInFlight(1)
+	, budgetOverride(0)
+	, stats()
+	{
+
+	}
+
+	void TextureStreamer::create(vk::Device device, VmaAllocator allocator, UploadManager* uploadManager, uint32_t maxFramesInFlight) {
+		this->device = device;
+		this->allocator = allocator;
+		this->uploadManager = uploadManager;
+		this->maxFramesInFlight = maxFramesInFlight;
+	}
+
+	void TextureStreamer::destroy() {
+		if (!device) {
+			return;
+		}
+		printf("Streamed %llu bytes (%llu levels in, %llu levels evicted)\n",
+			(unsigned long long)stats.streamedBytes, (unsigned long long)stats.levelsStreamedIn, (unsigned long long)stats.levelsEvicted);
+
+		while (!textures.empty()) {
+			removeTexture(textures.begin()->second->texture);
+		}
+		for (RetiredResidency& retired : retiredResidencies) {
+			destroyResidency(retired.residency);
+		}
+		retiredResidencies.clear();
+		device = nullptr;
+	}
+
+	bool TextureStreamer::addTexture(Texture* texture, std::unique_ptr<TextureFile> file, vk::Format format) {
+		std::unique_ptr<StreamedTexture> streamed = std::make_unique<StreamedTexture>();
+		streamed->file = std::move(file);
+		streamed->format = format;
+
+		const uint32_t mipLevels = streamed->file->getMipLevels();
+		const std::vector<TextureFile::Level>& levels = streamed->file->getLevels();
+		streamed->tailMip = 0;
+		while (streamed->tailMip + 1 < mipLevels && std::max(levels[streamed->tailMip].width, levels[streamed->tailMip].height) > RESIDENT_TAIL_SIZE) {
+			streamed->tailMip++;
+		}
+		streamed->requestedMip = streamed->tailMip;
+		streamed->lastRequestFrame = 0;
+		streamed->pending = false;
+
+		if (!createResidency(*streamed, streamed->tailMip, streamed->resident)) {
+			return false;
+		}
+		// Draws of the next frame wait on the upload, so the tail can be used right away
+		uploadResidency(*streamed, streamed->resident);
+
+		texture->width = streamed->file->getWidth();
+		texture->height = streamed->file->getHeight();
+		texture->depth = 1;
+		texture->mipLevels = mipLevels;
+		texture->residentMip = streamed->resident.mip;
+		texture->format = streamed->file->getFormat();
+		texture->flags = Texture::FlagBits::Sampled | Texture::FlagBits::TransferDst;
+		texture->sampleCount = Texture::SampleCount::Samples1;
+		texture->memoryUsage = Texture::MemoryUsage::GpuOnly;
+		texture->vk.image = streamed->resident.image;
+		texture->vk.imageAlloc = streamed->resident.imageAlloc;
+		texture->vk.imageView = streamed->resident.imageView;
+		streamed->texture = texture;
+
+		textures[texture] = std::move(streamed);
+		return true;
+	}
+
+	void TextureStreamer::removeTexture(Texture* texture) {
+		auto it = textures.find(texture);
+		assert(it != textures.end());
+		StreamedTexture& streamed = *it->second;
+		if (streamed.pending) {
+			uploadManager->wait(streamed.pendingTicket);
+			destroyResidency(streamed.pendingResidency);
+		}
+		destroyResidency(streamed.resident);
+		textures.erase(it);
+	}
+
+	void TextureStreamer::requestMip(Texture* texture, uint32_t mipLevel, uint64_t frame) {
+		auto it = textures.find(texture);
+		if (it == textures.end()) {
+			return;
+		}
+		StreamedTexture& streamed = *it->second;
+		mipLevel = std::min(mipLevel, streamed.tailMip);
+		if (streamed.lastRequestFrame != frame) {
+			streamed.requestedMip = mipLevel;
+			streamed.lastRequestFrame = frame;
+		}
+		else {
+			streamed.requestedMip = std::min(streamed.requestedMip, mipLevel);
+		}
+	}
+
+	void TextureStreamer::update(uint64_t frame, std::vector<Texture*>& changedTextures) {
+		// Every frame which could have sampled a retired image has finished
+		auto retiredEnd = std::remove_if(retiredResidencies.begin(), retiredResidencies.end(), [&](RetiredResidency& retired) {
+			if (retired.frame + maxFramesInFlight > frame) {
+				return false;
+			}
+			destroyResidency(retired.residency);
+			return true;
+		});
+		retiredResidencies.erase(retiredEnd, retiredResidencies.end());
+
+		std::vector<StreamedTexture*> idle;
+		idle.reserve(textures.size());
+		uint64_t projectedBytes = 0;
+		for (auto& entry : textures) {
+			StreamedTexture& streamed = *entry.second;
+			if (streamed.pending && uploadManager->isComplete(streamed.pendingTicket)) {
+				if (streamed.pendingResidency.mip < streamed.resident.mip) {
+					stats.levelsStreamedIn += streamed.resident.mip - streamed.pendingResidency.mip;
+				}
+				else {
+					stats.levelsEvicted += streamed.pendingResidency.mip - streamed.resident.mip;
+				}
+				retiredResidencies.push_back(RetiredResidency{ streamed.resident, frame });
+				streamed.resident = streamed.pendingResidency;
+				streamed.pending = false;
+
+				Texture* texture = streamed.texture;
+				texture->residentMip = streamed.resident.mip;
+				texture->vk.image = streamed.resident.image;
+				texture->vk.imageAlloc = streamed.resident.imageAlloc;
+				texture->vk.imageView = streamed.resident.imageView;
+				changedTextures.push_back(texture);
+			}
+			if (streamed.pending) {
+				projectedBytes += streamed.pendingResidency.bytes;
+			}
+			else {
+				projectedBytes += streamed.resident.bytes;
+				idle.push_back(&streamed);
+			}
+		}
+
+		uint64_t budget = 0;
+		if (budgetOverride > 0) {
+			budget = budgetOverride;
+		}
+		else {
+			const int64_t available = queryAvailableBytes();
+			budget = available > -static_cast<int64_t>(projectedBytes) ? projectedBytes + available : 0;
+		}
+		stats.budgetBytes = budget;
+
+		// Most recently requested first
+		std::sort(idle.begin(), idle.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+			return a->lastRequestFrame > b->lastRequestFrame;
+		});
+
+		// Evict from the least recently requested end, stale textures drop back to their tail,
+		// the others lose one level per frame
+		for (auto it = idle.rbegin(); it != idle.rend() && projectedBytes > budget; ++it) {
+			StreamedTexture& streamed = **it;
+			if (streamed.resident.mip >= streamed.tailMip) {
+				continue;
+			}
+			const bool stale = streamed.lastRequestFrame + REQUEST_TIMEOUT_FRAMES < frame;
+			const uint32_t mip = stale ? streamed.tailMip : streamed.resident.mip + 1;
+			const uint64_t bytes = getResidencyBytes(streamed, mip);
+			if (scheduleResidency(streamed, mip)) {
+				projectedBytes = projectedBytes - streamed.resident.bytes + bytes;
+			}
+		}
+
+		// Stream in the finest requested level which still fits, the most recently requested textures first
+		uint64_t streamBytes = 0;
+		for (StreamedTexture* streamedPtr : idle) {
+			StreamedTexture& streamed = *streamedPtr;
+			if (streamed.pending || streamed.lastRequestFrame + REQUEST_TIMEOUT_FRAMES < frame) {
+				continue;
+			}
+			uint32_t mip = streamed.requestedMip;
+			uint64_t bytes = 0;
+			for (; mip < streamed.resident.mip; mip++) {
+				bytes = getResidencyBytes(streamed, mip);
+				const bool fitsBudget = projectedBytes - streamed.resident.bytes + bytes <= budget;
+				const bool fitsFrame = streamBytes == 0 || streamBytes + bytes <= MAX_STREAM_BYTES_PER_FRAME;
+				if (fitsBudget && fitsFrame) {
+					break;
+				}
+			}
+			if (mip < streamed.resident.mip && scheduleResidency(streamed, mip)) {
+				projectedBytes = projectedBytes - streamed.resident.bytes + bytes;
+				streamBytes += bytes;
+			}
+			if (streamBytes >= MAX_STREAM_BYTES_PER_FRAME) {
+				break;
+			}
+		}
+
+		stats.residentBytes = projectedBytes;
+	}
+
+	bool TextureStreamer::createResidency(StreamedTexture& streamed, uint32_t mip, Residency& residency) {
+		const TextureFile::Level& level = streamed.file->getLevels()[mip];
+		const uint32_t mipLevels = streamed.file->getMipLevels() - mip;
+
+		vk::ImageCreateInfo imageInfo{};
+		imageInfo.imageType = vk::ImageType::e2D;
+		imageInfo.extent.width = level.width;
+		imageInfo.extent.height = level.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = mipLevels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = streamed.format;
+		imageInfo.tiling = vk::ImageTiling::eOptimal;
+		imageInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+		imageInfo.sharingMode = vk::SharingMode::eExclusive;
+		imageInfo.samples = vk::SampleCountFlagBits::e1;
+
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		// Running out of memory is expected here, the change is just skipped then
+		allocInfo.flags = VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+
+		VkResult result = vmaCreateImage(allocator, (VkImageCreateInfo*)&imageInfo, &allocInfo, (VkImage*)&residency.image, &residency.imageAlloc, nullptr);
+		if (result != VK_SUCCESS) {
+			printf("Failed to allocate mip %u of a streamed texture (%d)\n", mip, result);
+			return false;
+		}
+
+		vk::ImageViewCreateInfo viewInfo{};
+		viewInfo.image = residency.image;
+		viewInfo.viewType = vk::ImageViewType::e2D;
+		viewInfo.format = streamed.format;
+		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = mipLevels;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+		residency.imageView = device.createImageView(viewInfo);
+		assert(residency.imageView);
+
+		residency.mip = mip;
+		residency.bytes = getResidencyBytes(streamed, mip);
+		return true;
+	}
+
+	void TextureStreamer::destroyResidency(Residency& residency) {
+		device.destroyImageView(residency.imageView);
+		vmaDestroyImage(allocator, residency.image, residency.imageAlloc);
+		residency = Residency{};
+	}
+
+	UploadTicket TextureStreamer::uploadResidency(StreamedTexture& streamed, const Residency& residency) {
+		const std::vector<TextureFile::Level>& fileLevels = streamed.file->getLevels();
+
+		// The resident levels are contiguous in both containers, uploaded as one range
+		uint64_t begin = fileLevels[residency.mip].offset;
+		uint64_t end = 0;
+		for (size_t i = residency.mip; i < fileLevels.size(); i++) {
+			begin = std::min(begin, fileLevels[i].offset);
+			end = std::max(end, fileLevels[i].offset + fileLevels[i].size);
+		}
+		std::vector<ImageUploadLevel> uploadLevels(fileLevels.size() - residency.mip);
+		for (size_t i = 0; i < uploadLevels.size(); i++) {
+			const TextureFile::Level& level = fileLevels[residency.mip + i];
+			uploadLevels[i].width = level.width;
+			uploadLevels[i].height = level.height;
+			uploadLevels[i].offset = level.offset - begin;
+		}
+
+		stats.streamedBytes += end - begin;
+		return uploadManager->uploadImage(residency.image, uploadLevels.data(), static_cast<uint32_t>(uploadLevels.size()), streamed.file->getData() + begin, end - begin);
+	}
+
+	uint64_t TextureStreamer::getResidencyBytes(const StreamedTexture& streamed, uint32_t mip) const {
+		uint64_t bytes = 0;
+		const std::vector<TextureFile::Level>& levels = streamed.file->getLevels();
+		for (size_t i = mip; i < levels.size(); i++) {
+			bytes += levels[i].size;
+		}
+		return bytes;
+	}
+
+	bool TextureStreamer::scheduleResidency(StreamedTexture& streamed, uint32_t mip) {
+		assert(!streamed.pending && mip != streamed.resident.mip);
+		if (!createResidency(streamed, mip, streamed.pendingResidency)) {
+			return false;
+		}
+		streamed.pendingTicket = uploadResidency(streamed, streamed.pendingResidency);
+		streamed.pending = true;
+		return true;
+	}
+
+	int64_t TextureStreamer::queryAvailableBytes() const {
+		const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+		vmaGetMemoryProperties(allocator, &memoryProperties);
+		VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+		vmaGetHeapBudgets(allocator, budgets);
+
+		// On integrated GPUs every heap is device local
+		int64_t available = 0;
+		for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+			if (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+				available += static_cast<int64_t>(budgets[i].budget * BUDGET_FRACTION) - static_cast<int64_t>(budgets[i].usage);
+			}
+		}
+		return available;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include "Texture.hpp"
+#include "TextureFile.hpp"
+#include "UploadManager.hpp"
+
+namespace vesuvio {
+	// Keeps the mip chains of KTX2/DDS textures partially resident within a memory budget.
+	// The small tail of every chain is made resident when the texture is added, finer levels are streamed in
+	// from the still mapped file once they are requested. When the projected residency exceeds the budget
+	// the levels of the least recently requested textures are evicted again.
+	// A residency change allocates a new image with the levels [mip, mipLevels) and uploads them in the background,
+	// the texture only switches over once the upload has finished. Replaced images are freed after all frames in flight.
+	class TextureStreamer
+	{
+	public:
+		struct Stats
+		{
+			uint64_t residentBytes; // projected, pending changes are counted with their new size
+			uint64_t budgetBytes; // what the streamer may use this frame
+			uint64_t streamedBytes; // uploaded by residency changes
+			uint64_t levelsStreamedIn;
+			uint64_t levelsEvicted;
+		};
+
+	public:
+		TextureStreamer();
+		void create(vk::Device device, VmaAllocator allocator, UploadManager* uploadManager, uint32_t maxFramesInFlight);
+		void destroy();
+
+		// Takes ownership of the file and fills in the texture, the tail of the mip chain is uploaded right away.
+		// The texture is owned by the caller and has to stay at its address until it is removed
+		bool addTexture(Texture* texture, std::unique_ptr<TextureFile> file, vk::Format format);
+		// Waits for a pending upload, the images are destroyed immediately so no frame in flight may use them anymore
+		void removeTexture(Texture* texture);
+		bool isStreamed(const Texture* texture) const { return textures.count(texture) > 0; }
+
+		// Finest level needed in the given frame, multiple requests within one frame keep the finest
+		void requestMip(Texture* texture, uint32_t mipLevel, uint64_t frame);
+		// 0 uses a fraction of the device local heap budget reported by VMA
+		void setBudget(uint64_t bytes) { budgetOverride = bytes; }
+
+		// Switches textures with finished uploads over, frees images no frame in flight can use anymore
+		// and schedules the next residency changes. Has to be called after the upload acquire barriers of
+		// the frame have been recorded. Textures whose image view changed are appended to changedTextures.
+		void update(uint64_t frame, std::vector<Texture*>& changedTextures);
+
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct Residency
+		{
+			vk::Image image;
+			VmaAllocation imageAlloc;
+			vk::ImageView imageView;
+			uint32_t mip; // first level in the image
+			uint64_t bytes;
+		};
+
+		struct StreamedTexture
+		{
+			Texture* texture;
+			std::unique_ptr<TextureFile> file;
+			vk::Format format;
+			uint32_t tailMip; // levels from here on are always resident
+			uint32_t requestedMip;
+			uint64_t lastRequestFrame;
+			Residency resident;
+			bool pending;
+			Residency pendingResidency;
+			UploadTicket pendingTicket;
+		};
+
+		struct RetiredResidency
+		{
+			Residency residency;
+			uint64_t frame;
+		};
+
+	private:
+		bool createResidency(StreamedTexture& streamed, uint32_t mip, Residency& residency);
+		void destroyResidency(Residency& residency);
+		UploadTicket uploadResidency(StreamedTexture& streamed, const Residency& residency);
+		uint64_t getResidencyBytes(const StreamedTexture& streamed, uint32_t mip) const;
+		bool scheduleResidency(StreamedTexture& streamed, uint32_t mip);
+		int64_t queryAvailableBytes() const;
+
+	private:
+		vk::Device device;
+		VmaAllocator allocator;
+		UploadManager* uploadManager;
+		uint32_t maxFramesInFlight;
+		uint64_t budgetOverride;
+
+		std::unordered_map<const Texture*, std::unique_ptr<StreamedTexture>> textures;
+		std::vector<RetiredResidency> retiredResidencies;
+
+		Stats stats;
+
+		// Largest dimension of the always resident levels
+		static constexpr uint32_t RESIDENT_TAIL_SIZE = 64;
+		// Share of the device local heap budget VMA reports that may be in use after streaming
+		static constexpr double BUDGET_FRACTION = 0.9;
+		// Requests older than this are treated as stale, their textures are evicted first
+		static constexpr uint64_t REQUEST_TIMEOUT_FRAMES = 120;
+		// Limits the uploads started per frame, a single larger change is still allowed
+		static constexpr uint64_t MAX_STREAM_BYTES_PER_FRAME = 16 * 1024 * 1024;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "UniformRingBuffer.hpp"
+
+#include <cassert>
+
+namespace vesuvio {
+
+	UniformRingBuffer::UniformRingBuffer()
+	: allocator(nullptr)
+	, buffer()
+	, bufferAlloc(nullptr)
+	, mappedData(nullptr)
+	, frameSize(0)
+	, alignment(1)
+	, frameBegin(0)
+	, head(0)
+	{
+
+	}
+
+	void UniformRingBuffer::create(VmaAllocator allocator, vk::DeviceSize frameSize, uint32_t frameCount, vk::DeviceSize minAlignment, vk::BufferUsageFlags usage) {
+		this->allocator = allocator;
+		alignment = minAlignment > 0 ? minAlignment : 1;
+		// Every frame region has to start at a valid dynamic offset
+		this->frameSize = (frameSize + alignment - 1) / alignment * alignment;
+
+		vk::BufferCreateInfo bufferInfo{};
+		bufferInfo.size = this->frameSize * frameCount;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+		allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+		VmaAllocationInfo allocationInfo = {};
+		VkResult result = vmaCreateBuffer(allocator, (VkBufferCreateInfo*)&bufferInfo, &allocInfo, (VkBuffer*)&buffer, &bufferAlloc, &allocationInfo);
+		assert(vk::Result(result) == vk::Result::eSuccess);
+		mappedData = static_cast<uint8_t*>(allocationInfo.pMappedData);
+		assert(mappedData);
+
+		printf("Created ring buffer (%u frames with %llu bytes each)\n", frameCount, (unsigned long long)this->frameSize);
+	}
+
+	void UniformRingBuffer::destroy() {
+		if (buffer) {
+			vmaDestroyBuffer(allocator, buffer, bufferAlloc);
+			buffer = nullptr;
+			bufferAlloc = nullptr;
+			mappedData = nullptr;
+		}
+	}
+
+	void UniformRingBuffer::beginFrame(uint32_t frameIndex) {
+		frameBegin = frameSize * frameIndex;
+		head.store(frameBegin, std::memory_order_relaxed);
+	}
+
+	void UniformRingBuffer::endFrame() {
+		// No-op on host coherent memory
+		const vk::DeviceSize end = head.load(std::memory_order_relaxed);
+		if (end > frameBegin) {
+			vmaFlushAllocation(allocator, bufferAlloc, frameBegin, end - frameBegin);
+		}
+	}
+
+	UniformRingBuffer::Allocation UniformRingBuffer::allocate(vk::DeviceSize size) {
+		const vk::DeviceSize alignedSize = (size + alignment - 1) / alignment * alignment;
+		const vk::DeviceSize frameEnd = frameBegin + frameSize;
+		// A failed allocation doesn't move the head, so smaller ones can still fit
+		vk::DeviceSize offset = head.load(std::memory_order_relaxed);
+		do {
+			if (offset + alignedSize > frameEnd) {
+				Allocation allocation;
+				allocation.data = nullptr;
+				allocation.offset = INVALID_OFFSET;
+				return allocation;
+			}
+		} while (!head.compare_exchange_weak(offset, offset + alignedSize, std::memory_order_relaxed));
+
+		Allocation allocation;
+		allocation.data = mappedData + offset;
+		allocation.offset = static_cast<uint32_t>(offset);
+		return allocation;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <atomic>
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+namespace vesuvio {
+	// A single persistently mapped uniform buffer which is split into one region per frame in flight.
+	// Constants are suballocated linearly from the region of the current frame and
+	// bound with eUniformBufferDynamic offsets, so there is no map/unmap and no extra descriptor set per draw.
+	// Other per frame data (e.g. instance streams) can use it with a different buffer usage.
+	class UniformRingBuffer
+	{
+	public:
+		struct Allocation
+		{
+			void* data; // nullptr if the frame region is exhausted
+			uint32_t offset; // dynamic offset from the start of the buffer
+		};
+		static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+	public:
+		UniformRingBuffer();
+		// minAlignment doesn't have to be a power of two, offsets are multiples of it
+		void create(VmaAllocator allocator, vk::DeviceSize frameSize, uint32_t frameCount, vk::DeviceSize minAlignment, vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eUniformBuffer);
+		void destroy();
+
+		// Must only be called once the fence of the frame which used this region has been signaled.
+		// Allocations are thread safe, beginFrame()/endFrame() are not
+		void beginFrame(uint32_t frameIndex);
+		// Makes the writes of the current frame visible to the device
+		void endFrame();
+
+		// Fails with a nullptr allocation once the region of the current frame is full,
+		// the region of another frame in flight is never written
+		Allocation allocate(vk::DeviceSize size);
+		// Returns INVALID_OFFSET if the data didn't fit
+		template<typename T>
+		uint32_t push(const T& data) {
+			Allocation allocation = allocate(sizeof(T));
+			if (!allocation.data) {
+				return INVALID_OFFSET;
+			}
+			memcpy(allocation.data, &data, sizeof(T));
+			return allocation.offset;
+		}
+
+		vk::Buffer getBuffer() const { return buffer; }
+
+	private:
+		VmaAllocator allocator;
+		vk::Buffer buffer;
+		VmaAllocation bufferAlloc;
+		uint8_t* mappedData;
+		vk::DeviceSize frameSize;
+		vk::DeviceSize alignment;
+		vk::DeviceSize frameBegin;
+		std::atomic<vk::DeviceSize> head;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,411 @@
+#include "UploadManager.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace vesuvio {
+
+	UploadManager::UploadManager()
+	: device()
+	, allocator(nullptr)
+	, transferQueue()
+	, transferQueueFamily(0)
+	, graphicsQueueFamily(0)
+	, commandPool()
+	, timelineSemaphore()
+	, lastSubmittedValue(0)
+	, lastCompletedValue(0)
+	, graphicsWaitedValue(0)
+	, staging()
+	, stagingData(nullptr)
+	, stagingSize(0)
+	, stagingHead(0)
+	, stagingTail(0)
+	, openCommandBuffer()
+	, openBytes(0)
+	, stats()
+	{
+
+	}
+
+	void UploadManager::create(vk::Device device, VmaAllocator allocator, vk::Queue transferQueue, uint32_t transferQueueFamily, uint32_t graphicsQueueFamily, vk::DeviceSize stagingSize) {
+		this->device = device;
+		this->allocator = allocator;
+		this->transferQueue = transferQueue;
+		this->transferQueueFamily = transferQueueFamily;
+		this->graphicsQueueFamily = graphicsQueueFamily;
+		this->stagingSize = stagingSize;
+
+		vk::CommandPoolCreateInfo poolInfo{};
+		poolInfo.queueFamilyIndex = transferQueueFamily;
+		poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+		commandPool = device.createCommandPool(poolInfo);
+		assert(commandPool);
+
+		vk::SemaphoreTypeCreateInfo semaphoreTypeInfo{};
+		semaphoreTypeInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+		semaphoreTypeInfo.initialValue = 0;
+		vk::SemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.pNext = &semaphoreTypeInfo;
+		timelineSemaphore = device.createSemaphore(semaphoreInfo);
+		assert(timelineSemaphore);
+
+		vk::BufferCreateInfo bufferInfo{};
+		bufferInfo.size = stagingSize;
+		bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+		bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+		allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+		VmaAllocationInfo allocationInfo = {};
+		VkResult result = vmaCreateBuffer(allocator, (VkBufferCreateInfo*)&bufferInfo, &allocInfo, (VkBuffer*)&staging.buffer, &staging.bufferAlloc, &allocationInfo);
+		assert(vk::Result(result) == vk::Result::eSuccess);
+		stagingData = static_cast<uint8_t*>(allocationInfo.pMappedData);
+		assert(stagingData);
+
+		printf("Created upload manager (%llu bytes staging, transfer queue family %u, graphics queue family %u)\n",
+			(unsigned long long)stagingSize, transferQueueFamily, graphicsQueueFamily);
+	}
+
+	void UploadManager::destroy() {
+		if (!device) {
+			return;
+		}
+		flush();
+		if (lastSubmittedValue > 0) {
+			wait(UploadTicket{ lastSubmittedValue });
+		}
+		assert(inFlightBatches.empty());
+
+		printf("Uploaded %llu bytes in %llu batches (%.1f MB/s)\n",
+			(unsigned long long)stats.bytesUploaded, (unsigned long long)stats.batchesSubmitted, stats.getThroughputMBps());
+
+		vmaDestroyBuffer(allocator, staging.buffer, staging.bufferAlloc);
+		device.destroySemaphore(timelineSemaphore);
+		device.destroyCommandPool(commandPool);
+		device = nullptr;
+	}
+
+	UploadTicket UploadManager::uploadBuffer(vk::Buffer dstBuffer, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size, bool concurrent) {
+		StagingAllocation stagingAlloc = allocateStaging(size);
+		memcpy(stagingAlloc.data, data, static_cast<size_t>(size));
+
+		vk::CommandBuffer commandBuffer = getBatchCommandBuffer();
+
+		vk::BufferCopy copyRegion{};
+		copyRegion.srcOffset = stagingAlloc.offset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		commandBuffer.copyBuffer(stagingAlloc.buffer, dstBuffer, copyRegion);
+
+		if (needsOwnershipTransfer() && !concurrent) {
+			vk::BufferMemoryBarrier barrier{};
+			barrier.srcQueueFamilyIndex = transferQueueFamily;
+			barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+			barrier.buffer = dstBuffer;
+			barrier.offset = dstOffset;
+			barrier.size = size;
+
+			barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			barrier.dstAccessMask = vk::AccessFlags();
+			openBufferReleases.push_back(barrier);
+
+			barrier.srcAccessMask = vk::AccessFlags();
+			barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+			openBufferAcquires.push_back(barrier);
+		}
+
+		openBytes += size;
+		return UploadTicket{ lastSubmittedValue + 1 };
+	}
+
+	UploadTicket UploadManager::uploadImage(vk::Image dstImage, uint32_t width, uint32_t height, const void* data, vk::DeviceSize size) {
+		ImageUploadLevel level{ width, height, 0 };
+		return uploadImage(dstImage, &level, 1, data, size);
+	}
+
+	UploadTicket UploadManager::uploadImage(vk::Image dstImage, const ImageUploadLevel* levels, uint32_t levelCount, const void* data, vk::DeviceSize size) {
+		StagingAllocation stagingAlloc = allocateStaging(size);
+		memcpy(stagingAlloc.data, data, static_cast<size_t>(size));
+
+		vk::CommandBuffer commandBuffer = getBatchCommandBuffer();
+
+		vk::ImageMemoryBarrier barrier{};
+		barrier.oldLayout = vk::ImageLayout::eUndefined;
+		barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = dstImage;
+		barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = levelCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = vk::AccessFlags();
+		barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(),
+			{}, {}, barrier
+		);
+
+		std::vector<vk::BufferImageCopy> copyRegions(levelCount);
+		for (uint32_t i = 0; i < levelCount; i++) {
+			vk::BufferImageCopy& copyRegion = copyRegions[i];
+			copyRegion.bufferOffset = stagingAlloc.offset + levels[i].offset;
+			copyRegion.bufferRowLength = 0;
+			copyRegion.bufferImageHeight = 0;
+			copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			copyRegion.imageSubresource.mipLevel = i;
+			copyRegion.imageSubresource.baseArrayLayer = 0;
+			copyRegion.imageSubresource.layerCount = 1;
+			copyRegion.imageOffset = vk::Offset3D{ 0, 0, 0 };
+			copyRegion.imageExtent = vk::Extent3D{ levels[i].width, levels[i].height, 1 };
+		}
+		commandBuffer.copyBufferToImage(stagingAlloc.buffer, dstImage, vk::ImageLayout::eTransferDstOptimal, copyRegions);
+
+		// Transitions to the final layout and, if needed, releases the ownership to the graphics queue family
+		barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+		barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		if (needsOwnershipTransfer()) {
+			barrier.srcQueueFamilyIndex = transferQueueFamily;
+			barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+		}
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlags();
+		openImageReleases.push_back(barrier);
+
+		if (needsOwnershipTransfer()) {
+			barrier.srcAccessMask = vk::AccessFlags();
+			barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+			openImageAcquires.push_back(barrier);
+		}
+
+		openBytes += size;
+		return UploadTicket{ lastSubmittedValue + 1 };
+	}
+
+	void UploadManager::flush() {
+		if (!openCommandBuffer) {
+			return;
+		}
+
+		if (!openBufferReleases.empty() || !openImageReleases.empty()) {
+			openCommandBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+				vk::DependencyFlags(),
+				{}, openBufferReleases, openImageReleases
+			);
+		}
+		openCommandBuffer.end();
+
+		const uint64_t value = lastSubmittedValue + 1;
+
+		vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &value;
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &openCommandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &timelineSemaphore;
+
+		transferQueue.submit(submitInfo, nullptr);
+
+		if (inFlightBatches.empty()) {
+			busyStart = std::chrono::high_resolution_clock::now();
+		}
+
+		Batch batch;
+		batch.value = value;
+		batch.commandBuffer = openCommandBuffer;
+		batch.stagingEnd = stagingHead;
+		batch.dedicatedStagingBuffers = std::move(openDedicatedStagingBuffers);
+		inFlightBatches.push_back(std::move(batch));
+		lastSubmittedValue = value;
+
+		submittedBufferAcquires.insert(submittedBufferAcquires.end(), openBufferAcquires.begin(), openBufferAcquires.end());
+		submittedImageAcquires.insert(submittedImageAcquires.end(), openImageAcquires.begin(), openImageAcquires.end());
+
+		stats.bytesUploaded += openBytes;
+		stats.batchesSubmitted++;
+
+		openCommandBuffer = nullptr;
+		openDedicatedStagingBuffers.clear();
+		openBufferReleases.clear();
+		openImageReleases.clear();
+		openBufferAcquires.clear();
+		openImageAcquires.clear();
+		openBytes = 0;
+	}
+
+	void UploadManager::update() {
+		lastCompletedValue = device.getSemaphoreCounterValue(timelineSemaphore);
+
+		bool retiredAny = false;
+		while (!inFlightBatches.empty() && inFlightBatches.front().value <= lastCompletedValue) {
+			Batch& batch = inFlightBatches.front();
+			stagingTail = batch.stagingEnd;
+			retireBatch(batch);
+			inFlightBatches.pop_front();
+			retiredAny = true;
+		}
+
+		if (inFlightBatches.empty()) {
+			if (retiredAny) {
+				auto now = std::chrono::high_resolution_clock::now();
+				stats.busySeconds += std::chrono::duration<double, std::chrono::seconds::period>(now - busyStart).count();
+			}
+			// Nothing references the staging ring anymore, start over to avoid wrapping
+			if (!openCommandBuffer) {
+				stagingHead = 0;
+				stagingTail = 0;
+			}
+		}
+	}
+
+	bool UploadManager::isComplete(UploadTicket ticket) {
+		if (ticket.value > lastSubmittedValue) {
+			return false;
+		}
+		if (ticket.value > lastCompletedValue) {
+			update();
+		}
+		return ticket.value <= lastCompletedValue;
+	}
+
+	void UploadManager::wait(UploadTicket ticket) {
+		if (ticket.value > lastSubmittedValue) {
+			flush();
+		}
+		if (ticket.value <= lastCompletedValue) {
+			return;
+		}
+
+		vk::SemaphoreWaitInfo waitInfo{};
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &timelineSemaphore;
+		waitInfo.pValues = &ticket.value;
+		vk::Result result = device.waitSemaphores(waitInfo, UINT64_MAX);
+		assert(result == vk::Result::eSuccess);
+
+		update();
+	}
+
+	uint64_t UploadManager::recordAcquireBarriers(vk::CommandBuffer commandBuffer) {
+		if (!submittedBufferAcquires.empty() || !submittedImageAcquires.empty()) {
+			commandBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands,
+				vk::DependencyFlags(),
+				{}, submittedBufferAcquires, submittedImageAcquires
+			);
+			submittedBufferAcquires.clear();
+			submittedImageAcquires.clear();
+		}
+
+		// Even finished uploads are waited on once, the semaphore wait is what makes the writes visible to the graphics queue
+		if (lastSubmittedValue > graphicsWaitedValue) {
+			graphicsWaitedValue = lastSubmittedValue;
+			return lastSubmittedValue;
+		}
+		return 0;
+	}
+
+	UploadManager::StagingAllocation UploadManager::allocateStaging(vk::DeviceSize size) {
+		// Satisfies the buffer offset alignment of all color formats including block compressed ones
+		constexpr vk::DeviceSize alignment = 16;
+		const vk::DeviceSize alignedSize = (size + alignment - 1) / alignment * alignment;
+
+		StagingAllocation stagingAlloc{};
+
+		if (alignedSize >= stagingSize) {
+			// Too large for the ring, gets its own staging buffer which is destroyed together with the batch
+			vk::BufferCreateInfo bufferInfo{};
+			bufferInfo.size = size;
+			bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+			bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+			VmaAllocationCreateInfo allocInfo = {};
+			allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+			allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+			StagingBuffer dedicated;
+			VmaAllocationInfo allocationInfo = {};
+			VkResult result = vmaCreateBuffer(allocator, (VkBufferCreateInfo*)&bufferInfo, &allocInfo, (VkBuffer*)&dedicated.buffer, &dedicated.bufferAlloc, &allocationInfo);
+			assert(vk::Result(result) == vk::Result::eSuccess);
+			openDedicatedStagingBuffers.push_back(dedicated);
+
+			stagingAlloc.buffer = dedicated.buffer;
+			stagingAlloc.offset = 0;
+			stagingAlloc.data = static_cast<uint8_t*>(allocationInfo.pMappedData);
+			return stagingAlloc;
+		}
+
+		stagingAlloc.buffer = staging.buffer;
+		for (;;) {
+			if (stagingHead >= stagingTail) {
+				if (stagingSize - stagingHead >= alignedSize) {
+					stagingAlloc.offset = stagingHead;
+					stagingHead += alignedSize;
+					break;
+				}
+				// Wrap around, head must never catch up with the tail
+				if (stagingTail > alignedSize) {
+					stagingAlloc.offset = 0;
+					stagingHead = alignedSize;
+					break;
+				}
+			}
+			else if (stagingTail - stagingHead > alignedSize) {
+				stagingAlloc.offset = stagingHead;
+				stagingHead += alignedSize;
+				break;
+			}
+
+			// Out of staging memory, submit what we have and wait for the oldest batch to free its range
+			flush();
+			assert(!inFlightBatches.empty());
+			wait(UploadTicket{ inFlightBatches.front().value });
+		}
+
+		stagingAlloc.data = stagingData + stagingAlloc.offset;
+		return stagingAlloc;
+	}
+
+	vk::CommandBuffer UploadManager::getBatchCommandBuffer() {
+		if (openCommandBuffer) {
+			return openCommandBuffer;
+		}
+
+		if (!freeCommandBuffers.empty()) {
+			openCommandBuffer = freeCommandBuffers.back();
+			freeCommandBuffers.pop_back();
+		}
+		else {
+			vk::CommandBufferAllocateInfo allocInfo{};
+			allocInfo.level = vk::CommandBufferLevel::ePrimary;
+			allocInfo.commandPool = commandPool;
+			allocInfo.commandBufferCount = 1;
+			openCommandBuffer = device.allocateCommandBuffers(allocInfo)[0];
+		}
+
+		// Implicitly resets the command buffer
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		openCommandBuffer.begin(beginInfo);
+
+		return openCommandBuffer;
+	}
+
+	void UploadManager::retireBatch(Batch& batch) {
+		for (auto& dedicated : batch.dedicatedStagingBuffers) {
+			vmaDestroyBuffer(allocator, dedicated.buffer, dedicated.bufferAlloc);
+		}
+		batch.dedicatedStagingBuffers.clear();
+		freeCommandBuffers.push_back(batch.commandBuffer);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <chrono>
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+namespace vesuvio {
+	// Handle to an upload which can be polled or waited on
+	struct UploadTicket
+	{
+		uint64_t value = 0; // timeline semaphore value which is signaled once the upload has finished
+	};
+
+	// One mip level of an image upload
+	struct ImageUploadLevel
+	{
+		uint32_t width;
+		uint32_t height;
+		vk::DeviceSize offset; // from the start of the uploaded data, has to be a multiple of the texel block size
+	};
+
+	// Batches staging copies into one submit on the transfer queue.
+	// Staging memory comes from a persistently mapped ring buffer which is reclaimed once a batch has finished,
+	// completion is signaled through a timeline semaphore.
+	// Destination resources are expected to be exclusively owned by the graphics queue family,
+	// if the transfer queue belongs to another family the ownership is released after the copy
+	// and has to be acquired on the graphics queue through recordAcquireBarriers().
+	class UploadManager
+	{
+	public:
+		struct Stats
+		{
+			uint64_t bytesUploaded;
+			uint64_t batchesSubmitted;
+			double busySeconds; // time with at least one batch in flight (measured with update() granularity)
+
+			double getThroughputMBps() const {
+				return busySeconds > 0.0 ? static_cast<double>(bytesUploaded) / (1024.0 * 1024.0) / busySeconds : 0.0;
+			}
+		};
+
+	public:
+		UploadManager();
+		void create(vk::Device device, VmaAllocator allocator,
+					vk::Queue transferQueue, uint32_t transferQueueFamily, uint32_t graphicsQueueFamily,
+					vk::DeviceSize stagingSize);
+		void destroy();
+
+		// Buffers created with concurrent sharing by both queue families are not transferred
+		UploadTicket uploadBuffer(vk::Buffer dstBuffer, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size, bool concurrent = false);
+		// Leaves the image in eShaderReadOnlyOptimal
+		UploadTicket uploadImage(vk::Image dstImage, uint32_t width, uint32_t height, const void* data, vk::DeviceSize size);
+		// Uploads the mip levels [0, levelCount), levels which are not uploaded stay untouched
+		UploadTicket uploadImage(vk::Image dstImage, const ImageUploadLevel* levels, uint32_t levelCount, const void* data, vk::DeviceSize size);
+
+		// Submits everything recorded since the last flush as one batch
+		void flush();
+		// Reclaims the staging memory of finished batches
+		void update();
+
+		bool isComplete(UploadTicket ticket);
+		void wait(UploadTicket ticket);
+
+		// Records the ownership acquire barriers of all submitted batches into a graphics command buffer.
+		// Returns the timeline value the submit of that command buffer has to wait on, 0 if there is nothing to wait for.
+		uint64_t recordAcquireBarriers(vk::CommandBuffer commandBuffer);
+		vk::Semaphore getTimelineSemaphore() const { return timelineSemaphore; }
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct StagingBuffer
+		{
+			vk::Buffer buffer;
+			VmaAllocation bufferAlloc;
+		};
+
+		struct Batch
+		{
+			uint64_t value;
+			vk::CommandBuffer commandBuffer;
+			vk::DeviceSize stagingEnd;
+			std::vector<StagingBuffer> dedicatedStagingBuffers;
+		};
+
+		struct StagingAllocation
+		{
+			vk::Buffer buffer;
+			vk::DeviceSize offset;
+			uint8_t* data;
+		};
+
+	private:
+		StagingAllocation allocateStaging(vk::DeviceSize size);
+		vk::CommandBuffer getBatchCommandBuffer();
+		void retireBatch(Batch& batch);
+		bool needsOwnershipTransfer() const { return transferQueueFamily != graphicsQueueFamily; }
+
+	private:
+		vk::Device device;
+		VmaAllocator allocator;
+		vk::Queue transferQueue;
+		uint32_t transferQueueFamily;
+		uint32_t graphicsQueueFamily;
+
+		vk::CommandPool commandPool;
+		std::vector<vk::CommandBuffer> freeCommandBuffers;
+		vk::Semaphore timelineSemaphore;
+		uint64_t lastSubmittedValue;
+		uint64_t lastCompletedValue;
+		uint64_t graphicsWaitedValue;
+
+		// ring of staging memory, [tail, head) is in use by the open and the in flight batches
+		StagingBuffer staging;
+		uint8_t* stagingData;
+		vk::DeviceSize stagingSize;
+		vk::DeviceSize stagingHead;
+		vk::DeviceSize stagingTail;
+
+		// batch which is currently recorded
+		vk::CommandBuffer openCommandBuffer;
+		std::vector<StagingBuffer> openDedicatedStagingBuffers;
+		vk::DeviceSize openBytes;
+		std::deque<Batch> inFlightBatches;
+
+		std::vector<vk::BufferMemoryBarrier> openBufferReleases;
+		std::vector<vk::ImageMemoryBarrier> openImageReleases;
+		std::vector<vk::BufferMemoryBarrier> openBufferAcquires;
+		std::vector<vk::ImageMemoryBarrier> openImageAcquires;
+		std::vector<vk::BufferMemoryBarrier> submittedBufferAcquires;
+		std::vector<vk::ImageMemoryBarrier> submittedImageAcquires;
+
+		Stats stats;
+		std::chrono::high_resolution_clock::time_point busyStart;
+	};
+}
\ No newline at end of file
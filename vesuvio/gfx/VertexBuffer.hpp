@@ -5,6 +5,7 @@
 #if VSV_GFX_BACKEND(VULKAN)
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
+#include "GeometryArena.hpp"
 #endif
 
 #include "Vertex.hpp"
@@ -12,12 +13,10 @@
 namespace vesuvio {
 	struct VertexBuffer
 	{
-		std::vector<Vertex> vertices;
 #if VSV_GFX_BACKEND(VULKAN)
 		struct 
 		{
-			vk::Buffer buffer;
-			VmaAllocation bufferAlloc;
+			GeometryArena::Allocation allocation; // drawn with allocation.first as vertexOffset
 		} vk;
 #endif
 	};
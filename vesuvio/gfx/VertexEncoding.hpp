@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace vesuvio {
+	// Storage format of the vertex streams of a Mesh, every attribute can be quantized on its own.
+	// The shaders read all variants as floats, only the vertex input state differs.
+	struct VertexEncoding
+	{
+		enum class Position : uint8_t
+		{
+			Float32, // vec3
+			Float16, // half4, w is padding
+		};
+
+		enum class Color : uint8_t
+		{
+			Float32, // vec3
+			Unorm8, // rgba8, a is padding
+		};
+
+		enum class TexCoord : uint8_t
+		{
+			Float32, // vec2
+			Unorm16, // clamped to [0, 1], meshes with wrapping UVs have to keep Float32
+		};
+
+		static const uint32_t VARIANT_COUNT = 8;
+
+		Position position = Position::Float32;
+		Color color = Color::Float32;
+		TexCoord texCoord = TexCoord::Float32;
+
+		static VertexEncoding quantized() {
+			VertexEncoding encoding;
+			encoding.position = Position::Float16;
+			encoding.color = Color::Unorm8;
+			encoding.texCoord = TexCoord::Unorm16;
+			return encoding;
+		}
+
+		// Unique for every combination, in [0, VARIANT_COUNT)
+		uint32_t getIndex() const {
+			return static_cast<uint32_t>(position) | static_cast<uint32_t>(color) << 1 | static_cast<uint32_t>(texCoord) << 2;
+		}
+
+		uint32_t getPositionStride() const { return position == Position::Float16 ? 8 : 12; }
+		uint32_t getColorSize() const { return color == Color::Unorm8 ? 4 : 12; }
+		uint32_t getTexCoordSize() const { return texCoord == TexCoord::Unorm16 ? 4 : 8; }
+		// color followed by texCoord
+		uint32_t getRemainderStride() const { return getColorSize() + getTexCoordSize(); }
+		uint32_t getBytesPerVertex() const { return getPositionStride() + getRemainderStride(); }
+
+		bool operator==(const VertexEncoding& other) const { return getIndex() == other.getIndex(); }
+		bool operator!=(const VertexEncoding& other) const { return !(*this == other); }
+	};
+}
\ No newline at end of file
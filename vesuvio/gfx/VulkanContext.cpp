@@ -2,6 +2,9 @@
 
 #include <fstream>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iterator>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -21,6 +24,11 @@
 
 #include "UniformBufferObject.hpp"
 #include "VertexBuffer.hpp"
+#include "RenderPass.hpp"
+#include "Mesh.hpp"
+#include "TextureFile.hpp"
+#include "ObjectBuffer.hpp"
+#include "Frustum.hpp"
 
 namespace vesuvio {
 
@@ -38,7 +46,10 @@ namespace vesuvio {
 	std::vector<char> readFile(const std::string& fileName) {
 		std::ifstream file(fileName, std::ios::ate | std::ios::binary);
 
-		assert(file.is_open());
+		if (!file.is_open()) {
+			printf("Failed to open '%s'\n", fileName.data());
+			return {};
+		}
 		size_t fileSize = (size_t)file.tellg();
 		std::vector<char> buffer(fileSize);
 		file.seekg(0);
@@ -49,6 +60,14 @@ namespace vesuvio {
 		return buffer;
 	}
 
+	inline bool fileExists(const char* fileName) {
+		return std::ifstream(fileName, std::ios::binary).is_open();
+	}
+
+	inline vk::IndexType toVkIndexType(IndexType indexType) {
+		return indexType == IndexType::Uint16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+	}
+
 	void DestroyDebugUtilsMessengerEXT(vk::Instance& instance, vk::DebugUtilsMessengerEXT debugMessenger, const vk::AllocationCallbacks* allocator) {
 		auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
 		if (func != nullptr) {
@@ -56,25 +75,53 @@ namespace vesuvio {
 		}
 	}
 
-	VulkanContext::VulkanContext()
+	VulkanContext::VulkanContext(uint32_t maxFramesInFlight)
 	: instance()
 	, allocator()
 	, currentFrame(0)
 	, depthImageAlloc()
 	, swapChainFormat()
 	, window(nullptr)
+	, headless(false)
+	, swapChainDirty(false)
+	, presentStats()
+	, nextFrameWaited(false)
+	, memoryBudgetSupported(false)
+	, gpuDrivenSupported(false)
+	, drawIndirectCountSupported(false)
+	, bindlessSupported(false)
+	, bindlessCapacity(0)
+	, bindlessIndexCount(0)
+	, fragmentShaderFile("assets/shaders/compiled/simple.frag.spv")
+	, maxFramesInFlight(maxFramesInFlight)
+	, frameStats()
+	, frame()
+	, drawStats()
+	, textureStats()
+	, cullStats()
+	, staleHandleReported(false)
+	, materialSetsMissing(false)
+	, cullValidation(false)
 	{
+		assert(maxFramesInFlight > 0);
 
 	}
 
 	void VulkanContext::init(const char* appName, GLFWwindow* window) {
 		this->window = window;
+		headless = false;
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 		createInstance(appName);
 		setupDebugMessenger();
 		createSurface(window);
 		pickPhysicalDevice();
 		createLogicalDevice();
 		createVmaAllocator();
+		createUploadManager();
+		createTextureStreamer();
+		createGeometryArenas();
+		createGpuProfiler();
+		createPipelineCache();
 		createSwapChain();
 		createSwapChainImageViews();
 		createSyncObjects();
@@ -84,16 +131,46 @@ namespace vesuvio {
 		createCommandPools();
 		createDepthResources();
 		createFramebuffers();
+		createTextureSampler();
+		createUniformBuffers();
+		createDescriptorPool();
 		createSampledImage();
+		createCommandBuffers();
+	}
+
+	void VulkanContext::initHeadless(const char* appName, uint32_t width, uint32_t height) {
+		window = nullptr;
+		headless = true;
+		headlessExtent = vk::Extent2D{ width, height };
+		createInstance(appName);
+		setupDebugMessenger();
+		pickPhysicalDevice();
+		createLogicalDevice();
+		createVmaAllocator();
+		createUploadManager();
+		createTextureStreamer();
+		createGeometryArenas();
+		createGpuProfiler();
+		createPipelineCache();
+		createOffscreenTargets();
+		createSyncObjects();
+		createRenderPass();
+		createDescriptorSetLayout();
+		createGraphicsPipeline();
+		createCommandPools();
+		createDepthResources();
+		createFramebuffers();
 		createTextureSampler();
-		vb = createVertexBuffer(vertices.data(), (uint16_t)vertices.size());
-		ib = createIndexBuffer(indices.data(), (uint32_t)indices.size());
 		createUniformBuffers();
 		createDescriptorPool();
-		createDescriptorSets();
+		createSampledImage();
 		createCommandBuffers();
 	}
 
+	void VulkanContext::setReadbackCallback(ReadbackFunc readbackFn) {
+		readbackFunc = readbackFn;
+	}
+
 	void VulkanContext::createInstance(const char* appName) {
 
 		vk::ApplicationInfo appInfo(
@@ -159,17 +236,7 @@ namespace vesuvio {
 		);
 	}
 
-	vk::ShaderModule VulkanContext::createShaderModule(const std::vector<char>& shaderCode) {
-		vk::ShaderModuleCreateInfo createInfo{};
-		createInfo.codeSize = shaderCode.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
-
-		vk::ShaderModule shaderModule = device.createShaderModule(createInfo);
-		assert(shaderModule);
-		return shaderModule;
-	}
-
-	vk::ImageView VulkanContext::createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags) {
+	vk::ImageView VulkanContext::createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels) {
 		vk::ImageViewCreateInfo viewInfo{};
 		viewInfo.image = image;
 		viewInfo.viewType = vk::ImageViewType::e2D;
@@ -180,7 +247,7 @@ namespace vesuvio {
 		viewInfo.components.a = vk::ComponentSwizzle::eIdentity;
 		viewInfo.subresourceRange.aspectMask = aspectFlags;
 		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.levelCount = mipLevels;
 		viewInfo.subresourceRange.baseArrayLayer = 0;
 		viewInfo.subresourceRange.layerCount = 1;
 
@@ -239,156 +306,6 @@ namespace vesuvio {
 		return vk::Result(result);
 	}
 
-	void VulkanContext::copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size, vk::CommandBuffer commandBuffer) {
-		bool usesLocalCommandBuffer = !commandBuffer;
-		if (usesLocalCommandBuffer) {
-			commandBuffer = beginOneTimeCommandBuffer(transferCommandPool);
-		}
-
-		vk::BufferCopy copyRegion{};
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
-		copyRegion.size = size;
-		commandBuffer.copyBuffer(srcBuffer, dstBuffer, copyRegion);
-
-		if (usesLocalCommandBuffer) {
-			endOneTimeCommandBuffer(commandBuffer, transferCommandPool, transferQueue);
-		}
-
-		printf("Copied %llu bytes between buffers\n", size);
-	}
-
-	void VulkanContext::copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height, vk::CommandBuffer commandBuffer) {
-		bool usesLocalCommandBuffer = !commandBuffer;
-		if (usesLocalCommandBuffer) {
-			commandBuffer = beginOneTimeCommandBuffer(transferCommandPool);
-		}
-
-		vk::BufferImageCopy copyRegion{};
-		copyRegion.bufferOffset = 0;
-		copyRegion.bufferRowLength = 0;
-		copyRegion.bufferImageHeight = 0;
-
-		copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-		copyRegion.imageSubresource.mipLevel = 0;
-		copyRegion.imageSubresource.baseArrayLayer = 0;
-		copyRegion.imageSubresource.layerCount = 1;
-
-		copyRegion.imageOffset = vk::Offset3D{ 0, 0, 0 };
-		copyRegion.imageExtent = vk::Extent3D{ width, height, 1 };
-
-		commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
-
-		if (usesLocalCommandBuffer) {
-			endOneTimeCommandBuffer(commandBuffer, transferCommandPool, transferQueue);
-		}
-
-		printf("Copied from buffer to image (%ux%u)\n", width, height);
-	}
-
-	vk::CommandBuffer VulkanContext::beginOneTimeCommandBuffer(vk::CommandPool pool) {
-		vk::CommandBufferAllocateInfo allocInfo{};
-		allocInfo.level = vk::CommandBufferLevel::ePrimary;
-		allocInfo.commandPool = pool;
-		allocInfo.commandBufferCount = 1;
-
-		vk::CommandBuffer commandBuffer = device.allocateCommandBuffers(allocInfo)[0];
-
-		vk::CommandBufferBeginInfo beginInfo{};
-		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-
-		commandBuffer.begin(beginInfo);
-
-		return commandBuffer;
-	}
-
-	void VulkanContext::endOneTimeCommandBuffer(vk::CommandBuffer commandBuffer, vk::CommandPool pool, vk::Queue queue) {
-		commandBuffer.end();
-
-		vk::SubmitInfo submitInfo{};
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		queue.submit(submitInfo, nullptr);
-		queue.waitIdle();
-
-		device.freeCommandBuffers(pool, commandBuffer);
-	}
-
-	void VulkanContext::transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::CommandBuffer commandBuffer) {
-		bool usesLocalCommandBuffer = !commandBuffer;
-		if (usesLocalCommandBuffer) {
-			commandBuffer = beginOneTimeCommandBuffer(graphicsCommandPool);
-		}
-
-		vk::ImageMemoryBarrier imageBarrier{};
-		imageBarrier.oldLayout = oldLayout;
-		imageBarrier.newLayout = newLayout;
-		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageBarrier.image = image;
-		if (newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
-			imageBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-
-			if (hasStencilComponent(format)) {
-				imageBarrier.subresourceRange.aspectMask |= vk::ImageAspectFlagBits::eStencil;
-			}
-		}
-		else {
-			imageBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-		}
-		imageBarrier.subresourceRange.baseMipLevel = 0;
-		imageBarrier.subresourceRange.levelCount = 1;
-		imageBarrier.subresourceRange.baseArrayLayer = 0;
-		imageBarrier.subresourceRange.layerCount = 1;
-
-		imageBarrier.srcAccessMask = vk::AccessFlags(); // TODO
-		imageBarrier.dstAccessMask = vk::AccessFlags(); // TODO
-
-		vk::PipelineStageFlags sourceStage;
-		vk::PipelineStageFlags destinationStage;
-
-		if (oldLayout == vk::ImageLayout::eUndefined ) {
-			imageBarrier.srcAccessMask = vk::AccessFlags();
-			sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		}
-		else if (oldLayout == vk::ImageLayout::eTransferDstOptimal) {
-			imageBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-			sourceStage = vk::PipelineStageFlagBits::eTransfer;
-		}
-		else {
-			assert(false);
-		}
-
-		if (newLayout == vk::ImageLayout::eTransferDstOptimal) {
-			imageBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-			destinationStage = vk::PipelineStageFlagBits::eTransfer;
-		}
-		else if (newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-			imageBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-			destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-		}
-		else if (newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
-			imageBarrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-			destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-		}
-		else {
-			assert(false);
-		}
-
-		commandBuffer.pipelineBarrier(
-			sourceStage, destinationStage,
-			vk::DependencyFlags(),
-			{}, // No memory barriers
-			{}, // No buffer memory barriers
-			imageBarrier
-		);
-
-		if (usesLocalCommandBuffer) {
-			endOneTimeCommandBuffer(commandBuffer, graphicsCommandPool, graphicsQueue);
-		}
-	}
-
 	void VulkanContext::setupDebugMessenger() {
 		if (!enableValidationLayers) return;
 
@@ -428,7 +345,10 @@ namespace vesuvio {
 			printf("Didn't find all required queue families!\n");
 			rating = 0.0f;
 		}
-		if (checkDeviceExtensionSupport(device)) {
+		if (!checkDeviceExtensionSupport(device)) {
+			rating = 0.0f;
+		}
+		else if (!headless) {
 			auto swapChainSupport = querySwapChainSupport(device);
 			if (swapChainSupport.formats.empty()) {
 				printf("No swap chain formats found!\n");
@@ -439,8 +359,13 @@ namespace vesuvio {
 				rating = 0.0f;
 			}
 		}
-		else {
-			rating = 0.0f;
+
+		if (rating > 0.0f) {
+			auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+			if (!features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore) {
+				printf("Timeline semaphores not supported!\n");
+				rating = 0.0f;
+			}
 		}
 
 		if (rating > 0.0f) {
@@ -483,8 +408,12 @@ namespace vesuvio {
 			if (!indices.graphics.has_value() && queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) {
 				indices.graphics = i;
 			}
-			if (!indices.present.has_value() && device.getSurfaceSupportKHR(i, surface)) {
-				indices.present = i;
+			if (!indices.present.has_value()) {
+				// Nothing is presented in headless mode, the graphics queue stands in for the present queue
+				bool canPresent = headless ? static_cast<bool>(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) : device.getSurfaceSupportKHR(i, surface);
+				if (canPresent) {
+					indices.present = i;
+				}
 			}
 			if (!indices.transfer.has_value() && queueFamily.queueFlags & vk::QueueFlagBits::eTransfer && !(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)) {
 				indices.transfer = i;
@@ -496,6 +425,11 @@ namespace vesuvio {
 			i++;
 		}
 
+		// Not every device (e.g. software implementations) has a dedicated transfer queue family
+		if (!indices.transfer.has_value() && indices.graphics.has_value()) {
+			indices.transfer = indices.graphics;
+		}
+
 		return indices;
 	}
 
@@ -519,12 +453,26 @@ namespace vesuvio {
 	}
 
 	vk::PresentModeKHR VulkanContext::chooseSwapChainPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes) {
-		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == vk::PresentModeKHR::eMailbox) {
-				return availablePresentMode;
+		auto isAvailable = [&](vk::PresentModeKHR presentMode) {
+			return std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end();
+		};
+
+		switch (presentPolicy.mode) {
+		case PresentMode::Immediate:
+			if (isAvailable(vk::PresentModeKHR::eImmediate)) {
+				return vk::PresentModeKHR::eImmediate;
+			}
+			[[fallthrough]];
+		case PresentMode::Mailbox:
+			if (isAvailable(vk::PresentModeKHR::eMailbox)) {
+				return vk::PresentModeKHR::eMailbox;
 			}
+			break;
+		default:
+			break;
 		}
 
+		// The only mode every device has to support
 		return vk::PresentModeKHR::eFifo;
 	}
 
@@ -572,11 +520,14 @@ namespace vesuvio {
 	}
 
 	std::vector<const char*> VulkanContext::getRequiredExtensions() {
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		std::vector<const char*> extensions;
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		if (!headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (enableValidationLayers) {
 			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -642,12 +593,57 @@ namespace vesuvio {
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		auto supportedFeatures = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+		const vk::PhysicalDeviceFeatures& supportedFeatures10 = supportedFeatures.get<vk::PhysicalDeviceFeatures2>().features;
 		vk::PhysicalDeviceFeatures deviceFeatures{};
-		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.samplerAnisotropy = supportedFeatures10.samplerAnisotropy;
+		// Optional, object buffers draw all objects with one indirect draw and pass the object index as firstInstance
+		gpuDrivenSupported = supportedFeatures10.multiDrawIndirect && supportedFeatures10.drawIndirectFirstInstance;
+		if (gpuDrivenSupported && !(fileExists("assets/shaders/compiled/cull.comp.spv") && fileExists("assets/shaders/compiled/indirect.vert.spv"))) {
+			printf("cull.comp.spv or indirect.vert.spv is missing, GPU driven drawing is disabled\n");
+			gpuDrivenSupported = false;
+		}
+		deviceFeatures.multiDrawIndirect = gpuDrivenSupported;
+		deviceFeatures.drawIndirectFirstInstance = gpuDrivenSupported;
+		drawIndirectCountSupported = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+		// Optional, textures are sampled through one global table instead of a set per material
+		const vk::PhysicalDeviceVulkan12Features& supportedFeatures12 = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>();
+		bindlessSupported = supportedFeatures12.runtimeDescriptorArray && supportedFeatures12.descriptorBindingPartiallyBound
+			&& supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind && supportedFeatures12.descriptorBindingUpdateUnusedWhilePending;
+		if (bindlessSupported) {
+			// Without the shader materials keep a set per albedo, which simple.frag samples
+			if (fileExists("assets/shaders/compiled/bindless.frag.spv")) {
+				fragmentShaderFile = "assets/shaders/compiled/bindless.frag.spv";
+			}
+			else {
+				printf("bindless.frag.spv is missing, falling back to simple.frag.spv\n");
+				bindlessSupported = false;
+			}
+		}
+		vk::PhysicalDeviceVulkan12Features deviceFeatures12{};
+		deviceFeatures12.timelineSemaphore = VK_TRUE;
+		deviceFeatures12.drawIndirectCount = drawIndirectCountSupported;
+		deviceFeatures12.runtimeDescriptorArray = bindlessSupported;
+		deviceFeatures12.descriptorBindingPartiallyBound = bindlessSupported;
+		deviceFeatures12.descriptorBindingSampledImageUpdateAfterBind = bindlessSupported;
+		deviceFeatures12.descriptorBindingUpdateUnusedWhilePending = bindlessSupported;
+		// Optional, lets VMA report the real heap budgets which the texture streamer is bound by
+		std::vector<const char*> enabledExtensions = deviceExtensions;
+		for (const auto& extension : physicalDevice.enumerateDeviceExtensionProperties()) {
+			if (!strcmp(extension.extensionName.data(), VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+				memoryBudgetSupported = true;
+				enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+				break;
+			}
+		}
+
 		vk::DeviceCreateInfo createInfo{};
+		createInfo.pNext = &deviceFeatures12;
 		createInfo.setQueueCreateInfos(queueCreateInfos);
 		createInfo.setPEnabledFeatures(&deviceFeatures);
-		createInfo.setPEnabledExtensionNames(deviceExtensions);
+		if (!enabledExtensions.empty()) {
+			createInfo.setPEnabledExtensionNames(enabledExtensions);
+		}
 
 		device = physicalDevice.createDevice(createInfo);
 		assert(device);
@@ -669,11 +665,68 @@ namespace vesuvio {
 		allocatorInfo.physicalDevice = physicalDevice;
 		allocatorInfo.device = device;
 		allocatorInfo.instance = instance;
+		if (memoryBudgetSupported) {
+			allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
 		
 		vmaCreateAllocator(&allocatorInfo, &allocator);
 	}
 
-	void VulkanContext::createSwapChain() {
+	void VulkanContext::createUploadManager() {
+		uploadManager.create(
+			device, allocator,
+			transferQueue, queueFamilyIndices.transfer.value(), queueFamilyIndices.graphics.value(),
+			UPLOAD_STAGING_SIZE
+		);
+	}
+
+	std::vector<uint32_t> VulkanContext::getUploadQueueFamilies() {
+		std::vector<uint32_t> queueFamilies = { queueFamilyIndices.graphics.value() };
+		if (queueFamilyIndices.transfer.value() != queueFamilyIndices.graphics.value()) {
+			queueFamilies.push_back(queueFamilyIndices.transfer.value());
+		}
+		return queueFamilies;
+	}
+
+	void VulkanContext::createGeometryArenas() {
+		// Shared with the transfer queue, so uploads into one block don't need an ownership transfer of the whole buffer
+		const std::vector<uint32_t> queueFamilies = getUploadQueueFamilies();
+		vertexArena.create("vertices", allocator, vk::BufferUsageFlagBits::eVertexBuffer, sizeof(Vertex), VERTEX_ARENA_BLOCK_SIZE, queueFamilies);
+		streamArena.create("vertex streams", allocator, vk::BufferUsageFlagBits::eVertexBuffer, 4, STREAM_ARENA_BLOCK_SIZE, queueFamilies);
+		index16Arena.create("16-bit indices", allocator, vk::BufferUsageFlagBits::eIndexBuffer, sizeof(uint16_t), INDEX_ARENA_BLOCK_SIZE, queueFamilies);
+		index32Arena.create("32-bit indices", allocator, vk::BufferUsageFlagBits::eIndexBuffer, sizeof(uint32_t), INDEX_ARENA_BLOCK_SIZE, queueFamilies);
+	}
+
+	void VulkanContext::createTextureStreamer() {
+		textureStreamer.create(device, allocator, &uploadManager, maxFramesInFlight);
+	}
+
+	void VulkanContext::createPipelineCache() {
+		pipelineCache.create(device, physicalDevice.getProperties(), PIPELINE_CACHE_FILE);
+	}
+
+	void VulkanContext::createGpuProfiler() {
+#if VSV_GPU_PROFILER()
+		std::vector<vk::QueueFamilyProperties> queueFamilies = physicalDevice.getQueueFamilyProperties();
+		gpuProfiler.create(
+			device,
+			physicalDevice.getProperties().limits.timestampPeriod,
+			queueFamilies[queueFamilyIndices.graphics.value()].timestampValidBits,
+			maxFramesInFlight
+		);
+#endif
+	}
+
+	const std::vector<GpuScopeTiming>& VulkanContext::getGpuTimings() const {
+#if VSV_GPU_PROFILER()
+		return gpuProfiler.getTimings();
+#else
+		static const std::vector<GpuScopeTiming> noTimings;
+		return noTimings;
+#endif
+	}
+
+	void VulkanContext::createSwapChain(vk::SwapchainKHR oldSwapChain) {
 		printf("Creating swap chain\n");
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
@@ -713,16 +766,69 @@ namespace vesuvio {
 		createInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
-		createInfo.oldSwapchain = nullptr;
+		// Lets the presentation engine hand over resources, the old swap chain is retired but stays valid
+		createInfo.oldSwapchain = oldSwapChain;
 
 		swapChain = device.createSwapchainKHR(createInfo);
 		assert(swapChain);
+		presentStats.presentMode = presentMode;
 
 		swapChainImages = device.getSwapchainImagesKHR(swapChain);
 		swapChainFormat = surfaceFormat.format;
 		swapChainExtent = extent;
 	}
 
+	void VulkanContext::createOffscreenTargets() {
+		printf("Creating %u offscreen targets (%ux%u)\n", maxFramesInFlight, headlessExtent.width, headlessExtent.height);
+		swapChainFormat = convertToVkFormat(Texture::Format::R8G8B8A8Srgb);
+		swapChainExtent = headlessExtent;
+
+		// One target per frame in flight, so a frame never has to wait for the readback of another one
+		offscreenTargets.resize(maxFramesInFlight);
+		readbackBuffers.resize(maxFramesInFlight);
+		readbackBufferAllocs.resize(maxFramesInFlight);
+		readbackData.resize(maxFramesInFlight);
+		readbackFrames.assign(maxFramesInFlight, NO_READBACK);
+
+		const vk::DeviceSize readbackSize = static_cast<vk::DeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			offscreenTargets[i] = createTexture(
+				swapChainExtent.width, swapChainExtent.height, 1,
+				Texture::Format::R8G8B8A8Srgb,
+				Texture::FlagBits::RenderTarget | Texture::FlagBits::TransferSrc,
+				Texture::SampleCount::Samples1,
+				Texture::MemoryUsage::GpuOnly
+			);
+
+			VK_CHECK(createBuffer(
+				readbackSize,
+				vk::BufferUsageFlagBits::eTransferDst,
+				queueFamilyIndices.graphics.value(),
+				VMA_MEMORY_USAGE_GPU_TO_CPU,
+				readbackBuffers[i], readbackBufferAllocs[i]
+			));
+			// Stays mapped for the lifetime of the buffer
+			vmaMapMemory(allocator, readbackBufferAllocs[i], &readbackData[i]);
+		}
+	}
+
+	void VulkanContext::destroyOffscreenTargets() {
+		for (uint32_t i = 0; i < offscreenTargets.size(); i++) {
+			const Texture* target = textures.get(offscreenTargets[i]);
+			device.destroyImageView(target->vk.imageView);
+			vmaDestroyImage(allocator, target->vk.image, target->vk.imageAlloc);
+			textures.destroy(offscreenTargets[i]);
+
+			vmaUnmapMemory(allocator, readbackBufferAllocs[i]);
+			vmaDestroyBuffer(allocator, readbackBuffers[i], readbackBufferAllocs[i]);
+		}
+		offscreenTargets.clear();
+		readbackBuffers.clear();
+		readbackBufferAllocs.clear();
+		readbackData.clear();
+		readbackFrames.clear();
+	}
+
 	void VulkanContext::createSwapChainImageViews() {
 		swapChainImageViews.resize(swapChainImages.size());
 		for (uint32_t i = 0; i < swapChainImages.size(); i++) {
@@ -739,7 +845,8 @@ namespace vesuvio {
 		colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
 		colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
 		colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
-		colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+		// Offscreen targets are left ready to be read back
+		colorAttachment.finalLayout = headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
 
 		vk::AttachmentReference colorAttachmentRef{};
 		colorAttachmentRef.attachment = 0;
@@ -769,10 +876,12 @@ namespace vesuvio {
 		vk::SubpassDependency dependency{};
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 		dependency.dstSubpass = 0;
-		dependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-		dependency.srcAccessMask = vk::AccessFlagBits(0);
-		dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-		dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+		// The depth image is shared by all frames in flight, the depth writes of the previous frame
+		// (which can still happen in the late fragment tests) have to finish before this frame clears it
+		dependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		dependency.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+		dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
 
 		vk::RenderPassCreateInfo renderPassInfo{};
 		renderPassInfo.setAttachments(attachments);
@@ -786,7 +895,7 @@ namespace vesuvio {
 	void VulkanContext::createDescriptorSetLayout() {
 		vk::DescriptorSetLayoutBinding uboLayoutBinding{};
 		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBuffer;
+		uboLayoutBinding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
 		uboLayoutBinding.descriptorCount = 1;
 		uboLayoutBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
 		uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
@@ -810,17 +919,207 @@ namespace vesuvio {
 		descriptorSetLayout = device.createDescriptorSetLayout(layoutInfo);
 		assert(descriptorSetLayout);
 
+		if (bindlessSupported) {
+			createBindlessTable();
+		}
+	}
+
+	void VulkanContext::createBindlessTable() {
+		auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+		const vk::PhysicalDeviceVulkan12Properties& properties12 = properties.get<vk::PhysicalDeviceVulkan12Properties>();
+		// The limits count all sets of the pipeline layout, the fragment stage also has the albedo of set 0 and a color attachment
+		bindlessCapacity = std::min({
+			MAX_BINDLESS_TEXTURES,
+			properties12.maxPerStageDescriptorUpdateAfterBindSamplers - 1,
+			properties12.maxPerStageDescriptorUpdateAfterBindSampledImages - 1,
+			properties12.maxDescriptorSetUpdateAfterBindSamplers - 1,
+			properties12.maxDescriptorSetUpdateAfterBindSampledImages - 1,
+			properties12.maxPerStageUpdateAfterBindResources - 2
+		});
+
+		vk::DescriptorSetLayoutBinding textureBinding{};
+		textureBinding.binding = 0;
+		textureBinding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+		textureBinding.descriptorCount = bindlessCapacity;
+		textureBinding.stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+		// Slots are written while frames in flight sample other slots of the same set
+		vk::DescriptorBindingFlags bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound
+			| vk::DescriptorBindingFlagBits::eUpdateAfterBind
+			| vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.setBindingFlags(bindingFlags);
+
+		vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+		layoutInfo.setBindings(textureBinding);
+		bindlessSetLayout = device.createDescriptorSetLayout(layoutInfo);
+		assert(bindlessSetLayout);
+
+		vk::DescriptorPoolSize poolSize{};
+		poolSize.type = vk::DescriptorType::eCombinedImageSampler;
+		poolSize.descriptorCount = bindlessCapacity;
+		vk::DescriptorPoolCreateInfo poolInfo{};
+		poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+		poolInfo.setPoolSizes(poolSize);
+		poolInfo.maxSets = 1;
+		bindlessDescriptorPool = device.createDescriptorPool(poolInfo);
+		assert(bindlessDescriptorPool);
+
+		vk::DescriptorSetAllocateInfo allocInfo{};
+		allocInfo.descriptorPool = bindlessDescriptorPool;
+		allocInfo.setSetLayouts(bindlessSetLayout);
+		bindlessDescriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+		printf("Created bindless texture table with %u slots\n", bindlessCapacity);
+	}
+
+	void VulkanContext::registerBindlessTexture(Texture* texture) {
+		if (!bindlessSupported) {
+			return;
+		}
+		assert(textureSampler && texture->bindlessIndex == Texture::NO_BINDLESS_INDEX);
+
+		uint32_t index;
+		if (!freeBindlessIndices.empty()) {
+			index = freeBindlessIndices.back();
+			freeBindlessIndices.pop_back();
+		}
+		else if (bindlessIndexCount < bindlessCapacity) {
+			index = bindlessIndexCount++;
+		}
+		else {
+			printf("Bindless texture table is full (%u slots), the texture is drawn with the default one\n", bindlessCapacity);
+			return;
+		}
+
+		vk::DescriptorImageInfo imageInfo{};
+		imageInfo.sampler = textureSampler;
+		imageInfo.imageView = texture->vk.imageView;
+		imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+		vk::WriteDescriptorSet descriptorWrite{};
+		descriptorWrite.dstSet = bindlessDescriptorSet;
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = index;
+		descriptorWrite.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+		device.updateDescriptorSets(descriptorWrite, {});
+
+		texture->bindlessIndex = index;
+	}
+
+	void VulkanContext::releaseBindlessIndex(uint32_t index) {
+		if (index != Texture::NO_BINDLESS_INDEX) {
+			freeBindlessIndices.push_back(index);
+		}
+	}
+
+	void VulkanContext::bindBindlessTexture(vk::CommandBuffer commandBuffer, const Material* material, bool& setBound, uint32_t& pushedIndex) {
+		if (!setBound) {
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, bindlessDescriptorSet, {});
+			setBound = true;
+		}
+		const uint32_t index = material->albedo->bindlessIndex != Texture::NO_BINDLESS_INDEX ? material->albedo->bindlessIndex : textures.get(sampledImage)->bindlessIndex;
+		if (index != pushedIndex) {
+			commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(index), &index);
+			pushedIndex = index;
+		}
+	}
+
+	std::vector<vk::PushConstantRange> VulkanContext::getMaterialPushConstantRanges() const {
+		if (!bindlessSupported) {
+			return {};
+		}
+		// Table index of the albedo
+		vk::PushConstantRange textureIndexRange{};
+		textureIndexRange.stageFlags = vk::ShaderStageFlagBits::eFragment;
+		textureIndexRange.offset = 0;
+		textureIndexRange.size = sizeof(uint32_t);
+		return { textureIndexRange };
 	}
 
 	void VulkanContext::createGraphicsPipeline() {
-		const std::string vertShaderFile = "assets/shaders/compiled/simple.vert.spv";
-		auto vertShaderCode = readFile(vertShaderFile);
+		std::vector<vk::DescriptorSetLayout> setLayouts = { descriptorSetLayout };
+		if (bindlessSupported) {
+			setLayouts.push_back(bindlessSetLayout);
+		}
+		const std::vector<vk::PushConstantRange> pushConstantRanges = getMaterialPushConstantRanges();
+		vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.setSetLayouts(setLayouts);
+		pipelineLayoutInfo.setPushConstantRanges(pushConstantRanges);
+
+		pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+		assert(pipelineLayout);
+
+		createMainPipelines();
+	}
+
+	void VulkanContext::createMainPipelines() {
+		std::array<vk::VertexInputBindingDescription, 1> bindingDescriptions = Vertex::getBindingDescriptions();
+		std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions = Vertex::getAttributeDescriptions();
+
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());;
+		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+		graphicsPipeline = createGraphicsPipeline(vertexInputInfo, "assets/shaders/compiled/simple.vert.spv", pipelineLayout);
+		// The float variant is always needed, quantized variants are created on first use
+		getMeshPipeline(VertexEncoding());
+	}
+
+	vk::Pipeline VulkanContext::getMeshPipeline(const VertexEncoding& encoding) {
+		vk::Pipeline& pipeline = meshPipelines[encoding.getIndex()];
+		if (!pipeline) {
+			// Same shaders fed from the split streams of a Mesh
+			std::array<vk::VertexInputBindingDescription, 2> bindingDescriptions = Mesh::getBindingDescriptions(encoding);
+			std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions = Mesh::getAttributeDescriptions(encoding);
+
+			vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
+			vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+			vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+			vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+			vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
-		const std::string fragShaderFile = "assets/shaders/compiled/simple.frag.spv";
-		auto fragShaderCode = readFile(fragShaderFile);
+			pipeline = createGraphicsPipeline(vertexInputInfo, "assets/shaders/compiled/simple.vert.spv", pipelineLayout);
+		}
+		return pipeline;
+	}
+
+	vk::Pipeline VulkanContext::getInstancedPipeline() {
+		if (!instancedPipeline) {
+			// Interleaved vertices at binding 0, the instance stream at binding 1
+			std::array<vk::VertexInputBindingDescription, 2> bindingDescriptions = {
+				Vertex::getBindingDescriptions()[0],
+				InstanceData::getBindingDescription()
+			};
+			std::array<vk::VertexInputAttributeDescription, 3> vertexAttributes = Vertex::getAttributeDescriptions();
+			std::array<vk::VertexInputAttributeDescription, 5> instanceAttributes = InstanceData::getAttributeDescriptions();
+			std::vector<vk::VertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+			attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+
+			vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
+			vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+			vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+			vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+			vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+			instancedPipeline = createGraphicsPipeline(vertexInputInfo, "assets/shaders/compiled/instanced.vert.spv", pipelineLayout);
+		}
+		return instancedPipeline;
+	}
 
-		vk::ShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-		vk::ShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+	vk::Pipeline VulkanContext::createGraphicsPipeline(const vk::PipelineVertexInputStateCreateInfo& vertexInputInfo, const char* vertexShaderFile, vk::PipelineLayout layout) {
+		vk::ShaderModule vertShaderModule = pipelineCache.getShaderModule(vertexShaderFile);
+		vk::ShaderModule fragShaderModule = pipelineCache.getShaderModule(fragmentShaderFile);
+		if (!fragShaderModule) {
+			// Samples the albedo of the material set, which is the default texture while the bindless table is used
+			fragShaderModule = pipelineCache.getShaderModule("assets/shaders/compiled/simple.frag.spv");
+		}
+		assert(vertShaderModule && fragShaderModule);
 
 		vk::PipelineShaderStageCreateInfo vertShaderStageInfo{};
 		vertShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
@@ -834,15 +1133,6 @@ namespace vesuvio {
 
 		vk::PipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-		std::array<vk::VertexInputBindingDescription, 1> bindingDescriptions = Vertex::getBindingDescriptions();
-		std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());;
-		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
 		vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
 		inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
 		inputAssembly.primitiveRestartEnable = VK_FALSE;
@@ -912,13 +1202,6 @@ namespace vesuvio {
 		dynamicStateInfo.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
 		dynamicStateInfo.pDynamicStates = dynamicStates;
 
-		vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.setSetLayouts(descriptorSetLayout);
-		pipelineLayoutInfo.setPushConstantRanges({});
-
-		pipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
-		assert(pipelineLayout);
-
 		vk::GraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.stageCount = sizeof(shaderStages) / sizeof(shaderStages[0]);
 		pipelineInfo.pStages = shaderStages;
@@ -930,25 +1213,90 @@ namespace vesuvio {
 		pipelineInfo.pDepthStencilState = &depthStencil;
 		pipelineInfo.pColorBlendState = &colorBlending;
 		pipelineInfo.pDynamicState = &dynamicStateInfo;
-		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.layout = layout;
 		pipelineInfo.renderPass = renderPass;
 		pipelineInfo.subpass = 0;
 		pipelineInfo.basePipelineHandle = nullptr; // Optional
 		pipelineInfo.basePipelineIndex = -1; // Optional
 
-		vk::ResultValue<vk::Pipeline> result = device.createGraphicsPipeline(nullptr, pipelineInfo);
-		assert(result.result == vk::Result::eSuccess);
-		graphicsPipeline = result.value;
-
-		device.destroyShaderModule(vertShaderModule);
-		device.destroyShaderModule(fragShaderModule);
+		return pipelineCache.getGraphicsPipeline(pipelineInfo);
+	}
+
+	void VulkanContext::createGpuDrivenPipelines() {
+		std::array<vk::DescriptorSetLayoutBinding, 3> cullBindings{};
+		for (uint32_t i = 0; i < cullBindings.size(); i++) {
+			// objects, draw commands, visible count
+			cullBindings[i].binding = i;
+			cullBindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+			cullBindings[i].descriptorCount = 1;
+			cullBindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+		}
+		vk::DescriptorSetLayoutCreateInfo cullLayoutInfo{};
+		cullLayoutInfo.setBindings(cullBindings);
+		cullSetLayout = device.createDescriptorSetLayout(cullLayoutInfo);
+		assert(cullSetLayout);
+
+		vk::DescriptorSetLayoutBinding objectBinding{};
+		objectBinding.binding = 0;
+		objectBinding.descriptorType = vk::DescriptorType::eStorageBuffer;
+		objectBinding.descriptorCount = 1;
+		objectBinding.stageFlags = vk::ShaderStageFlagBits::eVertex;
+		vk::DescriptorSetLayoutCreateInfo objectLayoutInfo{};
+		objectLayoutInfo.setBindings(objectBinding);
+		objectSetLayout = device.createDescriptorSetLayout(objectLayoutInfo);
+		assert(objectSetLayout);
+
+		// planes[6], objectCount, compact
+		vk::PushConstantRange cullConstants{};
+		cullConstants.stageFlags = vk::ShaderStageFlagBits::eCompute;
+		cullConstants.offset = 0;
+		cullConstants.size = sizeof(glm::vec4) * 6 + sizeof(uint32_t) * 2;
+		vk::PipelineLayoutCreateInfo cullPipelineLayoutInfo{};
+		cullPipelineLayoutInfo.setSetLayouts(cullSetLayout);
+		cullPipelineLayoutInfo.setPushConstantRanges(cullConstants);
+		cullPipelineLayout = device.createPipelineLayout(cullPipelineLayoutInfo);
+		assert(cullPipelineLayout);
+
+		// Sets 0 and 1 stay compatible with the regular pipeline layout, so material sets and the texture table can be bound to both.
+		// Without the table set 1 is an unused placeholder
+		std::array<vk::DescriptorSetLayout, 3> indirectSetLayouts = { descriptorSetLayout, bindlessSupported ? bindlessSetLayout : objectSetLayout, objectSetLayout };
+		const std::vector<vk::PushConstantRange> materialPushConstantRanges = getMaterialPushConstantRanges();
+		vk::PipelineLayoutCreateInfo indirectPipelineLayoutInfo{};
+		indirectPipelineLayoutInfo.setSetLayouts(indirectSetLayouts);
+		indirectPipelineLayoutInfo.setPushConstantRanges(materialPushConstantRanges);
+		indirectPipelineLayout = device.createPipelineLayout(indirectPipelineLayoutInfo);
+		assert(indirectPipelineLayout);
+
+		vk::PipelineShaderStageCreateInfo cullStageInfo{};
+		cullStageInfo.stage = vk::ShaderStageFlagBits::eCompute;
+		cullStageInfo.module = pipelineCache.getShaderModule("assets/shaders/compiled/cull.comp.spv");
+		cullStageInfo.pName = "main";
+		vk::ComputePipelineCreateInfo cullPipelineInfo{};
+		cullPipelineInfo.stage = cullStageInfo;
+		cullPipelineInfo.layout = cullPipelineLayout;
+		cullPipeline = pipelineCache.getComputePipeline(cullPipelineInfo);
+
+		createIndirectPipeline();
+	}
+
+	void VulkanContext::createIndirectPipeline() {
+		// Objects are drawn from the interleaved vertex arena
+		std::array<vk::VertexInputBindingDescription, 1> bindingDescriptions = Vertex::getBindingDescriptions();
+		std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions = Vertex::getAttributeDescriptions();
+		vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+		indirectPipeline = createGraphicsPipeline(vertexInputInfo, "assets/shaders/compiled/indirect.vert.spv", indirectPipelineLayout);
 	}
 
 	void VulkanContext::createFramebuffers() {
-		swapChainFramebuffers.resize(swapChainImageViews.size());
-		for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+		const size_t framebufferCount = headless ? offscreenTargets.size() : swapChainImageViews.size();
+		swapChainFramebuffers.resize(framebufferCount);
+		for (size_t i = 0; i < framebufferCount; i++) {
 			std::array<vk::ImageView, 2> attachments = {
-				swapChainImageViews[i],
+				headless ? textures.get(offscreenTargets[i])->vk.imageView : swapChainImageViews[i],
 				depthImageView
 			};
 
@@ -966,23 +1314,23 @@ namespace vesuvio {
 	}
 
 	void VulkanContext::createCommandPools() {
-		{
-			// Graphics command pool
-			vk::CommandPoolCreateInfo poolInfo{};
-			poolInfo.queueFamilyIndex = queueFamilyIndices.graphics.value();
-			poolInfo.flags = vk::CommandPoolCreateFlagBits(0); // optional
+		// Per frame graphics command pools, reset as a whole once the frame's fence has been signaled
+		vk::CommandPoolCreateInfo poolInfo{};
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphics.value();
+		poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
 
-			graphicsCommandPool = device.createCommandPool(poolInfo);
-			assert(graphicsCommandPool);
+		frameCommandPools.resize(maxFramesInFlight);
+		for (size_t i = 0; i < frameCommandPools.size(); i++) {
+			frameCommandPools[i] = device.createCommandPool(poolInfo);
+			assert(frameCommandPools[i]);
 		}
-		{
-			// Transfer command pool
-			vk::CommandPoolCreateInfo poolInfo{};
-			poolInfo.queueFamilyIndex = queueFamilyIndices.transfer.value();
-			poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
 
-			transferCommandPool = device.createCommandPool(poolInfo);
-			assert(transferCommandPool);
+		// Command pools must only be used by one thread at a time, so every recording thread gets its own
+		recordingThreads.resize(maxFramesInFlight * MAX_RECORDING_THREADS);
+		for (RecordingThread& recordingThread : recordingThreads) {
+			recordingThread.commandPool = device.createCommandPool(poolInfo);
+			assert(recordingThread.commandPool);
+			recordingThread.usedCommandBuffers = 0;
 		}
 	}
 
@@ -997,57 +1345,12 @@ namespace vesuvio {
 			depthImage, depthImageAlloc
 		));
 		depthImageView = createImageView(depthImage, depthFormat, vk::ImageAspectFlagBits::eDepth);
-
-		transitionImageLayout(depthImage, depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-
+		// No layout transition, the render pass clears it from eUndefined every frame
 	}
 
 	void VulkanContext::createSampledImage() {
-		int texWidth;
-		int texHeight;
-		int texChannels;
-		stbi_uc* pixels = stbi_load("assets/textures/texture.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-		assert(pixels);
-
-		vk::DeviceSize imageSize = static_cast<uint64_t>(texWidth) * static_cast<uint64_t>(texHeight) * 4;
-
-		vk::Buffer stagingBuffer;
-		VmaAllocation stagingBufferAlloc;
-		VK_CHECK(createBuffer(
-			imageSize,
-			vk::BufferUsageFlagBits::eTransferSrc,
-			queueFamilyIndices.transfer.value(),
-			VMA_MEMORY_USAGE_CPU_ONLY,
-			stagingBuffer, stagingBufferAlloc
-		));
-
-		void* mappedData;
-		vmaMapMemory(allocator, stagingBufferAlloc, &mappedData);
-		memcpy(mappedData, pixels, static_cast<size_t>(imageSize));
-		vmaUnmapMemory(allocator, stagingBufferAlloc);
-		stbi_image_free(pixels);
-
-		sampledImage = createTexture((uint32_t)texWidth, (uint32_t)texHeight, 1, Texture::Format::R8G8B8A8Srgb, Texture::FlagBits::Sampled | Texture::FlagBits::TransferDst, Texture::SampleCount::Samples1, Texture::MemoryUsage::GpuOnly);
-
-		vk::CommandBuffer commandBuffer = beginOneTimeCommandBuffer(graphicsCommandPool);
-		transitionImageLayout(
-			sampledImage->vk.image, vk::Format::eR8G8B8A8Srgb,
-			vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
-			commandBuffer
-		);
-		copyBufferToImage(
-			stagingBuffer, sampledImage->vk.image,
-			static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight),
-			commandBuffer
-		);
-		transitionImageLayout(
-			sampledImage->vk.image, vk::Format::eR8G8B8A8Srgb,
-			vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
-			commandBuffer
-		);
-		endOneTimeCommandBuffer(commandBuffer, graphicsCommandPool, graphicsQueue);
-
-		vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAlloc);
+		sampledImage = loadTexture("assets/textures/texture.jpg");
+		assert(sampledImage.isValid());
 	}
 
 	void VulkanContext::createTextureSampler() {
@@ -1075,95 +1378,318 @@ namespace vesuvio {
 		samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
 		samplerInfo.mipLodBias = 0.0f;
 		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 		textureSampler = device.createSampler(samplerInfo);
 	}
 
 
 	void VulkanContext::createUniformBuffers() {
-		vk::DeviceSize bufferSize = sizeof(UniformBufferObject);
-
-		uniformBuffers.resize(swapChainImages.size());
-		uniformBufferAllocs.resize(uniformBuffers.size());
+		const vk::DeviceSize minAlignment = physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+		uniformRingBuffer.create(allocator, UNIFORM_RING_FRAME_SIZE, maxFramesInFlight, minAlignment);
+		instanceRingBuffer.create(allocator, INSTANCE_RING_FRAME_SIZE, maxFramesInFlight, sizeof(InstanceData), vk::BufferUsageFlagBits::eVertexBuffer);
+	}
 
-		for (size_t i = 0; i < uniformBuffers.size(); i++) {
-			VK_CHECK(createBuffer(
-				bufferSize,
-				vk::BufferUsageFlagBits::eUniformBuffer,
-				queueFamilyIndices.graphics.value(),
-				VMA_MEMORY_USAGE_CPU_TO_GPU,
-				uniformBuffers[i], uniformBufferAllocs[i]
-			));
+	void VulkanContext::createDescriptorPool() {
+		// Material sets (set 0) as well as the object and cull sets of object buffers (up to 3 storage buffers)
+		std::vector<DescriptorAllocator::PoolSize> poolSizes = {
+			{ vk::DescriptorType::eUniformBufferDynamic, 1 },
+			{ vk::DescriptorType::eCombinedImageSampler, 1 },
+			{ vk::DescriptorType::eStorageBuffer, 3 },
+		};
+		descriptorAllocator.create(device, poolSizes, DESCRIPTOR_SETS_PER_POOL, true);
+	}
+
+	Material* VulkanContext::createMaterial(TextureHandle albedo) {
+		Material* material = new Material();
+		material->albedo = textures.get(albedo.isValid() ? albedo : sampledImage);
+		assert(material->albedo);
+		writeMaterialDescriptorSet(material);
+		materials.push_back(material);
+
+		return material;
+	}
+
+	void VulkanContext::writeMaterialDescriptorSet(Material* material) {
+		// A single set per albedo serves all frames in flight and every material using it,
+		// the frame's region of the uniform ring buffer is selected with the dynamic offset.
+		// The bindless shaders select the albedo with its table index, so all materials share the set of the default texture
+		const Texture* albedo = bindlessSupported ? textures.get(sampledImage) : material->albedo;
+		material->vk.descriptorSet = descriptorAllocator.getSet(descriptorSetLayout, {
+			DescriptorAllocator::Binding::buffer(0, vk::DescriptorType::eUniformBufferDynamic, uniformRingBuffer.getBuffer(), 0, sizeof(UniformBufferObject)),
+			DescriptorAllocator::Binding::image(1, vk::DescriptorType::eCombinedImageSampler, textureSampler, albedo->vk.imageView, vk::ImageLayout::eShaderReadOnlyOptimal),
+		});
+		if (!material->vk.descriptorSet) {
+			printf("Failed to allocate a material descriptor set, the material isn't drawn until a retry succeeds\n");
+			materialSetsMissing = true;
 		}
 	}
 
-	void VulkanContext::createDescriptorPool() {
-		std::array<vk::DescriptorPoolSize, 2> poolSizes = {};
+	void VulkanContext::destroyMaterial(Material* material) {
+		// The descriptor set might still be referenced by a frame in flight
+		std::lock_guard<std::mutex> lock(retireMutex);
+		pendingRetires.materials.push_back(material);
+	}
 
-		poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+	void VulkanContext::updateStreamedTextures() {
+		auto retiredEnd = std::remove_if(retiredDescriptorSets.begin(), retiredDescriptorSets.end(), [&](const RetiredDescriptorSet& retired) {
+			if (retired.frame + maxFramesInFlight > currentFrame) {
+				return false;
+			}
+			descriptorAllocator.release(retired.descriptorSet);
+			return true;
+		});
+		retiredDescriptorSets.erase(retiredEnd, retiredDescriptorSets.end());
+		auto retiredIndicesEnd = std::remove_if(retiredBindlessIndices.begin(), retiredBindlessIndices.end(), [&](const RetiredBindlessIndex& retired) {
+			if (retired.frame + maxFramesInFlight > currentFrame) {
+				return false;
+			}
+			releaseBindlessIndex(retired.index);
+			return true;
+		});
+		retiredBindlessIndices.erase(retiredIndicesEnd, retiredBindlessIndices.end());
+
+		if (materialSetsMissing) {
+			materialSetsMissing = false;
+			for (Material* material : materials) {
+				if (!material->vk.descriptorSet) {
+					writeMaterialDescriptorSet(material);
+				}
+			}
+		}
 
-		poolSizes[1].type = vk::DescriptorType::eCombinedImageSampler;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+		std::vector<Texture*> changedTextures;
+		textureStreamer.update(currentFrame, changedTextures);
+		if (changedTextures.empty()) {
+			return;
+		}
 
-		vk::DescriptorPoolCreateInfo poolInfo{};
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
+		if (bindlessSupported) {
+			// Slots which frames in flight can sample must not be rewritten, so changed textures move to a new one
+			for (Texture* texture : changedTextures) {
+				if (texture->bindlessIndex != Texture::NO_BINDLESS_INDEX) {
+					retiredBindlessIndices.push_back(RetiredBindlessIndex{ texture->bindlessIndex, currentFrame });
+				}
+				texture->bindlessIndex = Texture::NO_BINDLESS_INDEX;
+				registerBindlessTexture(texture);
+			}
+			return;
+		}
 
-		descriptorPool = device.createDescriptorPool(poolInfo);
-		assert(descriptorPool);
+		// Sets which are bound by frames in flight must not be updated, so affected materials get a new one
+		for (Material* material : materials) {
+			if (std::find(changedTextures.begin(), changedTextures.end(), material->albedo) != changedTextures.end()) {
+				if (material->vk.descriptorSet) {
+					retiredDescriptorSets.push_back(RetiredDescriptorSet{ material->vk.descriptorSet, currentFrame });
+				}
+				writeMaterialDescriptorSet(material);
+			}
+		}
 	}
 
-	void VulkanContext::createDescriptorSets() {
-		std::vector<vk::DescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
-		vk::DescriptorSetAllocateInfo allocInfo{};
-		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = (uint32_t)swapChainImages.size();
-		allocInfo.pSetLayouts = layouts.data();
+	ObjectBuffer* VulkanContext::createObjectBuffer(uint32_t capacity) {
+		assert(capacity > 0);
+		if (!gpuDrivenSupported) {
+			printf("Object buffers need multiDrawIndirect and drawIndirectFirstInstance!\n");
+			return nullptr;
+		}
+		if (!cullPipeline) {
+			createGpuDrivenPipelines();
+		}
+
+		ObjectBuffer* objectBuffer = new ObjectBuffer();
+		objectBuffer->capacity = capacity;
+		objectBuffer->objectCount = 0;
+		objectBuffer->visibleCount = 0;
+		auto& impl = objectBuffer->vk;
+
+		const vk::DeviceSize commandsSize = sizeof(vk::DrawIndexedIndirectCommand) * capacity;
+		impl.commandBuffers.resize(maxFramesInFlight);
+		impl.commandBufferAllocs.resize(maxFramesInFlight);
+		impl.countBuffers.resize(maxFramesInFlight);
+		impl.countBufferAllocs.resize(maxFramesInFlight);
+		impl.culledFrames.assign(maxFramesInFlight, NOT_CULLED);
+		impl.expectedVisible.resize(maxFramesInFlight);
+		impl.uncertainObjects.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			VK_CHECK(createBuffer(
+				commandsSize,
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+				queueFamilyIndices.graphics.value(),
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				impl.commandBuffers[i], impl.commandBufferAllocs[i]
+			));
+			VK_CHECK(createBuffer(
+				sizeof(uint32_t),
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+				queueFamilyIndices.graphics.value(),
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				impl.countBuffers[i], impl.countBufferAllocs[i]
+			));
+		}
 
-		descriptorSets.resize(swapChainImages.size());
-		descriptorSets = device.allocateDescriptorSets(allocInfo);
+		impl.validated = cullValidation;
+		impl.readbackStride = sizeof(uint32_t) + (impl.validated ? commandsSize : 0);
+		VK_CHECK(createBuffer(
+			impl.readbackStride * maxFramesInFlight,
+			vk::BufferUsageFlagBits::eTransferDst,
+			queueFamilyIndices.graphics.value(),
+			VMA_MEMORY_USAGE_GPU_TO_CPU,
+			impl.readbackBuffer, impl.readbackBufferAlloc
+		));
+		// Stays mapped for the lifetime of the buffer
+		void* readbackData = nullptr;
+		vmaMapMemory(allocator, impl.readbackBufferAlloc, &readbackData);
+		impl.readbackData = static_cast<uint8_t*>(readbackData);
 
-		for (size_t i = 0; i < swapChainImages.size(); i++) {
+		if (!createObjectStorage(objectBuffer)) {
+			printf("Failed to allocate the descriptor sets of an object buffer!\n");
+			freeObjectBuffer(objectBuffer);
+			return nullptr;
+		}
 
-			std::array<vk::WriteDescriptorSet, 2> descriptorWrites{};
+		objectBuffers.push_back(objectBuffer);
+		return objectBuffer;
+	}
 
-			vk::DescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = uniformBuffers[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
+	bool VulkanContext::createObjectStorage(ObjectBuffer* objectBuffer) {
+		auto& impl = objectBuffer->vk;
+		// Filled through the upload manager without an ownership transfer, like the geometry arenas
+		VK_CHECK(createBuffer(
+			sizeof(GpuObject) * objectBuffer->capacity,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			getUploadQueueFamilies(),
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			impl.objectBuffer, impl.objectBufferAlloc
+		));
 
-			descriptorWrites[0].dstSet = descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType = vk::DescriptorType::eUniformBuffer;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-			descriptorWrites[0].pImageInfo = nullptr; // Optional
-			descriptorWrites[0].pTexelBufferView = nullptr; // Optional
+		const vk::DescriptorType storage = vk::DescriptorType::eStorageBuffer;
+		impl.objectSet = descriptorAllocator.getSet(objectSetLayout, {
+			DescriptorAllocator::Binding::buffer(0, storage, impl.objectBuffer, 0, VK_WHOLE_SIZE),
+		});
+		impl.cullSets.resize(maxFramesInFlight);
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			impl.cullSets[i] = descriptorAllocator.getSet(cullSetLayout, {
+				DescriptorAllocator::Binding::buffer(0, storage, impl.objectBuffer, 0, VK_WHOLE_SIZE),
+				DescriptorAllocator::Binding::buffer(1, storage, impl.commandBuffers[i], 0, VK_WHOLE_SIZE),
+				DescriptorAllocator::Binding::buffer(2, storage, impl.countBuffers[i], 0, VK_WHOLE_SIZE),
+			});
+		}
+		return impl.objectSet && std::find(impl.cullSets.begin(), impl.cullSets.end(), vk::DescriptorSet()) == impl.cullSets.end();
+	}
+
+	void VulkanContext::retireObjectStorage(ObjectBuffer* objectBuffer) {
+		auto& impl = objectBuffer->vk;
+		std::lock_guard<std::mutex> lock(retireMutex);
+		pendingRetires.buffers.push_back(RetiredBuffer{ impl.objectBuffer, impl.objectBufferAlloc });
+		for (vk::DescriptorSet cullSet : impl.cullSets) {
+			pendingRetires.descriptorSets.push_back(cullSet);
+		}
+		pendingRetires.descriptorSets.push_back(impl.objectSet);
+		impl.objectBuffer = nullptr;
+		impl.objectBufferAlloc = nullptr;
+		impl.objectSet = nullptr;
+		std::fill(impl.cullSets.begin(), impl.cullSets.end(), vk::DescriptorSet());
+	}
+
+	void VulkanContext::destroyObjectBuffer(ObjectBuffer* objectBuffer) {
+		// The buffers might still be used by a frame in flight
+		std::lock_guard<std::mutex> lock(retireMutex);
+		pendingRetires.objectBuffers.push_back(objectBuffer);
+	}
+
+	void VulkanContext::freeObjectBuffer(ObjectBuffer* objectBuffer) {
+		auto& impl = objectBuffer->vk;
+		for (vk::DescriptorSet cullSet : impl.cullSets) {
+			if (cullSet) {
+				descriptorAllocator.release(cullSet);
+			}
+		}
+		if (impl.objectSet) {
+			descriptorAllocator.release(impl.objectSet);
+		}
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			vmaDestroyBuffer(allocator, impl.commandBuffers[i], impl.commandBufferAllocs[i]);
+			vmaDestroyBuffer(allocator, impl.countBuffers[i], impl.countBufferAllocs[i]);
+		}
+		vmaUnmapMemory(allocator, impl.readbackBufferAlloc);
+		vmaDestroyBuffer(allocator, impl.readbackBuffer, impl.readbackBufferAlloc);
+		vmaDestroyBuffer(allocator, impl.objectBuffer, impl.objectBufferAlloc);
+		objectBuffers.erase(std::remove(objectBuffers.begin(), objectBuffers.end(), objectBuffer), objectBuffers.end());
+		delete objectBuffer;
+	}
+
+	void VulkanContext::setObjects(ObjectBuffer* objectBuffer, const DrawObject* objects, uint32_t objectCount) {
+		assert(objectCount <= objectBuffer->capacity);
+		auto& impl = objectBuffer->vk;
+
+		// Frames in flight might still cull and draw from the current objects, so instead of waiting for them
+		// the objects go into a new storage buffer and the old one is retired. Their culls are dropped
+		retireObjectStorage(objectBuffer);
+		std::fill(impl.culledFrames.begin(), impl.culledFrames.end(), NOT_CULLED);
+		if (!createObjectStorage(objectBuffer)) {
+			printf("Failed to allocate the descriptor sets of an object buffer, it stays empty!\n");
+			retireObjectStorage(objectBuffer);
+			objectBuffer->objects.clear();
+			objectBuffer->objectCount = 0;
+			objectBuffer->visibleCount = 0;
+			return;
+		}
 
-			vk::DescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-			imageInfo.imageView = sampledImage->vk.imageView;
-			imageInfo.sampler = textureSampler;
+		objectBuffer->objects.resize(objectCount);
+		// Objects with stale buffer handles are left out
+		uint32_t keptCount = 0;
+		for (uint32_t i = 0; i < objectCount; i++) {
+			const DrawObject& object = objects[i];
+			const VertexBuffer* vertexBuffer = vertexBuffers.get(object.vertexBuffer);
+			const IndexBuffer* indexBuffer = indexBuffers.get(object.indexBuffer);
+			if (!vertexBuffer || !indexBuffer) {
+				reportStaleHandle("setObjects()");
+				continue;
+			}
+			const GeometryArena::Allocation& vertexAllocation = vertexBuffer->vk.allocation;
+			const GeometryArena::Allocation& indexAllocation = indexBuffer->vk.allocation;
+			const vk::IndexType indexType = toVkIndexType(indexBuffer->indexType);
+			if (keptCount == 0) {
+				impl.vertexBuffer = vertexAllocation.buffer;
+				impl.indexBuffer = indexAllocation.buffer;
+				impl.indexType = indexType;
+			}
+			assert(vertexAllocation.buffer == impl.vertexBuffer && indexAllocation.buffer == impl.indexBuffer && indexType == impl.indexType
+				&& "all objects have to be drawable with the same vertex and index buffer binding");
 
-			descriptorWrites[1].dstSet = descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pBufferInfo = nullptr; // Optional
-			descriptorWrites[1].pImageInfo = &imageInfo;
-			descriptorWrites[1].pTexelBufferView = nullptr; // Optional
+			GpuObject& gpuObject = objectBuffer->objects[keptCount++];
+			gpuObject.transform = object.transform;
+			gpuObject.boundingSphere = object.boundingSphere;
+			gpuObject.indexCount = object.indexCount;
+			gpuObject.firstIndex = indexAllocation.first + object.firstIndex;
+			gpuObject.vertexOffset = static_cast<int32_t>(vertexAllocation.first) + object.vertexOffset;
+			gpuObject.padding = 0;
+		}
+		objectBuffer->objects.resize(keptCount);
+		objectBuffer->objectCount = keptCount;
+		objectBuffer->visibleCount = 0;
 
-			device.updateDescriptorSets(descriptorWrites, {});
+		if (keptCount > 0) {
+			uploadManager.uploadBuffer(impl.objectBuffer, 0, objectBuffer->objects.data(), sizeof(GpuObject) * keptCount, true);
 		}
 	}
 
 	void VulkanContext::createCommandBuffers() {
-		commandBuffers.resize(swapChainFramebuffers.size());
+		commandBuffers.resize(maxFramesInFlight);
+
+		for (size_t i = 0; i < commandBuffers.size(); i++) {
+			vk::CommandBufferAllocateInfo allocInfo{};
+			allocInfo.commandPool = frameCommandPools[i];
+			allocInfo.level = vk::CommandBufferLevel::ePrimary;
+			allocInfo.commandBufferCount = 1;
+			commandBuffers[i] = device.allocateCommandBuffers(allocInfo)[0];
+		}
+	}
+
+	void VulkanContext::beginRenderPass(RenderPass* renderPass, bool parallel) {
+		assert(frame.active && !frame.inRenderPass);
+		assert(renderPass == nullptr && "only the main render pass is supported yet");
 
 		vk::Viewport viewport{};
 		viewport.x = 0.0f;
@@ -1177,60 +1703,571 @@ namespace vesuvio {
 		scissor.offset = vk::Offset2D{ 0, 0 };
 		scissor.extent = swapChainExtent;
 
-		vk::CommandBufferAllocateInfo allocInfo{};
-		allocInfo.commandPool = graphicsCommandPool;
-		allocInfo.level = vk::CommandBufferLevel::ePrimary;
-		allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
-		commandBuffers = device.allocateCommandBuffers(allocInfo);
+		std::array<float, 4> clearColorValues = { 0.0f, 0.0f, 0.0f, 1.0f };
+		std::array<vk::ClearValue, 2> clearValues = {
+			vk::ClearColorValue(clearColorValues),
+			vk::ClearDepthStencilValue(1.0f, 0)
+		};
 
-		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			vk::CommandBufferBeginInfo beginInfo{};
-			beginInfo.flags = vk::CommandBufferUsageFlagBits(0); // optional
-			beginInfo.pInheritanceInfo = nullptr; // optional
+		vk::RenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.renderPass = this->renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[frame.imageIndex];
+		renderPassInfo.renderArea.offset = vk::Offset2D{ 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+#if VSV_GPU_PROFILER()
+		gpuProfiler.beginScope(frame.commandBuffer, "MainPass");
+#endif
+		frame.viewport = viewport;
+		frame.scissor = scissor;
+		if (parallel) {
+			// Dynamic state is not inherited, the secondary command buffers set it themselves
+			frame.commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		}
+		else {
+			frame.commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+			frame.commandBuffer.setViewport(0, viewport);
+			frame.commandBuffer.setScissor(0, scissor);
+		}
+		frame.inRenderPass = true;
+		frame.parallelPass = parallel;
+		frame.mainPassRecorded = true;
+	}
 
-			commandBuffers[i].begin(beginInfo);
+	void VulkanContext::endRenderPass() {
+		assert(frame.inRenderPass);
+		frame.commandBuffer.endRenderPass();
+#if VSV_GPU_PROFILER()
+		gpuProfiler.endScope(frame.commandBuffer);
+#endif
+		frame.inRenderPass = false;
+	}
 
-			std::array<float, 4> clearColorValues = { 0.0f, 0.0f, 0.0f, 1.0f };
-			std::array<vk::ClearValue, 2> clearValues = {
-				vk::ClearColorValue(clearColorValues),
-				vk::ClearDepthStencilValue(1.0f, 0)
-			};
+	void VulkanContext::setMaterial(Material* material) {
+		if (material == frame.material) {
+			drawStats.redundantBindsSkipped++;
+			return;
+		}
+		// Materials sharing a set (always the case with the bindless table) only differ in their pushed texture index
+		frame.descriptorSetDirty |= !material || !frame.material || material->vk.descriptorSet != frame.material->vk.descriptorSet;
+		frame.material = material;
+	}
+
+	void VulkanContext::setMeshBuffers(VertexBufferHandle vertexBufferHandle, IndexBufferHandle indexBufferHandle) {
+		// Resolved once, so the draws of the frame only follow pointers
+		VertexBuffer* vertexBuffer = vertexBuffers.get(vertexBufferHandle);
+		IndexBuffer* indexBuffer = indexBuffers.get(indexBufferHandle);
+		if (!vertexBuffer || !indexBuffer) {
+			reportStaleHandle("setMeshBuffers()");
+			frame.meshBuffersStale = true;
+			return;
+		}
+		frame.meshBuffersStale = false;
+		if (vertexBuffer == frame.vertexBuffer && indexBuffer == frame.indexBuffer) {
+			drawStats.redundantBindsSkipped++;
+			return;
+		}
+		frame.vertexBufferDirty |= vertexBuffer != frame.vertexBuffer || frame.mesh;
+		frame.indexBufferDirty |= indexBuffer != frame.indexBuffer || frame.mesh;
+		frame.vertexBuffer = vertexBuffer;
+		frame.indexBuffer = indexBuffer;
+		frame.mesh = nullptr;
+	}
+
+	void VulkanContext::setMesh(Mesh* mesh) {
+		if (mesh == frame.mesh) {
+			drawStats.redundantBindsSkipped++;
+			return;
+		}
+		frame.mesh = mesh;
+		frame.vertexBuffer = nullptr;
+		frame.indexBuffer = nullptr;
+		frame.meshBuffersStale = false;
+		frame.vertexBufferDirty = true;
+		frame.indexBufferDirty = true;
+	}
+
+	void VulkanContext::setTransform(const glm::mat4& model) {
+		frame.model = model;
+		frame.uniformsDirty = true;
+	}
+
+	void VulkanContext::draw(uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset) {
+		assert(frame.inRenderPass && !frame.parallelPass);
+		assert(frame.material && (frame.mesh || frame.meshBuffersStale || (frame.vertexBuffer && frame.indexBuffer)));
+
+		if (!flushDrawState()) {
+			drawStats.droppedDraws++;
+			return;
+		}
+		frame.commandBuffer.drawIndexed(indexCount, 1, frame.baseIndex + firstIndex, frame.baseVertex + vertexOffset, 0);
+		drawStats.drawCalls++;
+	}
+
+	void VulkanContext::drawInstanced(uint32_t indexCount, const InstanceData* instances, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset) {
+		assert(frame.inRenderPass && !frame.parallelPass);
+		assert(frame.material && (frame.meshBuffersStale || (frame.vertexBuffer && frame.indexBuffer)) && "instanced draws need an interleaved vertex buffer");
+		if (instanceCount == 0) {
+			return;
+		}
+		if (frame.meshBuffersStale) {
+			drawStats.droppedDraws++;
+			return;
+		}
+		if (instanceCount > MAX_INSTANCES_PER_FRAME) {
+			printf("drawInstanced() with %u instances exceeds the limit of %u per frame, the draw is dropped\n", instanceCount, MAX_INSTANCES_PER_FRAME);
+			drawStats.droppedDraws++;
+			return;
+		}
+
+		// The whole ring buffer stays bound, the instances are selected through firstInstance
+		UniformRingBuffer::Allocation allocation = instanceRingBuffer.allocate(sizeof(InstanceData) * instanceCount);
+		if (!allocation.data || !flushDrawState(true)) {
+			drawStats.droppedDraws++;
+			return;
+		}
+		memcpy(allocation.data, instances, sizeof(InstanceData) * instanceCount);
+		const uint32_t firstInstance = allocation.offset / sizeof(InstanceData);
+
+		frame.commandBuffer.drawIndexed(indexCount, instanceCount, frame.baseIndex + firstIndex, frame.baseVertex + vertexOffset, firstInstance);
+		drawStats.drawCalls++;
+		drawStats.instancesDrawn += instanceCount;
+	}
+
+	void VulkanContext::drawParallel(const DrawCommand* draws, uint32_t drawCount, uint32_t threadCount) {
+		assert(frame.inRenderPass && frame.parallelPass);
+		if (drawCount == 0) {
+			return;
+		}
+		threadCount = std::max(1u, std::min({ threadCount, MAX_RECORDING_THREADS, drawCount }));
+
+		vk::CommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = swapChainFramebuffers[frame.imageIndex];
+
+		std::array<vk::CommandBuffer, MAX_RECORDING_THREADS> secondaryCommandBuffers;
+		std::array<DrawStats, MAX_RECORDING_THREADS> threadStats{};
+
+		auto recordStart = std::chrono::high_resolution_clock::now();
+		runParallel(threadCount, [&](uint32_t threadIndex) {
+			const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * threadIndex / threadCount);
+			const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * (threadIndex + 1) / threadCount);
+			secondaryCommandBuffers[threadIndex] = recordDraws(threadIndex, inheritanceInfo, draws + begin, end - begin, threadStats[threadIndex]);
+		});
+		auto recordEnd = std::chrono::high_resolution_clock::now();
+
+		frame.commandBuffer.executeCommands(threadCount, secondaryCommandBuffers.data());
+		// The bound state of the primary command buffer is undefined after executing secondary ones
+		frame.pipeline = nullptr;
+		frame.descriptorSetDirty = true;
+		frame.vertexBufferDirty = true;
+		frame.indexBufferDirty = true;
+		frame.boundVertexBuffer = nullptr;
+		frame.boundIndexBuffer = nullptr;
+		frame.instanceBufferBound = false;
+		frame.bindlessSetBound = false;
+		frame.pushedTextureIndex = Texture::NO_BINDLESS_INDEX;
+
+		for (uint32_t i = 0; i < threadCount; i++) {
+			drawStats.drawCalls += threadStats[i].drawCalls;
+			drawStats.pipelineBinds += threadStats[i].pipelineBinds;
+			drawStats.descriptorSetBinds += threadStats[i].descriptorSetBinds;
+			drawStats.vertexBufferBinds += threadStats[i].vertexBufferBinds;
+			drawStats.indexBufferBinds += threadStats[i].indexBufferBinds;
+			drawStats.redundantBindsSkipped += threadStats[i].redundantBindsSkipped;
+			drawStats.droppedDraws += threadStats[i].droppedDraws;
+		}
+		drawStats.lastParallelThreadCount = threadCount;
+		drawStats.lastParallelRecordSeconds = std::chrono::duration<double, std::chrono::seconds::period>(recordEnd - recordStart).count();
+	}
+
+	vk::CommandBuffer VulkanContext::recordDraws(uint32_t threadIndex, const vk::CommandBufferInheritanceInfo& inheritanceInfo, const DrawCommand* draws, uint32_t drawCount, DrawStats& stats) {
+		// Only this thread touches its pool while recording
+		RecordingThread& recordingThread = recordingThreads[frame.frameIndex * MAX_RECORDING_THREADS + threadIndex];
+		if (recordingThread.usedCommandBuffers == recordingThread.commandBuffers.size()) {
+			vk::CommandBufferAllocateInfo allocInfo{};
+			allocInfo.commandPool = recordingThread.commandPool;
+			allocInfo.level = vk::CommandBufferLevel::eSecondary;
+			allocInfo.commandBufferCount = 1;
+			recordingThread.commandBuffers.push_back(device.allocateCommandBuffers(allocInfo)[0]);
+		}
+		vk::CommandBuffer commandBuffer = recordingThread.commandBuffers[recordingThread.usedCommandBuffers++];
+
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		commandBuffer.begin(beginInfo);
+		commandBuffer.setViewport(0, frame.viewport);
+		commandBuffer.setScissor(0, frame.scissor);
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
+		stats.pipelineBinds++;
+
+		Material* material = nullptr;
+		vk::Buffer vertexBuffer;
+		vk::Buffer indexBuffer;
+		IndexType indexType = IndexType::Uint16;
+		uint32_t uniformOffset = 0;
+		// Transform uniformOffset holds, skipped draws never change it
+		glm::mat4 pushedTransform;
+		bool uniformsPushed = false;
+		bool bindlessSetBound = false;
+		uint32_t pushedTextureIndex = Texture::NO_BINDLESS_INDEX;
+		for (uint32_t i = 0; i < drawCount; i++) {
+			const DrawCommand& draw = draws[i];
+			// Buffers from the same arena block stay bound, the draws select their geometry through the offsets
+			const VertexBuffer* drawVertexBuffer = vertexBuffers.get(draw.vertexBuffer);
+			const IndexBuffer* drawIndexBuffer = indexBuffers.get(draw.indexBuffer);
+			if (!drawVertexBuffer || !drawIndexBuffer) {
+				reportStaleHandle("drawParallel()");
+				stats.droppedDraws++;
+				continue;
+			}
+			if (!draw.material->vk.descriptorSet) {
+				stats.droppedDraws++;
+				continue;
+			}
+
+			bool descriptorSetDirty = !material || draw.material->vk.descriptorSet != material->vk.descriptorSet;
+			if (!uniformsPushed || draw.transform != pushedTransform) {
+				UniformBufferObject ubo{};
+				ubo.model = draw.transform;
+				ubo.view = frame.view;
+				ubo.proj = frame.proj;
+				uint32_t offset = uniformRingBuffer.push(ubo);
+				uniformsPushed = offset != UniformRingBuffer::INVALID_OFFSET;
+				if (!uniformsPushed) {
+					stats.droppedDraws++;
+					continue;
+				}
+				descriptorSetDirty |= offset != uniformOffset;
+				uniformOffset = offset;
+				pushedTransform = draw.transform;
+			}
+
+			if (descriptorSetDirty) {
+				commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, draw.material->vk.descriptorSet, uniformOffset);
+				material = draw.material;
+				stats.descriptorSetBinds++;
+			}
+			else {
+				stats.redundantBindsSkipped++;
+			}
+			if (bindlessSupported) {
+				bindBindlessTexture(commandBuffer, draw.material, bindlessSetBound, pushedTextureIndex);
+			}
+			const GeometryArena::Allocation& vertexAllocation = drawVertexBuffer->vk.allocation;
+			const GeometryArena::Allocation& indexAllocation = drawIndexBuffer->vk.allocation;
+			if (vertexAllocation.buffer != vertexBuffer) {
+				vk::DeviceSize offset = 0;
+				commandBuffer.bindVertexBuffers(0, vertexAllocation.buffer, offset);
+				vertexBuffer = vertexAllocation.buffer;
+				stats.vertexBufferBinds++;
+			}
+			else {
+				stats.redundantBindsSkipped++;
+			}
+			if (indexAllocation.buffer != indexBuffer || drawIndexBuffer->indexType != indexType) {
+				commandBuffer.bindIndexBuffer(indexAllocation.buffer, 0, toVkIndexType(drawIndexBuffer->indexType));
+				indexBuffer = indexAllocation.buffer;
+				indexType = drawIndexBuffer->indexType;
+				stats.indexBufferBinds++;
+			}
+			else {
+				stats.redundantBindsSkipped++;
+			}
+
+			commandBuffer.drawIndexed(draw.indexCount, 1, indexAllocation.first + draw.firstIndex, static_cast<int32_t>(vertexAllocation.first) + draw.vertexOffset, 0);
+			stats.drawCalls++;
+		}
+
+		commandBuffer.end();
+		return commandBuffer;
+	}
+
+	void VulkanContext::cullObjects(ObjectBuffer* objectBuffer) {
+		assert(frame.active && !frame.inRenderPass);
+		auto& impl = objectBuffer->vk;
+		const uint32_t frameIndex = frame.frameIndex;
+		assert(impl.culledFrames[frameIndex] != currentFrame && "an object buffer can only be culled once per frame");
+		if (objectBuffer->objectCount == 0) {
+			return;
+		}
+		vk::CommandBuffer commandBuffer = frame.commandBuffer;
+		VSV_GPU_SCOPE(gpuProfiler, commandBuffer, "Cull");
+
+		const Frustum frustum = Frustum::fromViewProjection(frame.proj * frame.view);
+		if (impl.validated) {
+			std::vector<uint32_t>& expected = impl.expectedVisible[frameIndex];
+			std::vector<uint32_t>& uncertain = impl.uncertainObjects[frameIndex];
+			expected.clear();
+			uncertain.clear();
+			for (uint32_t i = 0; i < objectBuffer->objectCount; i++) {
+				const GpuObject& object = objectBuffer->objects[i];
+				const glm::vec4 sphere = Frustum::transformSphere(object.transform, object.boundingSphere);
+				if (frustum.nearBoundary(sphere, CULL_VALIDATION_TOLERANCE)) {
+					uncertain.push_back(i);
+				}
+				else if (frustum.intersectsSphere(sphere)) {
+					expected.push_back(i);
+				}
+			}
+		}
+
+		commandBuffer.fillBuffer(impl.countBuffers[frameIndex], 0, sizeof(uint32_t), 0);
+		vk::BufferMemoryBarrier clearBarrier{};
+		clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		clearBarrier.buffer = impl.countBuffers[frameIndex];
+		clearBarrier.offset = 0;
+		clearBarrier.size = VK_WHOLE_SIZE;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+			vk::DependencyFlags(),
+			{}, clearBarrier, {}
+		);
+
+		struct
+		{
+			glm::vec4 planes[6];
+			uint32_t objectCount;
+			uint32_t compact;
+		} cullConstants{};
+		std::copy(std::begin(frustum.planes), std::end(frustum.planes), cullConstants.planes);
+		cullConstants.objectCount = objectBuffer->objectCount;
+		// Without a draw count from the GPU the command list can't be compacted
+		cullConstants.compact = drawIndirectCountSupported ? 1 : 0;
+
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, impl.cullSets[frameIndex], {});
+		commandBuffer.pushConstants(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(cullConstants), &cullConstants);
+		commandBuffer.dispatch((objectBuffer->objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		std::array<vk::BufferMemoryBarrier, 2> cullBarriers{};
+		for (uint32_t i = 0; i < cullBarriers.size(); i++) {
+			cullBarriers[i].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+			cullBarriers[i].dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead;
+			cullBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			cullBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			cullBarriers[i].buffer = i == 0 ? impl.commandBuffers[frameIndex] : impl.countBuffers[frameIndex];
+			cullBarriers[i].offset = 0;
+			cullBarriers[i].size = VK_WHOLE_SIZE;
+		}
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(),
+			{}, cullBarriers, {}
+		);
+
+		// The visible count (and the commands to validate) are read back once the frame has finished
+		const vk::DeviceSize readbackOffset = impl.readbackStride * frameIndex;
+		commandBuffer.copyBuffer(impl.countBuffers[frameIndex], impl.readbackBuffer, vk::BufferCopy{ 0, readbackOffset, sizeof(uint32_t) });
+		if (impl.validated) {
+			commandBuffer.copyBuffer(impl.commandBuffers[frameIndex], impl.readbackBuffer,
+				vk::BufferCopy{ 0, readbackOffset + sizeof(uint32_t), sizeof(vk::DrawIndexedIndirectCommand) * objectBuffer->objectCount });
+		}
+		vk::BufferMemoryBarrier readbackBarrier{};
+		readbackBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		readbackBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		readbackBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		readbackBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		readbackBarrier.buffer = impl.readbackBuffer;
+		readbackBarrier.offset = readbackOffset;
+		readbackBarrier.size = impl.readbackStride;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+			vk::DependencyFlags(),
+			{}, readbackBarrier, {}
+		);
+
+		impl.culledFrames[frameIndex] = currentFrame;
+		cullStats.culledObjects += objectBuffer->objectCount;
+	}
+
+	void VulkanContext::drawObjects(ObjectBuffer* objectBuffer, Material* material) {
+		assert(frame.inRenderPass && !frame.parallelPass);
+		if (objectBuffer->objectCount == 0) {
+			return;
+		}
+		auto& impl = objectBuffer->vk;
+		const uint32_t frameIndex = frame.frameIndex;
+		assert(impl.culledFrames[frameIndex] == currentFrame && "cullObjects() has to be called first in this frame");
+		if (!material->vk.descriptorSet) {
+			drawStats.droppedDraws++;
+			return;
+		}
+		vk::CommandBuffer commandBuffer = frame.commandBuffer;
+
+		// The transforms come from the object buffer, only view and projection are taken from the constants
+		UniformBufferObject ubo{};
+		ubo.model = glm::mat4(1.0f);
+		ubo.view = frame.view;
+		ubo.proj = frame.proj;
+		const uint32_t uniformOffset = uniformRingBuffer.push(ubo);
+		if (uniformOffset == UniformRingBuffer::INVALID_OFFSET) {
+			drawStats.droppedDraws++;
+			return;
+		}
+
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, indirectPipeline);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, indirectPipelineLayout, 0, material->vk.descriptorSet, uniformOffset);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, indirectPipelineLayout, 2, impl.objectSet, {});
+		if (bindlessSupported) {
+			bindBindlessTexture(commandBuffer, material, frame.bindlessSetBound, frame.pushedTextureIndex);
+		}
+		vk::DeviceSize offset = 0;
+		commandBuffer.bindVertexBuffers(0, impl.vertexBuffer, offset);
+		commandBuffer.bindIndexBuffer(impl.indexBuffer, 0, impl.indexType);
+
+		const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+		if (drawIndirectCountSupported) {
+			commandBuffer.drawIndexedIndirectCount(impl.commandBuffers[frameIndex], 0, impl.countBuffers[frameIndex], 0, objectBuffer->objectCount, stride);
+		}
+		else {
+			commandBuffer.drawIndexedIndirect(impl.commandBuffers[frameIndex], 0, objectBuffer->objectCount, stride);
+		}
+		drawStats.drawCalls++;
+		drawStats.pipelineBinds++;
+		drawStats.descriptorSetBinds += 2;
+		drawStats.vertexBufferBinds++;
+		drawStats.indexBufferBinds++;
+
+		// The following regular draws have to bind their state again, the arena blocks bound here can be reused
+		frame.pipeline = indirectPipeline;
+		frame.descriptorSetDirty = true;
+		frame.vertexBufferDirty = true;
+		frame.indexBufferDirty = true;
+		frame.boundVertexBuffer = impl.vertexBuffer;
+		frame.boundIndexBuffer = impl.indexBuffer;
+		frame.boundIndexType = impl.indexType;
+	}
+
+	void VulkanContext::reportStaleHandle(const char* caller) {
+		if (!staleHandleReported.exchange(true)) {
+			printf("%s got a stale or invalid buffer handle, its draws are dropped (only the first one is reported)\n", caller);
+		}
+	}
 
-			vk::RenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.renderPass = renderPass;
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = vk::Offset2D{ 0, 0 };
-			renderPassInfo.renderArea.extent = swapChainExtent;
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+	void VulkanContext::setParallelFor(ParallelForFunc parallelForFn) {
+		parallelForFunc = parallelForFn;
+	}
 
-			commandBuffers[i].beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-			commandBuffers[i].setViewport(0, viewport);
-			commandBuffers[i].setScissor(0, scissor);
-			commandBuffers[i].bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
-			std::vector<vk::Buffer> vertexBuffers = { vb->vk.buffer };
-			std::vector<vk::DeviceSize> offsets = { 0 };
-			commandBuffers[i].bindVertexBuffers(0, vertexBuffers, offsets);
-			commandBuffers[i].bindIndexBuffer(ib->vk.buffer, 0, vk::IndexType::eUint16);
-			commandBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets[i], {});
-			commandBuffers[i].drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-			commandBuffers[i].endRenderPass();
+	void VulkanContext::runParallel(uint32_t taskCount, const std::function<void(uint32_t)>& task) {
+		if (parallelForFunc) {
+			parallelForFunc(taskCount, task);
+			return;
+		}
 
-			commandBuffers[i].end();
+		// Spawning threads per call would cost more than it saves, without workers the parts are recorded inline
+		for (uint32_t i = 0; i < taskCount; i++) {
+			task(i);
+		}
+	}
+
+	bool VulkanContext::flushDrawState(bool instanced) {
+		vk::CommandBuffer commandBuffer = frame.commandBuffer;
+		if (!frame.material->vk.descriptorSet || frame.meshBuffersStale) {
+			return false;
+		}
+
+		// Constants are only pushed again if the transform has changed since the last draw
+		if (frame.uniformsDirty) {
+			UniformBufferObject ubo{};
+			ubo.model = frame.model;
+			ubo.view = frame.view;
+			ubo.proj = frame.proj;
+			uint32_t uniformOffset = uniformRingBuffer.push(ubo);
+			if (uniformOffset == UniformRingBuffer::INVALID_OFFSET) {
+				return false;
+			}
+			frame.descriptorSetDirty |= uniformOffset != frame.uniformOffset;
+			frame.uniformOffset = uniformOffset;
+			frame.uniformsDirty = false;
+		}
+
+		// All materials share the pipeline for now, only the vertex layout differs
+		vk::Pipeline pipeline = frame.mesh ? getMeshPipeline(frame.mesh->getEncoding()) : (instanced ? getInstancedPipeline() : graphicsPipeline);
+		if (frame.pipeline != pipeline) {
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+			frame.pipeline = pipeline;
+			drawStats.pipelineBinds++;
+		}
+		if (frame.descriptorSetDirty) {
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, frame.material->vk.descriptorSet, frame.uniformOffset);
+			frame.descriptorSetDirty = false;
+			drawStats.descriptorSetBinds++;
+		}
+		if (bindlessSupported) {
+			bindBindlessTexture(commandBuffer, frame.material, frame.bindlessSetBound, frame.pushedTextureIndex);
+		}
+		if (frame.vertexBufferDirty) {
+			if (frame.mesh) {
+				// The streams of different layouts share one arena, so they are bound at the mesh's offsets
+				const Mesh::VulkanImpl& meshImpl = frame.mesh->getVulkanImpl();
+				std::array<vk::Buffer, 2> streams = { meshImpl.posAllocation.buffer, meshImpl.remainderAllocation.buffer };
+				std::array<vk::DeviceSize, 2> offsets = { meshImpl.posAllocation.offset, meshImpl.remainderAllocation.offset };
+				commandBuffer.bindVertexBuffers(0, streams, offsets);
+				frame.boundVertexBuffer = nullptr;
+				frame.instanceBufferBound = false;
+				frame.baseVertex = 0;
+				drawStats.vertexBufferBinds++;
+			}
+			else {
+				const GeometryArena::Allocation& allocation = frame.vertexBuffer->vk.allocation;
+				if (allocation.buffer != frame.boundVertexBuffer) {
+					vk::DeviceSize offset = 0;
+					commandBuffer.bindVertexBuffers(0, allocation.buffer, offset);
+					frame.boundVertexBuffer = allocation.buffer;
+					drawStats.vertexBufferBinds++;
+				}
+				else {
+					drawStats.redundantBindsSkipped++;
+				}
+				frame.baseVertex = static_cast<int32_t>(allocation.first);
+			}
+			frame.vertexBufferDirty = false;
+		}
+		if (frame.indexBufferDirty) {
+			const GeometryArena::Allocation& allocation = frame.mesh ? frame.mesh->getVulkanImpl().indexAllocation : frame.indexBuffer->vk.allocation;
+			const vk::IndexType indexType = toVkIndexType(frame.mesh ? frame.mesh->getVulkanImpl().indexType : frame.indexBuffer->indexType);
+			if (allocation.buffer != frame.boundIndexBuffer || indexType != frame.boundIndexType) {
+				commandBuffer.bindIndexBuffer(allocation.buffer, 0, indexType);
+				frame.boundIndexBuffer = allocation.buffer;
+				frame.boundIndexType = indexType;
+				drawStats.indexBufferBinds++;
+			}
+			else {
+				drawStats.redundantBindsSkipped++;
+			}
+			frame.baseIndex = allocation.first;
+			frame.indexBufferDirty = false;
+		}
+		if (instanced && !frame.instanceBufferBound) {
+			vk::DeviceSize offset = 0;
+			commandBuffer.bindVertexBuffers(1, instanceRingBuffer.getBuffer(), offset);
+			frame.instanceBufferBound = true;
+			drawStats.vertexBufferBinds++;
 		}
+		return true;
 	}
 
 	void VulkanContext::createSyncObjects() {
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		imageAvailableSemaphores.resize(maxFramesInFlight);
+		renderFinishedSemaphores.resize(maxFramesInFlight);
+		inFlightFences.resize(maxFramesInFlight);
 		imagesInFlight.resize(swapChainImages.size(), nullptr);
+		frameStartTimes.resize(maxFramesInFlight);
+		frameLatencyPending.assign(maxFramesInFlight, false);
 
 		vk::SemaphoreCreateInfo semaphoreInfo{};
 		vk::FenceCreateInfo fenceInfo{};
 		fenceInfo.flags = vk::FenceCreateFlagBits::eSignaled;
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		for (size_t i = 0; i < maxFramesInFlight; i++) {
 			imageAvailableSemaphores[i] = device.createSemaphore(semaphoreInfo);
 			assert(imageAvailableSemaphores[i]);
 			renderFinishedSemaphores[i] = device.createSemaphore(semaphoreInfo);
@@ -1238,10 +2275,6 @@ namespace vesuvio {
 			inFlightFences[i] = device.createFence(fenceInfo);
 			assert(inFlightFences[i]);
 		}
-
-		vk::FenceCreateInfo bufferCopyFenceInfo{};
-		bufferCopyFence = device.createFence(bufferCopyFenceInfo);
-		assert(bufferCopyFence);
 	}
 
 	void VulkanContext::cleanupSwapChain() {
@@ -1252,230 +2285,600 @@ namespace vesuvio {
 			device.destroyFramebuffer(framebuffer);
 		}
 
-		device.freeCommandBuffers(graphicsCommandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
 		device.destroyRenderPass(renderPass);
+		for (vk::RenderPass retiredRenderPass : retiredRenderPasses) {
+			device.destroyRenderPass(retiredRenderPass);
+		}
+		retiredRenderPasses.clear();
+
+		if (headless) {
+			destroyOffscreenTargets();
+			return;
+		}
 
 		for (auto& imageView : swapChainImageViews) {
 			device.destroyImageView(imageView);
 		}
 
 		device.destroySwapchainKHR(swapChain);
+	}
 
-		for (size_t i = 0; i < uniformBuffers.size(); i++) {
-			vmaDestroyBuffer(allocator, uniformBuffers[i], uniformBufferAllocs[i]);
+	void VulkanContext::requestSwapChainRecreation() {
+		// Drag resizing sends many events, all of them are handled by a single recreation at the start of the next frame
+		if (swapChainDirty) {
+			frameStats.resizeEventsCoalesced++;
+			return;
 		}
-		device.destroyDescriptorPool(descriptorPool);
+		swapChainDirty = true;
+		resizeRequestTime = std::chrono::high_resolution_clock::now();
 	}
 
 	void VulkanContext::recreateSwapChain() {
-		int currentWidth = 0, currentHeight = 0;
-		glfwGetFramebufferSize(window, &currentWidth, &currentHeight);
-		while (currentWidth == 0 || currentHeight == 0) {
+		if (!headless) {
+			int currentWidth = 0, currentHeight = 0;
 			glfwGetFramebufferSize(window, &currentWidth, &currentHeight);
-			glfwWaitEvents();
+			while (currentWidth == 0 || currentHeight == 0) {
+				glfwGetFramebufferSize(window, &currentWidth, &currentHeight);
+				glfwWaitEvents();
+			}
 		}
 
-		device.waitIdle();
+		// Only the objects which depend on the extent are replaced, the render pass, pipelines,
+		// uniform buffers, descriptor sets and command buffers are kept (the first two unless the format changed)
+		if (headless) {
+			// The frames in flight still render into the offscreen targets and read them back
+			VK_CHECK(device.waitForFences(inFlightFences, VK_TRUE, UINT64_MAX))
+			// Readbacks of frames which already finished are still handed out
+			for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+				processReadback(i);
+			}
+			device.destroyImageView(depthImageView);
+			vmaDestroyImage(allocator, depthImage, depthImageAlloc);
+			for (auto& framebuffer : swapChainFramebuffers) {
+				device.destroyFramebuffer(framebuffer);
+			}
+			destroyOffscreenTargets();
+			createOffscreenTargets();
+		}
+		else {
+			// Nothing waits here, the old objects are destroyed once the frames in flight which use them have finished
+			RetiredSwapChain retired{};
+			retired.swapChain = swapChain;
+			retired.imageViews = std::move(swapChainImageViews);
+			retired.framebuffers = std::move(swapChainFramebuffers);
+			retired.depthImage = depthImage;
+			retired.depthImageAlloc = depthImageAlloc;
+			retired.depthImageView = depthImageView;
+			retired.frame = currentFrame;
+			retiredSwapChains.push_back(std::move(retired));
+
+			const vk::Format previousFormat = swapChainFormat;
+			createSwapChain(swapChain);
+			createSwapChainImageViews();
+			// e.g. the window moved to a monitor with another surface format
+			if (swapChainFormat != previousFormat) {
+				recreateFormatDependentObjects();
+			}
+		}
+		createDepthResources();
+		createFramebuffers();
 
-		cleanupSwapChain();
+		// The new swap chain might have a different image count
+		imagesInFlight.assign(swapChainImages.size(), nullptr);
 
-		createSwapChain();
-		createSwapChainImageViews();
+		swapChainDirty = false;
+		const double latency = std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - resizeRequestTime).count();
+		frameStats.swapChainRecreations++;
+		frameStats.lastResizeLatencySeconds = latency;
+		frameStats.maxResizeLatencySeconds = std::max(frameStats.maxResizeLatencySeconds, latency);
+	}
+
+	void VulkanContext::recreateFormatDependentObjects() {
+		printf("Swap chain format changed, recreating the render pass and pipelines\n");
+		// Frames in flight still use the old render pass. It is kept until cleanup, so its handle
+		// can't be reused by a render pass of another format while the pipeline cache keys on it
+		retiredRenderPasses.push_back(renderPass);
 		createRenderPass();
-		createDepthResources();
-		createFramebuffers();
-		createUniformBuffers();
-		createDescriptorPool();
-		createDescriptorSets();
-		createCommandBuffers();
+
+		// The old pipelines stay in the cache, the new render pass gets its own ones
+		meshPipelines.fill(vk::Pipeline());
+		instancedPipeline = nullptr;
+		createMainPipelines();
+		if (cullPipeline) {
+			createIndirectPipeline();
+		}
+		frameStats.formatChanges++;
 	}
 
-	void VulkanContext::drawFrame() {
-		uint32_t frameIndex = currentFrame % MAX_FRAMES_IN_FLIGHT;
-		VK_CHECK(device.waitForFences(inFlightFences[frameIndex], VK_TRUE, UINT64_MAX))
+	void VulkanContext::destroyRetiredSwapChains(bool all) {
+		auto retiredEnd = std::remove_if(retiredSwapChains.begin(), retiredSwapChains.end(), [&](const RetiredSwapChain& retired) {
+			if (!all && retired.frame + maxFramesInFlight > currentFrame) {
+				return false;
+			}
+			for (vk::Framebuffer framebuffer : retired.framebuffers) {
+				device.destroyFramebuffer(framebuffer);
+			}
+			for (vk::ImageView imageView : retired.imageViews) {
+				device.destroyImageView(imageView);
+			}
+			device.destroyImageView(retired.depthImageView);
+			vmaDestroyImage(allocator, retired.depthImage, retired.depthImageAlloc);
+			device.destroySwapchainKHR(retired.swapChain);
+			return true;
+		});
+		retiredSwapChains.erase(retiredEnd, retiredSwapChains.end());
+	}
+
+	void VulkanContext::setPresentPolicy(const PresentPolicy& policy) {
+		const bool modeChanged = policy.mode != presentPolicy.mode;
+		presentPolicy = policy;
+		// Before init the swap chain is created with the policy anyway
+		if (modeChanged && swapChain) {
+			requestSwapChainRecreation();
+		}
+		nextFrameDeadline = std::chrono::high_resolution_clock::now();
+	}
+
+	void VulkanContext::waitForNextFrame() {
+		assert(!frame.active);
+		using Clock = std::chrono::high_resolution_clock;
+
+		if (presentPolicy.targetFrameRate > 0.0f) {
+			const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / presentPolicy.targetFrameRate));
+			Clock::time_point now = Clock::now();
+			if (nextFrameDeadline > now) {
+				if (nextFrameDeadline - now > PACING_SPIN_TIME) {
+					std::this_thread::sleep_for(nextFrameDeadline - now - PACING_SPIN_TIME);
+				}
+				const Clock::time_point spinStart = Clock::now();
+				while (Clock::now() < nextFrameDeadline) {
+				}
+				presentStats.pacingSleepSeconds += std::chrono::duration<double, std::chrono::seconds::period>(spinStart - now).count();
+				presentStats.pacingSpinSeconds += std::chrono::duration<double, std::chrono::seconds::period>(Clock::now() - spinStart).count();
+			}
+			// A late frame moves the following deadlines instead of letting the next frames catch up in a burst
+			nextFrameDeadline = std::max(nextFrameDeadline + period, Clock::now());
+		}
+
+		// Waiting here instead of in beginFrame() keeps queued frames from adding to the input latency
+		uint32_t framesAhead = presentPolicy.framesAhead > 0 ? std::min(presentPolicy.framesAhead, maxFramesInFlight) : maxFramesInFlight;
+		if (presentPolicy.mode == PresentMode::LowLatency) {
+			framesAhead = 1;
+		}
+		if (currentFrame >= framesAhead) {
+			const uint32_t waitIndex = (currentFrame - framesAhead) % maxFramesInFlight;
+			const Clock::time_point waitStart = Clock::now();
+			VK_CHECK(device.waitForFences(inFlightFences[waitIndex], VK_TRUE, UINT64_MAX))
+			presentStats.frameAheadWaitSeconds += std::chrono::duration<double, std::chrono::seconds::period>(Clock::now() - waitStart).count();
+		}
+
+		collectFrameLatency();
+		frameStartTimes[currentFrame % maxFramesInFlight] = Clock::now();
+		nextFrameWaited = true;
+	}
+
+	void VulkanContext::collectFrameLatency() {
+		const auto now = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+			if (!frameLatencyPending[i] || device.getFenceStatus(inFlightFences[i]) != vk::Result::eSuccess) {
+				continue;
+			}
+			frameLatencyPending[i] = false;
+
+			const double latency = std::chrono::duration<double, std::chrono::seconds::period>(now - frameStartTimes[i]).count();
+			presentStats.lastInputToGpuCompleteSeconds = latency;
+			presentStats.averageInputToGpuCompleteSeconds = presentStats.latencySamples == 0 ? latency
+				: presentStats.averageInputToGpuCompleteSeconds + (latency - presentStats.averageInputToGpuCompleteSeconds) * LATENCY_AVERAGE_WEIGHT;
+			presentStats.latencySamples++;
+		}
+	}
+
+	bool VulkanContext::beginFrame() {
+		assert(!frame.active);
+		uint32_t frameIndex = currentFrame % maxFramesInFlight;
+		// Input was sampled just before, unless the frame has been started with waitForNextFrame()
+		const auto beginTime = std::chrono::high_resolution_clock::now();
 
-		uint32_t imageIndex;
-		// Have to use the plain C functions here, 
-		// because the Vulkan HPP functions will throw an exception
-		// on VK_ERROR_OUT_OF_DATE_KHR
-		vk::Result acquireResult = static_cast<vk::Result>(vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[frameIndex], nullptr, &imageIndex));
-		if (acquireResult == vk::Result::eErrorOutOfDateKHR) {
+		// With more than one frame in flight the previous frame may still run on the GPU while this one is recorded
+		if (currentFrame > 0 && maxFramesInFlight > 1) {
+			const uint32_t previousFrameIndex = (currentFrame - 1) % maxFramesInFlight;
+			if (device.getFenceStatus(inFlightFences[previousFrameIndex]) != vk::Result::eSuccess) {
+				frameStats.overlappedFrames++;
+			}
+		}
+
+		// Only blocks if the GPU is still working on the frame submitted maxFramesInFlight frames ago
+		auto waitStart = std::chrono::high_resolution_clock::now();
+		VK_CHECK(device.waitForFences(inFlightFences[frameIndex], VK_TRUE, UINT64_MAX))
+		auto waitEnd = std::chrono::high_resolution_clock::now();
+		frameStats.fenceWaitSeconds += std::chrono::duration<double, std::chrono::seconds::period>(waitEnd - waitStart).count();
+
+		collectFrameLatency();
+		if (!nextFrameWaited) {
+			frameStartTimes[frameIndex] = beginTime;
+		}
+		nextFrameWaited = false;
+
+		uploadManager.update();
+		descriptorAllocator.nextFrame();
+		// Culls recorded into this frame slot have finished as well
+		processCullReadback(frameIndex);
+		destroyRetiredSwapChains(false);
+		destroyRetiredResources(false);
+		if (swapChainDirty) {
 			recreateSwapChain();
-			return;
 		}
-		assert(acquireResult == vk::Result::eSuccess || acquireResult == vk::Result::eSuboptimalKHR);
 
-		// Check if a previous frame is using this image (i.e. there is its fence to wait on)
-		if (imagesInFlight[imageIndex]) {
-			VK_CHECK(device.waitForFences(imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX))
+		uint32_t imageIndex = frameIndex;
+		if (headless) {
+			// The frame which used this slot before has finished, its readback can be handed out
+			processReadback(frameIndex);
+		}
+		else {
+			// Have to use the plain C functions here, 
+			// because the Vulkan HPP functions will throw an exception
+			// on VK_ERROR_OUT_OF_DATE_KHR
+			vk::Result acquireResult = static_cast<vk::Result>(vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[frameIndex], nullptr, &imageIndex));
+			if (acquireResult == vk::Result::eErrorOutOfDateKHR) {
+				requestSwapChainRecreation();
+				recreateSwapChain();
+				return false;
+			}
+			assert(acquireResult == vk::Result::eSuccess || acquireResult == vk::Result::eSuboptimalKHR);
+
+			// Check if a previous frame is using this image (i.e. there is its fence to wait on)
+			if (imagesInFlight[imageIndex]) {
+				VK_CHECK(device.waitForFences(imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX))
+			}
+			// Mark the image as now being in use by this frame
+			imagesInFlight[imageIndex] = inFlightFences[frameIndex];
+		}
+
+		// The fence of this frame has been waited on, so nothing recorded from this pool is in use anymore
+		device.resetCommandPool(frameCommandPools[frameIndex]);
+		for (uint32_t i = 0; i < MAX_RECORDING_THREADS; i++) {
+			RecordingThread& recordingThread = recordingThreads[frameIndex * MAX_RECORDING_THREADS + i];
+			if (recordingThread.usedCommandBuffers > 0) {
+				device.resetCommandPool(recordingThread.commandPool);
+				recordingThread.usedCommandBuffers = 0;
+			}
+		}
+		vk::CommandBuffer commandBuffer = commandBuffers[frameIndex];
+
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+		beginInfo.pInheritanceInfo = nullptr; // optional
+		commandBuffer.begin(beginInfo);
+#if VSV_GPU_PROFILER()
+		gpuProfiler.beginFrame(commandBuffer, frameIndex);
+		gpuProfiler.beginScope(commandBuffer, "Frame");
+#endif
+
+		// Everything uploaded until now has to be visible to this frame,
+		// resources created while the frame is recorded can be used from the next frame on
+		uploadManager.flush();
+		uint64_t uploadWaitValue = uploadManager.recordAcquireBarriers(commandBuffer);
+		// Blits can't run on a dedicated transfer queue, so the mip chains of freshly uploaded textures are built here
+		for (Texture* texture : pendingMipGenerations) {
+			recordMipGeneration(commandBuffer, texture);
+		}
+		pendingMipGenerations.clear();
+		// Residency changes whose uploads have finished were acquired above at the latest
+		updateStreamedTextures();
+
+		uniformRingBuffer.beginFrame(frameIndex);
+		instanceRingBuffer.beginFrame(frameIndex);
+
+		// Nothing is bound yet in the new command buffer
+		frame = FrameState{};
+		frame.active = true;
+		frame.frameIndex = frameIndex;
+		frame.imageIndex = imageIndex;
+		frame.commandBuffer = commandBuffer;
+		frame.uploadWaitValue = uploadWaitValue;
+		frame.model = glm::mat4(1.0f);
+		frame.uniformsDirty = true;
+		frame.pushedTextureIndex = Texture::NO_BINDLESS_INDEX;
+		updateCamera();
+
+		return true;
+	}
+
+	void VulkanContext::endFrame() {
+		assert(frame.active && !frame.inRenderPass);
+		const uint32_t frameIndex = frame.frameIndex;
+		uint32_t imageIndex = frame.imageIndex;
+		vk::CommandBuffer commandBuffer = frame.commandBuffer;
+		const uint64_t uploadWaitValue = frame.uploadWaitValue;
+
+		// The swap chain image has to end up in the present layout (the offscreen target in the readback layout)
+		if (!frame.mainPassRecorded) {
+			beginRenderPass(nullptr);
+			endRenderPass();
+		}
+
+		uniformRingBuffer.endFrame();
+		instanceRingBuffer.endFrame();
+
+		if (headless && readbackFunc) {
+			VSV_GPU_SCOPE(gpuProfiler, commandBuffer, "Readback");
+			recordReadback(commandBuffer, frameIndex);
 		}
-		// Mark the image as now being in use by this frame
-		imagesInFlight[imageIndex] = inFlightFences[frameIndex];
 
-		vk::Semaphore waitSemaphores[] = { imageAvailableSemaphores[frameIndex] };
-		vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+#if VSV_GPU_PROFILER()
+		gpuProfiler.endScope(commandBuffer);
+		gpuProfiler.endFrame();
+#endif
+		commandBuffer.end();
+
+		std::vector<vk::Semaphore> waitSemaphores;
+		std::vector<vk::PipelineStageFlags> waitStages;
+		std::vector<uint64_t> waitValues; // values for binary semaphores are ignored
+		if (!headless) {
+			waitSemaphores.push_back(imageAvailableSemaphores[frameIndex]);
+			waitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+			waitValues.push_back(0);
+		}
+		if (uploadWaitValue > 0) {
+			waitSemaphores.push_back(uploadManager.getTimelineSemaphore());
+			waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+			waitValues.push_back(uploadWaitValue);
+		}
 		vk::Semaphore signalSemaphores[] = { renderFinishedSemaphores[frameIndex] };
 
-		updateUniformBuffer(imageIndex);
+		vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineInfo.pWaitSemaphoreValues = waitValues.data();
 
 		vk::SubmitInfo submitInfo{};
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffers[frameIndex];
+		// Nothing is presented in headless mode, so nobody would wait on the semaphore
+		submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
 		device.resetFences(inFlightFences[frameIndex]);
 
 		graphicsQueue.submit(submitInfo, inFlightFences[frameIndex]);
+		frameLatencyPending[frameIndex] = true;
+
+		if (!headless) {
+			vk::SwapchainKHR swapChains[] = { swapChain };
+			vk::PresentInfoKHR presentInfo{};
+			presentInfo.waitSemaphoreCount = 1;
+			presentInfo.pWaitSemaphores = signalSemaphores;
+			presentInfo.swapchainCount = 1;
+			presentInfo.pSwapchains = swapChains;
+			presentInfo.pImageIndices = &imageIndex;
+			presentInfo.pResults = nullptr; // optional
+
+			// Have to use the plain C functions here, 
+			// because the Vulkan HPP functions will throw an exception
+			// on VK_ERROR_OUT_OF_DATE_KHR
+			vk::Result presentResult = static_cast<vk::Result>(vkQueuePresentKHR(presentQueue, (VkPresentInfoKHR*)(&presentInfo)));
+			if (presentResult == vk::Result::eErrorOutOfDateKHR || presentResult == vk::Result::eSuboptimalKHR) {
+				requestSwapChainRecreation();
+			}
+			else {
+				assert(presentResult == vk::Result::eSuccess);
+			}
+		}
 
-		vk::SwapchainKHR swapChains[] = { swapChain };
-		vk::PresentInfoKHR presentInfo{};
-		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
-		presentInfo.swapchainCount = 1;
-		presentInfo.pSwapchains = swapChains;
-		presentInfo.pImageIndices = &imageIndex;
-		presentInfo.pResults = nullptr; // optional
-
-		// Have to use the plain C functions here, 
-		// because the Vulkan HPP functions will throw an exception
-		// on VK_ERROR_OUT_OF_DATE_KHR
-		vk::Result presentResult = static_cast<vk::Result>(vkQueuePresentKHR(presentQueue, (VkPresentInfoKHR*)(&presentInfo)));
-		if (presentResult == vk::Result::eErrorOutOfDateKHR || presentResult == vk::Result::eSuboptimalKHR) {
-			recreateSwapChain();
+		currentFrame++;
+		frameStats.frameCount++;
+		frame.active = false;
+	}
+
+	void VulkanContext::recordReadback(vk::CommandBuffer commandBuffer, uint32_t frameIndex) {
+		const Texture* target = textures.get(offscreenTargets[frameIndex]);
+
+		// The render pass already left the target in eTransferSrcOptimal, only the writes have to be made visible
+		vk::ImageMemoryBarrier imageBarrier{};
+		imageBarrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+		imageBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = target->vk.image;
+		imageBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		imageBarrier.subresourceRange.baseMipLevel = 0;
+		imageBarrier.subresourceRange.levelCount = 1;
+		imageBarrier.subresourceRange.baseArrayLayer = 0;
+		imageBarrier.subresourceRange.layerCount = 1;
+		imageBarrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+		imageBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(),
+			{}, {}, imageBarrier
+		);
+
+		vk::BufferImageCopy copyRegion{};
+		copyRegion.bufferOffset = 0;
+		copyRegion.bufferRowLength = 0;
+		copyRegion.bufferImageHeight = 0;
+		copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		copyRegion.imageSubresource.mipLevel = 0;
+		copyRegion.imageSubresource.baseArrayLayer = 0;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageOffset = vk::Offset3D{ 0, 0, 0 };
+		copyRegion.imageExtent = vk::Extent3D{ target->width, target->height, 1 };
+		commandBuffer.copyImageToBuffer(target->vk.image, vk::ImageLayout::eTransferSrcOptimal, readbackBuffers[frameIndex], copyRegion);
+
+		vk::BufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		bufferBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = readbackBuffers[frameIndex];
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+			vk::DependencyFlags(),
+			{}, bufferBarrier, {}
+		);
+
+		readbackFrames[frameIndex] = currentFrame;
+	}
+
+	void VulkanContext::processReadback(uint32_t frameIndex) {
+		if (readbackFrames[frameIndex] == NO_READBACK) {
+			return;
 		}
-		else {
-			assert(presentResult == vk::Result::eSuccess);
+
+		const Texture* target = textures.get(offscreenTargets[frameIndex]);
+		vmaInvalidateAllocation(allocator, readbackBufferAllocs[frameIndex], 0, VK_WHOLE_SIZE);
+		if (readbackFunc) {
+			readbackFunc(readbackData[frameIndex], target->width, target->height, readbackFrames[frameIndex]);
 		}
+		readbackFrames[frameIndex] = NO_READBACK;
+	}
 
-		currentFrame++;
+	void VulkanContext::processCullReadback(uint32_t frameIndex) {
+		for (ObjectBuffer* objectBuffer : objectBuffers) {
+			auto& impl = objectBuffer->vk;
+			if (impl.culledFrames[frameIndex] == NOT_CULLED) {
+				continue;
+			}
+			impl.culledFrames[frameIndex] = NOT_CULLED;
+
+			const vk::DeviceSize readbackOffset = impl.readbackStride * frameIndex;
+			vmaInvalidateAllocation(allocator, impl.readbackBufferAlloc, readbackOffset, impl.readbackStride);
+			const uint8_t* data = impl.readbackData + readbackOffset;
+			memcpy(&objectBuffer->visibleCount, data, sizeof(uint32_t));
+			cullStats.visibleObjects += objectBuffer->visibleCount;
+			if (!impl.validated) {
+				continue;
+			}
+
+			// Compacted commands are in the order the invocations finished, otherwise culled ones have no instance
+			const uint32_t commandCount = drawIndirectCountSupported ? objectBuffer->visibleCount : objectBuffer->objectCount;
+			std::vector<uint32_t> visible;
+			visible.reserve(commandCount);
+			for (uint32_t i = 0; i < commandCount; i++) {
+				vk::DrawIndexedIndirectCommand command;
+				memcpy(&command, data + sizeof(uint32_t) + sizeof(command) * i, sizeof(command));
+				if (command.instanceCount > 0) {
+					visible.push_back(command.firstInstance);
+				}
+			}
+			std::sort(visible.begin(), visible.end());
+			const uint32_t visibleCommands = static_cast<uint32_t>(visible.size());
+			// Objects on a plane may go either way
+			const std::vector<uint32_t>& uncertain = impl.uncertainObjects[frameIndex];
+			if (!uncertain.empty()) {
+				std::vector<uint32_t> certain;
+				certain.reserve(visible.size());
+				std::set_difference(visible.begin(), visible.end(), uncertain.begin(), uncertain.end(), std::back_inserter(certain));
+				visible.swap(certain);
+			}
+
+			const std::vector<uint32_t>& expected = impl.expectedVisible[frameIndex];
+			cullStats.validatedCulls++;
+			if (visible != expected || objectBuffer->visibleCount != visibleCommands) {
+				cullStats.validationMismatches++;
+				printf("Cull validation failed: GPU found %u visible objects, CPU reference %u\n", objectBuffer->visibleCount, static_cast<uint32_t>(expected.size()));
+			}
+		}
 	}
 
-	void VulkanContext::updateUniformBuffer(uint32_t currentImage) {
+	void VulkanContext::updateCamera() {
 		static auto startTime = std::chrono::high_resolution_clock::now();
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float elapsedTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 
-		UniformBufferObject ubo{};
-		ubo.model = glm::rotate(glm::mat4(1.0f), elapsedTime * glm::radians(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.view = glm::lookAt(glm::vec3(sinf(elapsedTime * 0.5f) * 1.5f, sinf(elapsedTime * 0.3f), -2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		frame.view = glm::lookAt(glm::vec3(sinf(elapsedTime * 0.5f) * 1.5f, sinf(elapsedTime * 0.3f), -2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		constexpr float fovy = glm::radians(45.0f);
 		const float aspect = (float)swapChainExtent.width / (float)swapChainExtent.height;
 		const float f = 1.0f / tanf(fovy * 0.5f);
 		const float nearPlane = 0.1f;
-		ubo.proj = {
+		frame.proj = {
 			{f / aspect, 0.0f, 0.0f, 0.0f}, // first COLUMN
 			{ 0.0f, f, 0.0f, 0.0f }, // second COLUMN
 			{ 0.0f, 0.0f, 0.0f, -1.0f }, // third COLUMN
 			{ 0.0f, 0.0f, nearPlane, 0.0f } // fourth COLUMN
 		};
-
-		void* mappedData;
-		vmaMapMemory(
-			allocator,
-			uniformBufferAllocs[currentImage],
-			&mappedData
-		);
-		memcpy(mappedData, &ubo, sizeof(ubo));
-		vmaUnmapMemory(allocator, uniformBufferAllocs[currentImage]);
 	}
 
-	void VulkanContext::update() {
-		drawFrame();
-		device.waitIdle();
-	}
-
-	VertexBuffer* VulkanContext::createVertexBuffer(const Vertex* vertices, uint16_t vertexCount) {
+	VertexBufferHandle VulkanContext::createVertexBuffer(const Vertex* vertices, uint32_t vertexCount) {
 		const vk::DeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
 
-		std::vector<uint32_t> stagingQueueIndices = { queueFamilyIndices.transfer.value() };
-		vk::Buffer stagingBuffer;
-		VmaAllocation stagingBufferAlloc;
-		VK_CHECK(createBuffer(
-			bufferSize,
-			vk::BufferUsageFlagBits::eTransferSrc,
-			stagingQueueIndices,
-			VMA_MEMORY_USAGE_CPU_ONLY,
-			stagingBuffer, stagingBufferAlloc
-		));
-
-		void* mappedData;
-		vmaMapMemory(allocator, stagingBufferAlloc, &mappedData);
-		memcpy(mappedData, vertices, bufferSize);
-		vmaUnmapMemory(allocator, stagingBufferAlloc);
-
-		VertexBuffer* vertexBuffer = new VertexBuffer();
+		const VertexBufferHandle handle = vertexBuffers.create();
+		VertexBuffer* vertexBuffer = vertexBuffers.get(handle);
+		vertexBuffer->vk.allocation = uploadGeometry(vertexArena, vertices, bufferSize);
 
-		std::vector<uint32_t> queueIndices = { queueFamilyIndices.graphics.value(), queueFamilyIndices.transfer.value() };
-		VK_CHECK(createBuffer(
-			bufferSize,
-			vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-			queueIndices,
-			VMA_MEMORY_USAGE_GPU_ONLY,
-			vertexBuffer->vk.buffer, vertexBuffer->vk.bufferAlloc
-		));
-
-		copyBuffer(stagingBuffer, vertexBuffer->vk.buffer, bufferSize);
-
-		vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAlloc);
-
-		return vertexBuffer;
+		return handle;
 	}
 
-	inline void VulkanContext::destroyVertexBuffer(VertexBuffer* vertexBuffer) {
-		vmaDestroyBuffer(allocator, vertexBuffer->vk.buffer, vertexBuffer->vk.bufferAlloc);
-		delete vertexBuffer;
+	void VulkanContext::destroyVertexBuffer(VertexBufferHandle handle) {
+		std::lock_guard<std::mutex> lock(retireMutex);
+		pendingRetires.vertexBuffers.push_back(handle);
 	}
 
-	IndexBuffer* VulkanContext::createIndexBuffer(const uint16_t* indices, uint32_t indexCount) {
+	IndexBufferHandle VulkanContext::createIndexBuffer(const uint16_t* indices, uint32_t indexCount) {
 		const vk::DeviceSize bufferSize = sizeof(indices[0]) * indexCount;
 
-		std::vector<uint32_t> stagingQueueIndices = { queueFamilyIndices.transfer.value() };
-		vk::Buffer stagingBuffer;
-		VmaAllocation stagingBufferAlloc;
-		VK_CHECK(createBuffer(
-			bufferSize,
-			vk::BufferUsageFlagBits::eTransferSrc,
-			stagingQueueIndices,
-			VMA_MEMORY_USAGE_CPU_ONLY,
-			stagingBuffer, stagingBufferAlloc
-		));
+		const IndexBufferHandle handle = indexBuffers.create();
+		IndexBuffer* indexBuffer = indexBuffers.get(handle);
+		indexBuffer->indexType = IndexType::Uint16;
+		indexBuffer->indexCount = indexCount;
+		indexBuffer->vk.allocation = uploadGeometry(getIndexArena(indexBuffer->indexType), indices, bufferSize);
 
+		return handle;
+	}
 
-		void* mappedData;
-		vmaMapMemory(allocator, stagingBufferAlloc, &mappedData);
-		memcpy(mappedData, indices, bufferSize);
-		vmaUnmapMemory(allocator, stagingBufferAlloc);
+	IndexBufferHandle VulkanContext::createIndexBuffer(const uint32_t* indices, uint32_t indexCount) {
+		if (selectIndexType(indices, indexCount) == IndexType::Uint16) {
+			// Half the index bandwidth, the narrowed copy only lives until it is in staging memory
+			const std::vector<uint16_t> narrowed = narrowIndices(indices, indexCount);
+			return createIndexBuffer(narrowed.data(), indexCount);
+		}
 
-		IndexBuffer* indexBuffer = new IndexBuffer();
+		const vk::DeviceSize bufferSize = sizeof(indices[0]) * indexCount;
 
-		std::vector<uint32_t> queueIndices = { queueFamilyIndices.graphics.value(), queueFamilyIndices.transfer.value() };
-		VK_CHECK(createBuffer(
-			bufferSize,
-			vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-			queueIndices,
-			VMA_MEMORY_USAGE_GPU_ONLY,
-			indexBuffer->vk.buffer, indexBuffer->vk.bufferAlloc
-		));
+		const IndexBufferHandle handle = indexBuffers.create();
+		IndexBuffer* indexBuffer = indexBuffers.get(handle);
+		indexBuffer->indexType = IndexType::Uint32;
+		indexBuffer->indexCount = indexCount;
+		indexBuffer->vk.allocation = uploadGeometry(getIndexArena(indexBuffer->indexType), indices, bufferSize);
+
+		return handle;
+	}
 
-		copyBuffer(stagingBuffer, indexBuffer->vk.buffer, bufferSize);
+	void VulkanContext::destroyIndexBuffer(IndexBufferHandle handle) {
+		std::lock_guard<std::mutex> lock(retireMutex);
+		pendingRetires.indexBuffers.push_back(handle);
+	}
 
-		vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAlloc);
+	GeometryArena::Allocation VulkanContext::uploadGeometry(GeometryArena& arena, const void* data, vk::DeviceSize size) {
+		assert(size > 0 && size % arena.getStride() == 0);
 
-		return indexBuffer;
+		GeometryArena::Allocation allocation = arena.allocate(static_cast<uint32_t>(size / arena.getStride()));
+		// Copied into staging memory right away, the copy itself is submitted with the next batch
+		uploadManager.uploadBuffer(allocation.buffer, allocation.offset, data, size, true);
+		return allocation;
 	}
 
-	inline void VulkanContext::destroyIndexBuffer(IndexBuffer* indexBuffer) {
-		vmaDestroyBuffer(allocator, indexBuffer->vk.buffer, indexBuffer->vk.bufferAlloc);
-		delete indexBuffer;
+	void VulkanContext::freeGeometry(GeometryArena& arena, GeometryArena::Allocation& allocation) {
+		if (!allocation.handle) {
+			return;
+		}
+		// The range might still be referenced by a frame in flight
+		{
+			std::lock_guard<std::mutex> lock(retireMutex);
+			pendingRetires.geometry.push_back(RetiredGeometry{ &arena, allocation });
+		}
+		allocation = GeometryArena::Allocation{};
 	}
 
-	Texture* VulkanContext::createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage) {
+	TextureHandle VulkanContext::createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage, uint32_t mipLevels) {
 		vk::Format vkFormat = convertToVkFormat(format);
+		assert(mipLevels >= 1 && mipLevels <= Texture::getMaxMipLevels(width, height));
 		vk::ImageUsageFlags usage;
 		assert(!(flags.RenderTarget && (flags.Depth || flags.Stencil)));
 		usage |= flags.RenderTarget ? vk::ImageUsageFlagBits::eColorAttachment : vk::ImageUsageFlagBits(0);
@@ -1491,7 +2894,7 @@ namespace vesuvio {
 		imageInfo.extent.width = width;
 		imageInfo.extent.height = height;
 		imageInfo.extent.depth = depth;
-		imageInfo.mipLevels = 1;
+		imageInfo.mipLevels = mipLevels;
 		imageInfo.arrayLayers = 1;
 		imageInfo.format = vkFormat;
 		imageInfo.tiling = vk::ImageTiling::eOptimal; // TODO
@@ -1504,7 +2907,12 @@ namespace vesuvio {
 		VmaAllocationCreateInfo allocInfo = {};
 		allocInfo.usage = vmaMemoryUsage;
 
-		Texture* texture = new Texture();
+		const TextureHandle handle = textures.create();
+		Texture* texture = textures.get(handle);
+		texture->width = width;
+		texture->height = height;
+		texture->depth = depth;
+		texture->mipLevels = mipLevels;
 		texture->format = format;
 		texture->flags = flags;
 		texture->sampleCount = sampleCount;
@@ -1516,51 +2924,366 @@ namespace vesuvio {
 		aspectFlags |= flags.Sampled && !(flags.Depth || flags.Stencil) ? vk::ImageAspectFlagBits::eColor : vk::ImageAspectFlagBits(0);
 		aspectFlags |= flags.Depth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits(0);
 		aspectFlags |= flags.Stencil ? vk::ImageAspectFlagBits::eStencil : vk::ImageAspectFlagBits(0);
-		texture->vk.imageView = createImageView(texture->vk.image, vkFormat, aspectFlags);
+		texture->vk.imageView = createImageView(texture->vk.image, vkFormat, aspectFlags, mipLevels);
+		if (flags.Sampled && !(flags.Depth || flags.Stencil)) {
+			registerBindlessTexture(texture);
+		}
 
-		return texture;
+		return handle;
 	}
 
-	void VulkanContext::destroyTexture(Texture* texture) {
-		device.destroyImageView(texture->vk.imageView);
-		vmaDestroyImage(allocator, texture->vk.image, texture->vk.imageAlloc);
-		delete texture;
+	TextureHandle VulkanContext::loadTexture(const char* fileName) {
+		TextureHandle handle;
+		if (TextureFile::isContainer(fileName)) {
+			TextureFile file;
+			if (!file.open(fileName)) {
+				return {};
+			}
+			vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(convertToVkFormat(file.getFormat()));
+			if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage)) {
+				printf("Texture format of '%s' is not supported by the device\n", fileName);
+				return {};
+			}
+
+			handle = createTexture(file.getWidth(), file.getHeight(), 1, file.getFormat(), Texture::FlagBits::Sampled | Texture::FlagBits::TransferDst, Texture::SampleCount::Samples1, Texture::MemoryUsage::GpuOnly, file.getMipLevels());
+
+			// KTX2 stores the smallest level first, so the levels are uploaded as one range from the lowest offset on
+			const std::vector<TextureFile::Level>& fileLevels = file.getLevels();
+			uint64_t begin = fileLevels.front().offset;
+			uint64_t end = 0;
+			for (const TextureFile::Level& level : fileLevels) {
+				begin = std::min(begin, level.offset);
+				end = std::max(end, level.offset + level.size);
+			}
+			std::vector<ImageUploadLevel> uploadLevels(fileLevels.size());
+			for (size_t i = 0; i < fileLevels.size(); i++) {
+				uploadLevels[i].width = fileLevels[i].width;
+				uploadLevels[i].height = fileLevels[i].height;
+				uploadLevels[i].offset = fileLevels[i].offset - begin;
+			}
+			uploadManager.uploadImage(textures.get(handle)->vk.image, uploadLevels.data(), static_cast<uint32_t>(uploadLevels.size()), file.getData() + begin, end - begin);
+		}
+		else {
+			int texWidth;
+			int texHeight;
+			int texChannels;
+			stbi_uc* pixels = stbi_load(fileName, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+			if (!pixels) {
+				printf("Failed to load texture '%s'\n", fileName);
+				return {};
+			}
+			const uint32_t width = static_cast<uint32_t>(texWidth);
+			const uint32_t height = static_cast<uint32_t>(texHeight);
+			vk::DeviceSize imageSize = static_cast<uint64_t>(width) * height * 4;
+
+			// Generating the chain needs linear filtered blits from and to the format
+			const Texture::Format format = Texture::Format::R8G8B8A8Srgb;
+			const vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+			vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(convertToVkFormat(format));
+			const bool generateMips = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+			const uint32_t mipLevels = generateMips ? Texture::getMaxMipLevels(width, height) : 1;
+
+			handle = createTexture(width, height, 1, format, Texture::FlagBits::Sampled | Texture::FlagBits::TransferSrc | Texture::FlagBits::TransferDst, Texture::SampleCount::Samples1, Texture::MemoryUsage::GpuOnly, mipLevels);
+
+			// The pixels are copied into staging memory right away, the copy itself is submitted with the next batch
+			uploadManager.uploadImage(textures.get(handle)->vk.image, width, height, pixels, imageSize);
+			stbi_image_free(pixels);
+			if (mipLevels > 1) {
+				pendingMipGenerations.push_back(textures.get(handle));
+			}
+		}
+
+		const Texture* texture = textures.get(handle);
+		uint64_t gpuBytes = 0;
+		for (uint32_t level = 0; level < texture->mipLevels; level++) {
+			gpuBytes += Texture::getLevelSize(texture->format, std::max(texture->width >> level, 1u), std::max(texture->height >> level, 1u));
+		}
+		const uint64_t uncompressedBytes = static_cast<uint64_t>(texture->width) * texture->height * 4;
+		textureStats.texturesLoaded++;
+		textureStats.gpuBytes += gpuBytes;
+		textureStats.uncompressedBytes += uncompressedBytes;
+		printf("Loaded texture '%s' (%ux%u, %u mips, %.2f MiB, %.2f MiB as single level RGBA8)\n",
+			fileName, texture->width, texture->height, texture->mipLevels,
+			gpuBytes / (1024.0 * 1024.0), uncompressedBytes / (1024.0 * 1024.0));
+
+		return handle;
+	}
+
+	void VulkanContext::recordMipGeneration(vk::CommandBuffer commandBuffer, Texture* texture) {
+		vk::ImageMemoryBarrier barrier{};
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = texture->vk.image;
+		barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		// Level 0 was left readable by the upload, the other levels have never been written
+		std::array<vk::ImageMemoryBarrier, 2> initialBarriers = { barrier, barrier };
+		initialBarriers[0].oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		initialBarriers[0].newLayout = vk::ImageLayout::eTransferSrcOptimal;
+		initialBarriers[0].srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		initialBarriers[0].dstAccessMask = vk::AccessFlagBits::eTransferRead;
+		initialBarriers[0].subresourceRange.baseMipLevel = 0;
+		initialBarriers[0].subresourceRange.levelCount = 1;
+		initialBarriers[1].oldLayout = vk::ImageLayout::eUndefined;
+		initialBarriers[1].newLayout = vk::ImageLayout::eTransferDstOptimal;
+		initialBarriers[1].dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+		initialBarriers[1].subresourceRange.baseMipLevel = 1;
+		initialBarriers[1].subresourceRange.levelCount = texture->mipLevels - 1;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(),
+			{}, {}, initialBarriers
+		);
+
+		int32_t width = static_cast<int32_t>(texture->width);
+		int32_t height = static_cast<int32_t>(texture->height);
+		for (uint32_t level = 1; level < texture->mipLevels; level++) {
+			const int32_t levelWidth = std::max(width / 2, 1);
+			const int32_t levelHeight = std::max(height / 2, 1);
+
+			vk::ImageBlit blit{};
+			blit.srcOffsets[1] = vk::Offset3D{ width, height, 1 };
+			blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			blit.srcSubresource.mipLevel = level - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.dstOffsets[1] = vk::Offset3D{ levelWidth, levelHeight, 1 };
+			blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			blit.dstSubresource.mipLevel = level;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+			commandBuffer.blitImage(
+				texture->vk.image, vk::ImageLayout::eTransferSrcOptimal,
+				texture->vk.image, vk::ImageLayout::eTransferDstOptimal,
+				blit, vk::Filter::eLinear
+			);
+
+			// The level just written is the source of the next blit
+			barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+			barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+			barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+			barrier.subresourceRange.baseMipLevel = level;
+			barrier.subresourceRange.levelCount = 1;
+			commandBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+				vk::DependencyFlags(),
+				{}, {}, barrier
+			);
+
+			width = levelWidth;
+			height = levelHeight;
+		}
+
+		barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+		barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = texture->mipLevels;
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+			vk::DependencyFlags(),
+			{}, {}, barrier
+		);
+	}
+
+	void VulkanContext::destroyTexture(TextureHandle handle) {
+		std::lock_guard<std::mutex> lock(retireMutex);
+		pendingRetires.textures.push_back(handle);
+	}
+
+	void VulkanContext::destroyRetiredResources(bool all) {
+		{
+			std::lock_guard<std::mutex> lock(retireMutex);
+			if (!pendingRetires.empty()) {
+				// Frames up to the current one might use the resources
+				pendingRetires.frame = currentFrame;
+				retireLists.push_back(std::move(pendingRetires));
+				pendingRetires = RetireList{};
+			}
+		}
+
+		// Stamped in order, so the lists whose frames have finished are at the front
+		while (!retireLists.empty() && (all || retireLists.front().frame + maxFramesInFlight <= currentFrame)) {
+			RetireList& retired = retireLists.front();
+			for (VertexBufferHandle handle : retired.vertexBuffers) {
+				if (VertexBuffer* vertexBuffer = vertexBuffers.get(handle)) {
+					vertexArena.free(vertexBuffer->vk.allocation);
+					vertexBuffers.destroy(handle);
+					frameStats.deferredDestructions++;
+				}
+			}
+			for (IndexBufferHandle handle : retired.indexBuffers) {
+				if (IndexBuffer* indexBuffer = indexBuffers.get(handle)) {
+					getIndexArena(indexBuffer->indexType).free(indexBuffer->vk.allocation);
+					indexBuffers.destroy(handle);
+					frameStats.deferredDestructions++;
+				}
+			}
+			for (TextureHandle handle : retired.textures) {
+				Texture* texture = textures.get(handle);
+				if (!texture) {
+					continue;
+				}
+				releaseBindlessIndex(texture->bindlessIndex);
+				if (textureStreamer.isStreamed(texture)) {
+					textureStreamer.removeTexture(texture);
+				}
+				else {
+					pendingMipGenerations.erase(std::remove(pendingMipGenerations.begin(), pendingMipGenerations.end(), texture), pendingMipGenerations.end());
+					device.destroyImageView(texture->vk.imageView);
+					vmaDestroyImage(allocator, texture->vk.image, texture->vk.imageAlloc);
+				}
+				textures.destroy(handle);
+				frameStats.deferredDestructions++;
+			}
+			for (RetiredGeometry& geometry : retired.geometry) {
+				geometry.arena->free(geometry.allocation);
+				frameStats.deferredDestructions++;
+			}
+			for (Material* material : retired.materials) {
+				if (material->vk.descriptorSet) {
+					descriptorAllocator.release(material->vk.descriptorSet);
+				}
+				materials.erase(std::remove(materials.begin(), materials.end(), material), materials.end());
+				delete material;
+				frameStats.deferredDestructions++;
+			}
+			for (ObjectBuffer* objectBuffer : retired.objectBuffers) {
+				freeObjectBuffer(objectBuffer);
+				frameStats.deferredDestructions++;
+			}
+			for (RetiredBuffer& buffer : retired.buffers) {
+				vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+				frameStats.deferredDestructions++;
+			}
+			for (vk::DescriptorSet set : retired.descriptorSets) {
+				if (set) {
+					descriptorAllocator.release(set);
+				}
+			}
+			retireLists.pop_front();
+		}
+	}
+
+	TextureHandle VulkanContext::loadStreamedTexture(const char* fileName) {
+		std::unique_ptr<TextureFile> file = std::make_unique<TextureFile>();
+		if (!file->open(fileName)) {
+			return {};
+		}
+		const vk::Format format = convertToVkFormat(file->getFormat());
+		vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(format);
+		if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage)) {
+			printf("Texture format of '%s' is not supported by the device\n", fileName);
+			return {};
+		}
+
+		const TextureHandle handle = textures.create();
+		Texture* texture = textures.get(handle);
+		if (!textureStreamer.addTexture(texture, std::move(file), format)) {
+			textures.destroy(handle);
+			return {};
+		}
+		registerBindlessTexture(texture);
+		printf("Streaming texture '%s' (%ux%u, %u mips, mip %u resident)\n", fileName, texture->width, texture->height, texture->mipLevels, texture->residentMip);
+		return handle;
+	}
+
+	void VulkanContext::requestTextureMip(TextureHandle handle, uint32_t mipLevel) {
+		Texture* texture = textures.get(handle);
+		assert(texture);
+		textureStreamer.requestMip(texture, mipLevel, currentFrame);
+	}
+
+	void VulkanContext::setTextureBudget(uint64_t bytes) {
+		textureStreamer.setBudget(bytes);
 	}
 
 	void VulkanContext::cleanup() {
 		// vulkan
+		device.waitIdle();
+		destroyRetiredSwapChains(true);
+		// Before the descriptor allocator, retired materials and object buffers still hold sets
+		destroyRetiredResources(true);
 		cleanupSwapChain();
 
-		device.destroyPipeline(graphicsPipeline);
+		uniformRingBuffer.destroy();
+		instanceRingBuffer.destroy();
+#if VSV_GPU_PROFILER()
+		gpuProfiler.destroy();
+#endif
+		while (!objectBuffers.empty()) {
+			freeObjectBuffer(objectBuffers.back());
+		}
+		// Materials the application didn't destroy
+		for (Material* material : materials) {
+			if (material->vk.descriptorSet) {
+				descriptorAllocator.release(material->vk.descriptorSet);
+			}
+			delete material;
+		}
+		materials.clear();
+		descriptorAllocator.destroy();
+		if (bindlessSupported) {
+			device.destroyDescriptorPool(bindlessDescriptorPool);
+		}
+
+		// Owns the pipelines
+		pipelineCache.destroy();
 		device.destroyPipelineLayout(pipelineLayout);
 		device.destroyDescriptorSetLayout(descriptorSetLayout);
+		if (bindlessSupported) {
+			device.destroyDescriptorSetLayout(bindlessSetLayout);
+		}
+		if (cullPipeline) {
+			device.destroyPipelineLayout(cullPipelineLayout);
+			device.destroyPipelineLayout(indirectPipelineLayout);
+			device.destroyDescriptorSetLayout(cullSetLayout);
+			device.destroyDescriptorSetLayout(objectSetLayout);
+		}
 
-		destroyVertexBuffer(vb);
-		destroyIndexBuffer(ib);
 		destroyTexture(sampledImage);
+		destroyRetiredResources(true);
 		device.destroySampler(textureSampler);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		for (size_t i = 0; i < maxFramesInFlight; i++) {
 			device.destroySemaphore(imageAvailableSemaphores[i]);
 			device.destroySemaphore(renderFinishedSemaphores[i]);
 			device.destroyFence(inFlightFences[i]);
 		}
-		device.destroyFence(bufferCopyFence);
 
-		device.destroyCommandPool(graphicsCommandPool);
-		device.destroyCommandPool(transferCommandPool);
+		textureStreamer.destroy();
+		uploadManager.destroy();
+		vertexArena.destroy();
+		streamArena.destroy();
+		index16Arena.destroy();
+		index32Arena.destroy();
+
+		for (auto& commandPool : frameCommandPools) {
+			device.destroyCommandPool(commandPool);
+		}
+		for (RecordingThread& recordingThread : recordingThreads) {
+			device.destroyCommandPool(recordingThread.commandPool);
+		}
 		vmaDestroyAllocator(allocator);
 		device.destroy();
 		if (enableValidationLayers) {
 			DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 		}
-		instance.destroySurfaceKHR(surface);
+		if (surface) {
+			instance.destroySurfaceKHR(surface);
+		}
 		instance.destroy();
 
 		// glfw
-		glfwDestroyWindow(window);
+		if (window) {
+			glfwDestroyWindow(window);
 
-		glfwTerminate();
+			glfwTerminate();
+		}
 	}
 
 	VKAPI_ATTR VkBool32 VKAPI_CALL VulkanContext::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
@@ -1575,13 +3298,25 @@ namespace vesuvio {
 	}
 
 	void VulkanContext::resizeFramebuffer(uint16_t width, uint16_t height) noexcept {
-		recreateSwapChain();
+		if (headless) {
+			headlessExtent = vk::Extent2D{ width, height };
+		}
+		// Called from the window callback, possibly while a frame is recorded
+		requestSwapChainRecreation();
 	}
 
 	vk::Format VulkanContext::convertToVkFormat(Texture::Format format) {
 		switch (format) {
 			case Texture::Format::R8G8B8A8Srgb: return vk::Format::eR8G8B8A8Srgb;
 			case Texture::Format::D32Sfloat: return vk::Format::eD32Sfloat;
+			case Texture::Format::R8G8B8A8Unorm: return vk::Format::eR8G8B8A8Unorm;
+			case Texture::Format::BC1RgbaUnorm: return vk::Format::eBc1RgbaUnormBlock;
+			case Texture::Format::BC1RgbaSrgb: return vk::Format::eBc1RgbaSrgbBlock;
+			case Texture::Format::BC3Unorm: return vk::Format::eBc3UnormBlock;
+			case Texture::Format::BC3Srgb: return vk::Format::eBc3SrgbBlock;
+			case Texture::Format::BC5Unorm: return vk::Format::eBc5UnormBlock;
+			case Texture::Format::BC7Unorm: return vk::Format::eBc7UnormBlock;
+			case Texture::Format::BC7Srgb: return vk::Format::eBc7SrgbBlock;
 			default: 
 				assert(false && "Not implemented (yet)"); 
 				return vk::Format::eUndefined;
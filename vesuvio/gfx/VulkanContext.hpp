@@ -4,8 +4,22 @@
 #include <stdint.h>
 #include <optional>
 #include <string>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <atomic>
 
 #include "GfxContext.hpp"
+#include "UniformRingBuffer.hpp"
+#include "UploadManager.hpp"
+#include "TextureStreamer.hpp"
+#include "GeometryArena.hpp"
+#include "GpuProfiler.hpp"
+#include "PipelineCache.hpp"
+#include "DescriptorAllocator.hpp"
+#include "VertexEncoding.hpp"
+#include "ResourcePool.hpp"
 
 #include <vulkan/vulkan.hpp>
 
@@ -27,22 +41,131 @@ namespace vesuvio {
 	class VulkanContext : public GfxContext
 	{
 	public:
-		VulkanContext();
+		VulkanContext(uint32_t maxFramesInFlight = 2);
 		~VulkanContext() { cleanup(); }
 		void init(const char* appName, GLFWwindow* window) override;
-		void update() override;
-
-		VertexBuffer* createVertexBuffer(const Vertex* vertices, uint16_t vertexCount) override;
-		void destroyVertexBuffer(VertexBuffer* vertexBuffer) override;
-		IndexBuffer* createIndexBuffer(const uint16_t* indices, uint32_t indexCount) override;
-		void destroyIndexBuffer(IndexBuffer* indexBuffer) override;
-
-		Texture* createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage) override;
-		void destroyTexture(Texture* texture) override;
+		void initHeadless(const char* appName, uint32_t width, uint32_t height) override;
+		bool beginFrame() override;
+		void endFrame() override;
+		void setPresentPolicy(const PresentPolicy& policy) override;
+		void waitForNextFrame() override;
+		void setReadbackCallback(ReadbackFunc readbackFn) override;
+
+		VertexBufferHandle createVertexBuffer(const Vertex* vertices, uint32_t vertexCount) override;
+		void destroyVertexBuffer(VertexBufferHandle vertexBuffer) override;
+		IndexBufferHandle createIndexBuffer(const uint16_t* indices, uint32_t indexCount) override;
+		IndexBufferHandle createIndexBuffer(const uint32_t* indices, uint32_t indexCount) override;
+		void destroyIndexBuffer(IndexBufferHandle indexBuffer) override;
+
+		TextureHandle createTexture(uint32_t width, uint32_t height, uint32_t depth, Texture::Format format, Texture::Flags flags, Texture::SampleCount sampleCount, Texture::MemoryUsage memoryUsage, uint32_t mipLevels = 1) override;
+		void destroyTexture(TextureHandle texture) override;
+		TextureHandle loadTexture(const char* fileName) override;
+		TextureHandle loadStreamedTexture(const char* fileName) override;
+		const Texture* getTexture(TextureHandle texture) const override { return textures.get(texture); }
+		void requestTextureMip(TextureHandle texture, uint32_t mipLevel) override;
+		void setTextureBudget(uint64_t bytes) override;
+
+		Material* createMaterial(TextureHandle albedo) override;
+		void destroyMaterial(Material* material) override;
+
+		ObjectBuffer* createObjectBuffer(uint32_t capacity) override;
+		void destroyObjectBuffer(ObjectBuffer* objectBuffer) override;
+		void setObjects(ObjectBuffer* objectBuffer, const DrawObject* objects, uint32_t objectCount) override;
+
+		void beginRenderPass(RenderPass* renderPass, bool parallel = false) override;
+		void setMaterial(Material* material) override;
+		void setMeshBuffers(VertexBufferHandle vertexBuffer, IndexBufferHandle indexBuffer) override;
+		void setMesh(Mesh* mesh) override;
+		void setTransform(const glm::mat4& model) override;
+		void draw(uint32_t indexCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0) override;
+		void drawInstanced(uint32_t indexCount, const InstanceData* instances, uint32_t instanceCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0) override;
+		void drawParallel(const DrawCommand* draws, uint32_t drawCount, uint32_t threadCount) override;
+		void cullObjects(ObjectBuffer* objectBuffer) override;
+		void drawObjects(ObjectBuffer* objectBuffer, Material* material) override;
+		void endRenderPass() override;
+		void setParallelFor(ParallelForFunc parallelForFn) override;
 
 		void resizeFramebuffer(uint16_t width, uint16_t height) noexcept override;
 		GfxBackend getGfxBackend() const override { return GfxBackend::Vulkan;  } 
 
+		struct FrameStats
+		{
+			uint64_t frameCount;
+			double fenceWaitSeconds; // time the CPU spent blocked on in-flight fences
+			uint64_t overlappedFrames; // frames started while the GPU was still busy with the previous one
+			uint64_t swapChainRecreations;
+			uint64_t resizeEventsCoalesced; // resize events handled by the recreation of an earlier one
+			uint64_t formatChanges; // recreations which had to rebuild the render pass and pipelines
+			double lastResizeLatencySeconds; // from the first resize event until the new swap chain was ready
+			double maxResizeLatencySeconds;
+			uint64_t deferredDestructions; // resources freed once the last frame which could use them had finished
+		};
+		const FrameStats& getFrameStats() const { return frameStats; }
+
+		struct PresentStats
+		{
+			vk::PresentModeKHR presentMode; // of the current swap chain
+			double pacingSleepSeconds; // time the frame rate limiter slept
+			double pacingSpinSeconds; // and spun after waking up
+			double frameAheadWaitSeconds; // time waitForNextFrame() blocked on frames still running on the GPU
+			// From the start of a frame (when input is sampled) until the CPU saw its fence signaled, so the GPU had finished it.
+			// Fences are only polled at frame boundaries (waitForNextFrame() and beginFrame()), which adds up to a frame of delay.
+			// Not the present itself, scanout adds up to a refresh interval on top, more if Fifo images are queued
+			uint64_t latencySamples;
+			double lastInputToGpuCompleteSeconds;
+			double averageInputToGpuCompleteSeconds; // exponential moving average
+		};
+		const PresentStats& getPresentStats() const { return presentStats; }
+
+		struct DrawStats
+		{
+			uint64_t drawCalls;
+			uint64_t instancesDrawn; // by instanced draw calls
+			uint64_t pipelineBinds;
+			uint64_t descriptorSetBinds;
+			uint64_t vertexBufferBinds;
+			uint64_t indexBufferBinds;
+			uint64_t redundantBindsSkipped; // set calls which did not change the bound state
+			uint64_t droppedDraws; // the frame's uniform or instance ring buffer region was exhausted, the material had no descriptor set or a buffer handle was stale
+			uint32_t lastParallelThreadCount;
+			double lastParallelRecordSeconds; // CPU time of the last drawParallel() until all threads had finished
+		};
+		const DrawStats& getDrawStats() const { return drawStats; }
+
+		struct TextureStats
+		{
+			uint32_t texturesLoaded;
+			uint64_t gpuBytes; // all levels in their stored format
+			uint64_t uncompressedBytes; // the same textures as single level RGBA8
+		};
+		const TextureStats& getTextureStats() const { return textureStats; }
+		const TextureStreamer::Stats& getStreamingStats() const { return textureStreamer.getStats(); }
+
+		struct CullStats
+		{
+			uint64_t culledObjects;
+			uint64_t visibleObjects; // of culls which have finished on the GPU
+			uint64_t validatedCulls;
+			uint64_t validationMismatches; // GPU visible set differed from the CPU reference
+		};
+		const CullStats& getCullStats() const { return cullStats; }
+		const DescriptorAllocator::Stats& getDescriptorStats() const { return descriptorAllocator.getStats(); }
+		// Compares the visible set of every GPU cull with a CPU reference once the frame has finished,
+		// only applies to object buffers created afterwards since they need a readback of their draw commands.
+		// Objects within CULL_VALIDATION_TOLERANCE of a frustum plane are skipped, the GPU rounds differently
+		static constexpr float CULL_VALIDATION_TOLERANCE = 1e-3f;
+		void setCullValidation(bool enabled) { cullValidation = enabled; }
+
+		// Suballocates from a shared geometry arena which is filled through the upload manager, used by the backend implementations of other gfx objects.
+		// size has to be a multiple of the arena's stride
+		GeometryArena::Allocation uploadGeometry(GeometryArena& arena, const void* data, vk::DeviceSize size);
+		// The range is released once no frame in flight can read it anymore, can be called from any thread
+		void freeGeometry(GeometryArena& arena, GeometryArena::Allocation& allocation);
+		// Split vertex streams of any layout, addressed in 4 byte elements
+		GeometryArena& getStreamArena() { return streamArena; }
+		GeometryArena& getIndexArena(IndexType indexType) { return indexType == IndexType::Uint16 ? index16Arena : index32Arena; }
+		const std::vector<GpuScopeTiming>& getGpuTimings() const override;
+
 	private:
 		vk::Format convertToVkFormat(Texture::Format format);
 		VmaMemoryUsage convertToVmaMemoryUsage(Texture::MemoryUsage memoryUsage);
@@ -66,6 +189,55 @@ namespace vesuvio {
 			std::vector<vk::PresentModeKHR> presentModes;
 		};
 
+		// State of the frame which is currently recorded,
+		// binds are deferred until the next draw so unchanged state is never bound twice
+		struct FrameState
+		{
+			bool active;
+			bool inRenderPass;
+			bool parallelPass;
+			bool mainPassRecorded;
+			uint32_t frameIndex;
+			uint32_t imageIndex;
+			vk::CommandBuffer commandBuffer;
+			uint64_t uploadWaitValue;
+			vk::Viewport viewport;
+			vk::Rect2D scissor;
+
+			glm::mat4 model;
+			glm::mat4 view;
+			glm::mat4 proj;
+			bool uniformsDirty;
+			uint32_t uniformOffset;
+
+			Material* material;
+			Mesh* mesh;
+			VertexBuffer* vertexBuffer;
+			IndexBuffer* indexBuffer;
+			bool descriptorSetDirty;
+			bool vertexBufferDirty;
+			bool indexBufferDirty;
+			bool meshBuffersStale; // the last setMeshBuffers() had a stale handle, draws are dropped until valid buffers are set
+			vk::Pipeline pipeline;
+			// What is actually bound, geometry from the same arena block needs no rebind
+			vk::Buffer boundVertexBuffer; // null while mesh streams are bound
+			vk::Buffer boundIndexBuffer;
+			vk::IndexType boundIndexType;
+			int32_t baseVertex;
+			uint32_t baseIndex;
+			bool instanceBufferBound; // the instance ring buffer at binding 1, mesh streams use it as well
+			bool bindlessSetBound;
+			uint32_t pushedTextureIndex;
+		};
+
+		// Secondary command buffers of one recording thread in one frame in flight
+		struct RecordingThread
+		{
+			vk::CommandPool commandPool;
+			std::vector<vk::CommandBuffer> commandBuffers;
+			uint32_t usedCommandBuffers;
+		};
+
 	private:
 
 		void createInstance(const char* appName);
@@ -74,12 +246,27 @@ namespace vesuvio {
 		void pickPhysicalDevice();
 		void createLogicalDevice();
 		void createVmaAllocator();
-		void createSwapChain();
+		void createUploadManager();
+		void createTextureStreamer();
+		void createGeometryArenas();
+		std::vector<uint32_t> getUploadQueueFamilies();
+		void createGpuProfiler();
+		void createPipelineCache();
+		void createSwapChain(vk::SwapchainKHR oldSwapChain = nullptr);
 		void createSwapChainImageViews();
+		void createOffscreenTargets();
+		void destroyOffscreenTargets();
 		void createSyncObjects();
 		void createRenderPass();
 		void createDescriptorSetLayout();
 		void createGraphicsPipeline();
+		// Pipelines which depend on the render pass (and so on the swap chain format)
+		void createMainPipelines();
+		vk::Pipeline createGraphicsPipeline(const vk::PipelineVertexInputStateCreateInfo& vertexInputInfo, const char* vertexShaderFile, vk::PipelineLayout layout);
+		void createGpuDrivenPipelines();
+		void createIndirectPipeline();
+		vk::Pipeline getMeshPipeline(const VertexEncoding& encoding);
+		vk::Pipeline getInstancedPipeline();
 		void createFramebuffers();
 		void createCommandPools();
 		void createDepthResources();
@@ -87,15 +274,42 @@ namespace vesuvio {
 		void createTextureSampler();
 		void createUniformBuffers();
 		void createDescriptorPool();
-		void createDescriptorSets();
 		void createCommandBuffers();
+		void writeMaterialDescriptorSet(Material* material);
+		void createBindlessTable();
+		void registerBindlessTexture(Texture* texture);
+		void releaseBindlessIndex(uint32_t index);
+		void bindBindlessTexture(vk::CommandBuffer commandBuffer, const Material* material, bool& setBound, uint32_t& pushedIndex);
+		std::vector<vk::PushConstantRange> getMaterialPushConstantRanges() const;
+		void updateStreamedTextures();
 
 		void cleanup();
 		void cleanupSwapChain();
+		void requestSwapChainRecreation();
 		void recreateSwapChain();
-
-		void drawFrame();
-		void updateUniformBuffer(uint32_t currentImage);
+		void recreateFormatDependentObjects();
+		// all destroys them regardless of the frames in flight, the device has to be idle
+		void destroyRetiredSwapChains(bool all);
+		// Frees the resources of retire lists whose frames have finished, all frees everything and needs an idle device
+		void destroyRetiredResources(bool all);
+		// The object storage buffer and the descriptor sets which read it, false if a set couldn't be allocated
+		bool createObjectStorage(ObjectBuffer* objectBuffer);
+		void retireObjectStorage(ObjectBuffer* objectBuffer);
+		// Immediately, no frame in flight may use the object buffer anymore
+		void freeObjectBuffer(ObjectBuffer* objectBuffer);
+		// Records the input to GPU completion latency of every submitted frame whose fence is signaled by now
+		void collectFrameLatency();
+
+		void updateCamera();
+		// Returns false if the draw has to be dropped because the constants didn't fit into this frame
+		bool flushDrawState(bool instanced = false);
+		// Thread safe, may be called while recording in parallel
+		void reportStaleHandle(const char* caller);
+		void runParallel(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+		vk::CommandBuffer recordDraws(uint32_t threadIndex, const vk::CommandBufferInheritanceInfo& inheritanceInfo, const DrawCommand* draws, uint32_t drawCount, DrawStats& stats);
+		void recordReadback(vk::CommandBuffer commandBuffer, uint32_t frameIndex);
+		void processReadback(uint32_t frameIndex);
+		void processCullReadback(uint32_t frameIndex);
 
 		float rateDevice(const vk::PhysicalDevice& device);
 		bool checkDeviceExtensionSupport(const vk::PhysicalDevice& device);
@@ -105,8 +319,7 @@ namespace vesuvio {
 		vk::PresentModeKHR chooseSwapChainPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes);
 		vk::Extent2D chooseSwapChainExtent(const vk::SurfaceCapabilitiesKHR& capabilities);
 		vk::DebugUtilsMessengerCreateInfoEXT getDebugMessengerCreateInfo();
-		vk::ShaderModule createShaderModule(const std::vector<char>& shaderCode);
-		vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags);
+		vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels = 1);
 
 		uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties);
 		vk::Result createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
@@ -116,11 +329,7 @@ namespace vesuvio {
 								vk::Format format, vk::ImageTiling tiling, 
 								vk::ImageUsageFlags usage, VmaMemoryUsage memoryUsage,
 								vk::Image& image, VmaAllocation& allocation);
-		void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size, vk::CommandBuffer commandBuffer = nullptr);
-		void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height, vk::CommandBuffer commandBuffer = nullptr);
-		vk::CommandBuffer beginOneTimeCommandBuffer(vk::CommandPool pool);
-		void endOneTimeCommandBuffer(vk::CommandBuffer commandBuffer, vk::CommandPool pool, vk::Queue queue);
-		void transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::CommandBuffer commandBuffer = nullptr);
+		void recordMipGeneration(vk::CommandBuffer commandBuffer, Texture* texture);
 		
 		bool checkValidationLayerSupport();
 		std::vector<const char*> getRequiredExtensions();
@@ -139,6 +348,34 @@ namespace vesuvio {
 		uint32_t currentFrame;
 		// window
 		GLFWwindow* window;
+		// headless rendering into offscreen targets instead of a swap chain
+		bool headless;
+		// set by resize events and out of date presents, the swap chain is recreated at the start of the next frame
+		bool swapChainDirty;
+		std::chrono::high_resolution_clock::time_point resizeRequestTime;
+		PresentPolicy presentPolicy;
+		PresentStats presentStats;
+		std::chrono::high_resolution_clock::time_point nextFrameDeadline;
+		bool nextFrameWaited; // waitForNextFrame() has set the start time of the next frame
+		// per frame in flight
+		std::vector<std::chrono::high_resolution_clock::time_point> frameStartTimes;
+		std::vector<bool> frameLatencyPending; // submitted, fence not seen signaled yet
+		// Sleeps overshoot by up to a scheduler tick, the rest until the deadline is spun
+		static constexpr std::chrono::microseconds PACING_SPIN_TIME = std::chrono::microseconds(2000);
+		static constexpr double LATENCY_AVERAGE_WEIGHT = 0.1;
+		bool memoryBudgetSupported; // VK_EXT_memory_budget, otherwise VMA estimates the budgets
+		bool gpuDrivenSupported; // multiDrawIndirect and drawIndirectFirstInstance, required by object buffers
+		bool drawIndirectCountSupported; // otherwise culled objects are drawn with zero instances
+		bool bindlessSupported; // descriptor indexing, otherwise every material has a set with its albedo
+		vk::Extent2D headlessExtent;
+		std::vector<TextureHandle> offscreenTargets;
+		ReadbackFunc readbackFunc;
+		// per frame in flight
+		std::vector<vk::Buffer> readbackBuffers;
+		std::vector<VmaAllocation> readbackBufferAllocs;
+		std::vector<void*> readbackData;
+		std::vector<uint64_t> readbackFrames;
+		static constexpr uint64_t NO_READBACK = UINT64_MAX;
 		// vulkan
 		vk::Instance instance;
 		vk::SurfaceKHR surface;
@@ -154,25 +391,145 @@ namespace vesuvio {
 		vk::Extent2D swapChainExtent;
 		std::vector<vk::ImageView> swapChainImageViews;
 		std::vector<vk::Framebuffer> swapChainFramebuffers;
-		const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+		// Replaced by a recreation, destroyed once the frames in flight which use them have finished
+		struct RetiredSwapChain
+		{
+			vk::SwapchainKHR swapChain;
+			std::vector<vk::ImageView> imageViews;
+			std::vector<vk::Framebuffer> framebuffers;
+			vk::Image depthImage;
+			VmaAllocation depthImageAlloc;
+			vk::ImageView depthImageView;
+			uint64_t frame;
+		};
+		std::vector<RetiredSwapChain> retiredSwapChains;
+		// Render passes replaced by a format change, destroyed on cleanup
+		std::vector<vk::RenderPass> retiredRenderPasses;
+		// Resources destroyed through the interface. Destroy calls may come from any thread and only append to
+		// pendingRetires, the render thread stamps it with the current frame at the start of a frame and frees
+		// the retire lists once the fence of their frame has been waited on. Freeing a handle twice is harmless
+		struct RetiredGeometry
+		{
+			GeometryArena* arena;
+			GeometryArena::Allocation allocation;
+		};
+		struct RetiredBuffer
+		{
+			vk::Buffer buffer;
+			VmaAllocation allocation;
+		};
+		struct RetireList
+		{
+			std::vector<VertexBufferHandle> vertexBuffers;
+			std::vector<IndexBufferHandle> indexBuffers;
+			std::vector<TextureHandle> textures;
+			std::vector<RetiredGeometry> geometry;
+			std::vector<Material*> materials;
+			std::vector<ObjectBuffer*> objectBuffers;
+			std::vector<RetiredBuffer> buffers;
+			std::vector<vk::DescriptorSet> descriptorSets; // from descriptorAllocator.getSet()
+			uint64_t frame;
+
+			bool empty() const {
+				return vertexBuffers.empty() && indexBuffers.empty() && textures.empty() && geometry.empty()
+					&& materials.empty() && objectBuffers.empty() && buffers.empty() && descriptorSets.empty();
+			}
+		};
+		std::mutex retireMutex;
+		RetireList pendingRetires; // guarded by retireMutex
+		std::deque<RetireList> retireLists; // oldest first, only touched by the render thread
+		const uint32_t maxFramesInFlight;
+		FrameStats frameStats;
+		FrameState frame;
+		DrawStats drawStats;
+		TextureStats textureStats;
+		CullStats cullStats;
 		vk::RenderPass renderPass;
-		vk::CommandPool graphicsCommandPool;
-		vk::CommandPool transferCommandPool;
+		// per frame in flight
+		std::vector<vk::CommandPool> frameCommandPools;
 		std::vector<vk::CommandBuffer> commandBuffers;
+		// per frame in flight and recording thread, frameIndex * MAX_RECORDING_THREADS + threadIndex
+		std::vector<RecordingThread> recordingThreads;
+		static constexpr uint32_t MAX_RECORDING_THREADS = 8;
+		ParallelForFunc parallelForFunc;
 		std::vector<vk::Semaphore> imageAvailableSemaphores;
 		std::vector<vk::Semaphore> renderFinishedSemaphores;
 		std::vector<vk::Fence> inFlightFences;
 		std::vector<vk::Fence> imagesInFlight;
 
-		vk::Fence bufferCopyFence;
+		UploadManager uploadManager;
+		static constexpr vk::DeviceSize UPLOAD_STAGING_SIZE = 32 * 1024 * 1024;
+		TextureStreamer textureStreamer;
+		// resources behind the handles of the interface, the backend keeps pointers to them while they are alive
+		ResourcePool<VertexBuffer> vertexBuffers;
+		ResourcePool<IndexBuffer> indexBuffers;
+		// Draws and objects with stale buffer handles are dropped, only the first one is logged
+		std::atomic<bool> staleHandleReported;
+		ResourcePool<Texture> textures;
+		GeometryArena vertexArena; // interleaved vertices of vertex buffers
+		GeometryArena streamArena;
+		GeometryArena index16Arena;
+		GeometryArena index32Arena;
+		static constexpr vk::DeviceSize VERTEX_ARENA_BLOCK_SIZE = 32 * 1024 * 1024;
+		static constexpr vk::DeviceSize STREAM_ARENA_BLOCK_SIZE = 64 * 1024 * 1024;
+		static constexpr vk::DeviceSize INDEX_ARENA_BLOCK_SIZE = 16 * 1024 * 1024;
+#if VSV_GPU_PROFILER()
+		GpuProfiler gpuProfiler;
+#endif
 
 		QueueFamilyIndices queueFamilyIndices;
 
 		vk::DescriptorSetLayout descriptorSetLayout;
-		vk::DescriptorPool descriptorPool;
-		std::vector<vk::DescriptorSet> descriptorSets;
+		// Material and object buffer sets, grows by another pool when the existing ones are full
+		DescriptorAllocator descriptorAllocator;
+		static constexpr uint32_t DESCRIPTOR_SETS_PER_POOL = 256;
+		// Materials get the set of the new image when a streamed albedo changes,
+		// the old one is released once no frame in flight can use it anymore
+		struct RetiredDescriptorSet
+		{
+			vk::DescriptorSet descriptorSet;
+			uint64_t frame;
+		};
+		std::vector<RetiredDescriptorSet> retiredDescriptorSets;
+		std::vector<Material*> materials;
+		// Some materials have no descriptor set because its allocation failed, they aren't drawn until a retry succeeds
+		bool materialSetsMissing;
+
+		// Global texture table at set 1 while bindless is supported. Materials only differ in the texture index
+		// which is pushed as a constant, so they all share a single set 0 and switching them binds nothing.
+		// Slots of streamed textures are reused once no frame in flight can sample the old image anymore
+		vk::DescriptorSetLayout bindlessSetLayout;
+		vk::DescriptorPool bindlessDescriptorPool;
+		vk::DescriptorSet bindlessDescriptorSet;
+		uint32_t bindlessCapacity;
+		uint32_t bindlessIndexCount; // slots handed out so far, including free ones
+		std::vector<uint32_t> freeBindlessIndices;
+		struct RetiredBindlessIndex
+		{
+			uint32_t index;
+			uint64_t frame;
+		};
+		std::vector<RetiredBindlessIndex> retiredBindlessIndices;
+		static constexpr uint32_t MAX_BINDLESS_TEXTURES = 16 * 1024;
+		const char* fragmentShaderFile;
 		vk::PipelineLayout pipelineLayout;
-		vk::Pipeline graphicsPipeline;
+		vk::Pipeline graphicsPipeline; // owned by the pipeline cache
+		std::array<vk::Pipeline, VertexEncoding::VARIANT_COUNT> meshPipelines; // owned by the pipeline cache, indexed by VertexEncoding::getIndex()
+		vk::Pipeline instancedPipeline; // owned by the pipeline cache, created on first use
+		PipelineCache pipelineCache;
+		static constexpr const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+		// GPU driven rendering, created with the first object buffer
+		vk::DescriptorSetLayout cullSetLayout;
+		vk::DescriptorSetLayout objectSetLayout;
+		vk::PipelineLayout cullPipelineLayout;
+		vk::PipelineLayout indirectPipelineLayout; // set 0 is the material set, set 1 the texture table, set 2 the objects
+		vk::Pipeline cullPipeline; // owned by the pipeline cache
+		vk::Pipeline indirectPipeline; // owned by the pipeline cache
+		std::vector<ObjectBuffer*> objectBuffers;
+		bool cullValidation;
+		static constexpr uint32_t CULL_GROUP_SIZE = 64;
+		static constexpr uint64_t NOT_CULLED = UINT64_MAX;
 
 		vk::Image depthImage;
 		VmaAllocation depthImageAlloc;
@@ -181,33 +538,18 @@ namespace vesuvio {
 		//vk::Image textureImage;
 		//VmaAllocation textureImageAlloc;
 		//vk::ImageView textureImageView;
-		Texture* sampledImage;
+		TextureHandle sampledImage; // default albedo of materials
 		vk::Sampler textureSampler;
-		VertexBuffer* vb;
-		IndexBuffer* ib;
-		std::vector<vk::Buffer> uniformBuffers;
-		std::vector<VmaAllocation> uniformBufferAllocs;
-
-		const std::vector<const char*> deviceExtensions = {
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
-		};
-
-		const std::vector<Vertex> vertices = {
-			{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-			{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
-			{{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
-			{{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
-
-			{{-0.5f, -1.0f, 0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-			{{0.5f, -1.0f, 0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
-			{{0.5f, 0.0f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
-			{{-0.5f, 0.0f, 0.5f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
-		};
-
-		const std::vector<uint16_t> indices = {
-			0, 1, 2, 2, 3, 0,
-			4, 5, 6, 6, 7, 4
-		};
+		// textures whose level 0 has been uploaded and whose other levels are blitted at the start of the next frame
+		std::vector<Texture*> pendingMipGenerations;
+		// constants of all frames in flight, one region per frame
+		UniformRingBuffer uniformRingBuffer;
+		static constexpr vk::DeviceSize UNIFORM_RING_FRAME_SIZE = 4 * 1024 * 1024;
+		// instance streams of all frames in flight, offsets are multiples of sizeof(InstanceData) so they can be passed as firstInstance
+		UniformRingBuffer instanceRingBuffer;
+		static constexpr vk::DeviceSize INSTANCE_RING_FRAME_SIZE = MAX_INSTANCES_PER_FRAME * sizeof(InstanceData);
+
+		std::vector<const char*> deviceExtensions;
 
 		// vulkan debug
 		const std::vector<const char*> validationLayers = {
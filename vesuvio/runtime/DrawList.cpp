@@ -0,0 +1,57 @@
+#include "DrawList.hpp"
+
+#include <algorithm>
+
+namespace vesuvio {
+
+	void DrawList::add(const DrawCommand& draw, const glm::vec4& instanceParams) {
+		draws.push_back(draw);
+		params.push_back(instanceParams);
+		stats.draws++;
+	}
+
+	void DrawList::clear() {
+		draws.clear();
+		params.clear();
+		stats = Stats{};
+	}
+
+	void DrawList::submit(GfxContext* gfx) {
+		// Stable, so instances of a batch keep the order they were added in
+		order.resize(draws.size());
+		for (uint32_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return batchKey(draws[a]) < batchKey(draws[b]);
+		});
+
+		stats.batches = 0;
+		for (uint32_t begin = 0; begin < order.size();) {
+			const DrawCommand& first = draws[order[begin]];
+			const BatchKey key = batchKey(first);
+			uint32_t end = begin + 1;
+			while (end < order.size() && batchKey(draws[order[end]]) == key) {
+				end++;
+			}
+
+			gfx->setMaterial(first.material);
+			gfx->setMeshBuffers(first.vertexBuffer, first.indexBuffer);
+			// A single drawInstanced() can't take more than the per frame limit
+			for (uint32_t chunkBegin = begin; chunkBegin < end; chunkBegin += GfxContext::MAX_INSTANCES_PER_FRAME) {
+				const uint32_t chunkEnd = std::min(end, chunkBegin + GfxContext::MAX_INSTANCES_PER_FRAME);
+				instances.clear();
+				for (uint32_t i = chunkBegin; i < chunkEnd; i++) {
+					instances.push_back(InstanceData{ draws[order[i]].transform, params[order[i]] });
+				}
+				gfx->drawInstanced(first.indexCount, instances.data(), static_cast<uint32_t>(instances.size()), first.firstIndex, first.vertexOffset);
+				stats.batches++;
+			}
+			begin = end;
+		}
+	}
+
+	DrawList::BatchKey DrawList::batchKey(const DrawCommand& draw) {
+		return std::make_tuple(draw.material, draw.vertexBuffer, draw.indexBuffer, draw.indexCount, draw.firstIndex, draw.vertexOffset);
+	}
+}
\ No newline at end of file
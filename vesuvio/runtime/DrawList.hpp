@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <tuple>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "GfxContext.hpp"
+
+namespace vesuvio {
+	// Collects the draws of a frame and submits all draws of the same geometry with the same material
+	// as a single instanced draw, no matter in which order they were added.
+	// Batches above GfxContext::MAX_INSTANCES_PER_FRAME are split into several instanced draws
+	class DrawList
+	{
+	public:
+		struct Stats
+		{
+			uint32_t draws; // added since the last clear()
+			uint32_t batches; // instanced draws the last submit() recorded
+		};
+
+	public:
+		void add(const DrawCommand& draw, const glm::vec4& params = glm::vec4(1.0f));
+		void clear();
+		// Records into the current render pass, which must not be a parallel one
+		void submit(GfxContext* gfx);
+
+		Stats getStats() const { return stats; }
+
+	private:
+		// Draws with equal keys are instances of the same batch, the order of the keys groups them
+		using BatchKey = std::tuple<Material*, VertexBufferHandle, IndexBufferHandle, uint32_t, uint32_t, int32_t>;
+		static BatchKey batchKey(const DrawCommand& draw);
+
+	private:
+		std::vector<DrawCommand> draws;
+		std::vector<glm::vec4> params;
+		// scratch, kept to avoid allocations every frame
+		std::vector<uint32_t> order;
+		std::vector<InstanceData> instances;
+		Stats stats{};
+	};
+}
\ No newline at end of file
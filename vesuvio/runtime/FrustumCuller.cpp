@@ -0,0 +1,235 @@
+#include "FrustumCuller.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <algorithm>
+
+#include "JobSystem.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VSV_CULL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC emits AVX instructions for intrinsics without enabling them for the whole translation unit
+#define VSV_TARGET_AVX
+#else
+#define VSV_TARGET_AVX __attribute__((target("avx")))
+#endif
+#else
+#define VSV_CULL_X86 0
+#endif
+
+namespace vesuvio {
+
+#if VSV_CULL_X86
+	namespace {
+		// Index of the lowest set bit, mask must not be 0
+		inline uint32_t lowestBit(int mask) {
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, static_cast<unsigned long>(mask));
+			return static_cast<uint32_t>(index);
+#else
+			return static_cast<uint32_t>(__builtin_ctz(static_cast<unsigned int>(mask)));
+#endif
+		}
+	}
+#endif
+
+	FrustumCuller::FrustumCuller()
+	: objectCount(0)
+	, simdLevel(detectSimdLevel())
+	, stats()
+	{
+
+	}
+
+	uint32_t FrustumCuller::addObject(const glm::vec4& boundingSphere) {
+		centerX.push_back(boundingSphere.x);
+		centerY.push_back(boundingSphere.y);
+		centerZ.push_back(boundingSphere.z);
+		radius.push_back(boundingSphere.w);
+		return objectCount++;
+	}
+
+	void FrustumCuller::setObject(uint32_t index, const glm::vec4& boundingSphere) {
+		assert(index < objectCount);
+		centerX[index] = boundingSphere.x;
+		centerY[index] = boundingSphere.y;
+		centerZ[index] = boundingSphere.z;
+		radius[index] = boundingSphere.w;
+	}
+
+	void FrustumCuller::clear() {
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		radius.clear();
+		objectCount = 0;
+	}
+
+	void FrustumCuller::reserve(uint32_t objectCount) {
+		centerX.reserve(objectCount);
+		centerY.reserve(objectCount);
+		centerZ.reserve(objectCount);
+		radius.reserve(objectCount);
+	}
+
+	void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices, JobSystem* jobSystem) {
+		const uint32_t chunkCount = (objectCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		chunkVisible.resize(objectCount);
+		chunkVisibleCounts.assign(chunkCount, 0);
+		chunkSeconds.assign(chunkCount, 0.0);
+
+		// Every chunk writes to its own range, so no synchronization is needed until the results are compacted
+		auto cullChunks = [&](uint32_t begin, uint32_t end) {
+			for (uint32_t chunkBegin = begin; chunkBegin < end; chunkBegin += CHUNK_SIZE) {
+				const uint32_t chunk = chunkBegin / CHUNK_SIZE;
+				const uint32_t chunkEnd = std::min(chunkBegin + CHUNK_SIZE, end);
+				auto start = std::chrono::high_resolution_clock::now();
+				chunkVisibleCounts[chunk] = cullRange(frustum, chunkBegin, chunkEnd, chunkVisible.data() + chunkBegin);
+				auto finish = std::chrono::high_resolution_clock::now();
+				chunkSeconds[chunk] = std::chrono::duration<double, std::chrono::seconds::period>(finish - start).count();
+			}
+		};
+		if (jobSystem && chunkCount > 1) {
+			jobSystem->parallelFor(objectCount, CHUNK_SIZE, cullChunks);
+		}
+		else {
+			cullChunks(0, objectCount);
+		}
+
+		visibleIndices.clear();
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+			const uint32_t* chunkBegin = chunkVisible.data() + chunk * CHUNK_SIZE;
+			visibleIndices.insert(visibleIndices.end(), chunkBegin, chunkBegin + chunkVisibleCounts[chunk]);
+			stats.cullSeconds += chunkSeconds[chunk];
+		}
+		stats.objectsCulled += objectCount;
+		stats.objectsVisible += visibleIndices.size();
+	}
+
+	void FrustumCuller::setSimdLevel(SimdLevel level) {
+		simdLevel = std::min(level, detectSimdLevel());
+	}
+
+	FrustumCuller::SimdLevel FrustumCuller::detectSimdLevel() {
+#if VSV_CULL_X86
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		// The OS has to save the YMM registers as well
+		if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+			return SimdLevel::Avx;
+		}
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx")) {
+			return SimdLevel::Avx;
+		}
+#endif
+		// Part of every x86-64 CPU
+		return SimdLevel::Sse;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	uint32_t FrustumCuller::cullRange(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+		switch (simdLevel) {
+		case SimdLevel::Avx:
+			return cullRangeAvx(frustum, begin, end, out);
+		case SimdLevel::Sse:
+			return cullRangeSse(frustum, begin, end, out);
+		default:
+			return cullRangeScalar(frustum, begin, end, out);
+		}
+	}
+
+	uint32_t FrustumCuller::cullRangeScalar(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+		uint32_t visibleCount = 0;
+		for (uint32_t i = begin; i < end; i++) {
+			if (frustum.intersectsSphere(glm::vec4(centerX[i], centerY[i], centerZ[i], radius[i]))) {
+				out[visibleCount++] = i;
+			}
+		}
+		return visibleCount;
+	}
+
+#if VSV_CULL_X86
+	uint32_t FrustumCuller::cullRangeSse(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+		__m128 planes[6][4];
+		for (uint32_t p = 0; p < 6; p++) {
+			for (uint32_t c = 0; c < 4; c++) {
+				planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+			}
+		}
+
+		uint32_t visibleCount = 0;
+		uint32_t i = begin;
+		for (; i + 4 <= end; i += 4) {
+			const __m128 x = _mm_loadu_ps(&centerX[i]);
+			const __m128 y = _mm_loadu_ps(&centerY[i]);
+			const __m128 z = _mm_loadu_ps(&centerZ[i]);
+			const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; p++) {
+				__m128 distance = _mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y));
+				distance = _mm_add_ps(distance, _mm_mul_ps(planes[p][2], z));
+				distance = _mm_add_ps(distance, planes[p][3]);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+			int mask = _mm_movemask_ps(inside);
+			while (mask) {
+				out[visibleCount++] = i + lowestBit(mask);
+				mask &= mask - 1;
+			}
+		}
+		return visibleCount + cullRangeScalar(frustum, i, end, out + visibleCount);
+	}
+
+	VSV_TARGET_AVX
+	uint32_t FrustumCuller::cullRangeAvx(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+		__m256 planes[6][4];
+		for (uint32_t p = 0; p < 6; p++) {
+			for (uint32_t c = 0; c < 4; c++) {
+				planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+			}
+		}
+
+		uint32_t visibleCount = 0;
+		uint32_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			const __m256 x = _mm256_loadu_ps(&centerX[i]);
+			const __m256 y = _mm256_loadu_ps(&centerY[i]);
+			const __m256 z = _mm256_loadu_ps(&centerZ[i]);
+			const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+			// No FMA, so the results match the SSE and scalar paths exactly
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; p++) {
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(planes[p][2], z));
+				distance = _mm256_add_ps(distance, planes[p][3]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			}
+			int mask = _mm256_movemask_ps(inside);
+			while (mask) {
+				out[visibleCount++] = i + lowestBit(mask);
+				mask &= mask - 1;
+			}
+		}
+		return visibleCount + cullRangeSse(frustum, i, end, out + visibleCount);
+	}
+#else
+	uint32_t FrustumCuller::cullRangeSse(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+		return cullRangeScalar(frustum, begin, end, out);
+	}
+
+	uint32_t FrustumCuller::cullRangeAvx(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+		return cullRangeScalar(frustum, begin, end, out);
+	}
+#endif
+}
\ No newline at end of file
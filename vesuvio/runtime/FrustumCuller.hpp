@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+
+namespace vesuvio {
+	class JobSystem;
+
+	// CPU visibility determination for many objects.
+	// World space bounding spheres are stored as structure of arrays, so 4 (SSE) or 8 (AVX) objects are tested
+	// against a plane at once. The instruction set is picked at runtime, without SSE the scalar Frustum test is used.
+	// Large object counts are split into chunks which are culled in parallel on the job system.
+	class FrustumCuller
+	{
+	public:
+		enum class SimdLevel
+		{
+			Scalar,
+			Sse,
+			Avx,
+		};
+
+		struct Stats
+		{
+			uint64_t objectsCulled;
+			uint64_t objectsVisible;
+			double cullSeconds; // CPU time summed over all chunks, so throughput per core can be derived
+
+			double getObjectsPerMillisecondPerCore() const { return cullSeconds > 0.0 ? objectsCulled / (cullSeconds * 1000.0) : 0.0; }
+		};
+
+	public:
+		FrustumCuller();
+
+		// Returns the index the object is culled as
+		uint32_t addObject(const glm::vec4& boundingSphere);
+		void setObject(uint32_t index, const glm::vec4& boundingSphere);
+		void clear();
+		void reserve(uint32_t objectCount);
+		uint32_t getObjectCount() const { return objectCount; }
+
+		// Replaces visibleIndices with the indices of the objects intersecting the frustum in ascending order.
+		// jobSystem nullptr culls on the calling thread only
+		void cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices, JobSystem* jobSystem = nullptr);
+
+		// Requests above what the CPU supports are clamped
+		void setSimdLevel(SimdLevel level);
+		SimdLevel getSimdLevel() const { return simdLevel; }
+		static SimdLevel detectSimdLevel();
+
+		const Stats& getStats() const { return stats; }
+		void resetStats() { stats = Stats{}; }
+
+	private:
+		// Writes the visible indices of [begin, end) to out and returns how many there were
+		uint32_t cullRange(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const;
+		uint32_t cullRangeScalar(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const;
+		uint32_t cullRangeSse(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const;
+		uint32_t cullRangeAvx(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* out) const;
+
+	private:
+		std::vector<float> centerX;
+		std::vector<float> centerY;
+		std::vector<float> centerZ;
+		std::vector<float> radius;
+		uint32_t objectCount;
+		SimdLevel simdLevel;
+		Stats stats;
+
+		// Per chunk results, kept to avoid allocations every frame
+		std::vector<uint32_t> chunkVisible;
+		std::vector<uint32_t> chunkVisibleCounts;
+		std::vector<double> chunkSeconds;
+
+		// Multiple of the widest SIMD width, so only the last chunk has a scalar tail
+		static constexpr uint32_t CHUNK_SIZE = 4096;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "JobSystem.hpp"
+
+#include <cassert>
+#include <algorithm>
+
+namespace vesuvio {
+
+	namespace {
+		// Queue of the worker the current thread belongs to
+		thread_local const JobSystem* tlsJobSystem = nullptr;
+		thread_local uint32_t tlsQueueIndex = 0;
+	}
+
+	JobSystem::JobSystem()
+	: mainThreadId()
+	, queuedJobs(0)
+	, quit(false)
+	, jobsExecuted(0)
+	, jobsStolen(0)
+	{
+
+	}
+
+	JobSystem::~JobSystem() {
+		shutdown();
+	}
+
+	void JobSystem::init(uint32_t workerCount) {
+		assert(workers.empty());
+		if (workerCount == 0) {
+			const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		}
+
+		mainThreadId = std::this_thread::get_id();
+		quit = false;
+		queues.resize(workerCount + 1);
+		for (WorkerQueue*& queue : queues) {
+			queue = new WorkerQueue();
+		}
+		workers.reserve(workerCount);
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+		}
+
+		printf("Created job system with %u workers\n", workerCount);
+	}
+
+	void JobSystem::shutdown() {
+		if (workers.empty()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			quit = true;
+		}
+		sleepCondition.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+
+		for (WorkerQueue* queue : queues) {
+			assert(queue->jobs.empty() && "job system shut down with pending jobs");
+			delete queue;
+		}
+		queues.clear();
+
+		printf("Job system executed %llu jobs (%llu stolen)\n", (unsigned long long)jobsExecuted.load(), (unsigned long long)jobsStolen.load());
+	}
+
+	void JobSystem::run(JobFunc func, JobCounter* counter, JobCounter* dependency) {
+		if (counter) {
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Job job{ std::move(func), counter };
+		if (dependency) {
+			// finish() takes the continuations under the same lock after the counter has reached zero,
+			// so the job is either appended in time or the counter is already zero
+			std::unique_lock<std::mutex> lock(dependency->continuationMutex);
+			if (!dependency->isDone()) {
+				dependency->continuations.emplace_back(std::move(job.func), job.counter);
+				return;
+			}
+		}
+		schedule(std::move(job));
+	}
+
+	void JobSystem::runOnMainThread(JobFunc func, JobCounter* counter) {
+		if (counter) {
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		mainThreadJobs.push_back(Job{ std::move(func), counter });
+	}
+
+	void JobSystem::wait(JobCounter& counter) {
+		const uint32_t queueIndex = getQueueIndex();
+		const bool mainThread = isMainThread();
+		while (!counter.isDone()) {
+			if (mainThread) {
+				processMainThreadJobs();
+			}
+			if (!tryRunJob(queueIndex)) {
+				std::this_thread::yield();
+			}
+		}
+		// The last finish() still holds the lock, the counter must not be destroyed before it has released it
+		std::lock_guard<std::mutex> lock(counter.continuationMutex);
+	}
+
+	void JobSystem::processMainThreadJobs() {
+		assert(isMainThread());
+		std::vector<Job> jobs;
+		{
+			std::lock_guard<std::mutex> lock(mainThreadMutex);
+			jobs.swap(mainThreadJobs);
+		}
+		for (Job& job : jobs) {
+			execute(job);
+		}
+	}
+
+	void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& func) {
+		if (count == 0) {
+			return;
+		}
+		batchSize = std::max(batchSize, 1u);
+
+		JobCounter counter;
+		// The calling thread processes the first batch itself
+		for (uint32_t begin = batchSize; begin < count; begin += batchSize) {
+			const uint32_t end = std::min(begin + batchSize, count);
+			run([&func, begin, end]() { func(begin, end); }, &counter);
+		}
+		func(0, std::min(batchSize, count));
+		wait(counter);
+	}
+
+	JobSystem::Stats JobSystem::getStats() const {
+		Stats stats;
+		stats.jobsExecuted = jobsExecuted.load(std::memory_order_relaxed);
+		stats.jobsStolen = jobsStolen.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void JobSystem::workerLoop(uint32_t queueIndex) {
+		tlsJobSystem = this;
+		tlsQueueIndex = queueIndex;
+
+		while (true) {
+			if (tryRunJob(queueIndex)) {
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepCondition.wait(lock, [this]() { return quit || queuedJobs.load() > 0; });
+			if (quit) {
+				break;
+			}
+		}
+	}
+
+	void JobSystem::schedule(Job job) {
+		assert(!queues.empty() && "job system not initialized");
+		WorkerQueue* queue = queues[getQueueIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			queue->jobs.push_back(std::move(job));
+		}
+		queuedJobs.fetch_add(1);
+
+		// Taking the lock makes sure a worker which is about to sleep sees the new job
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		sleepCondition.notify_one();
+	}
+
+	bool JobSystem::tryRunJob(uint32_t queueIndex) {
+		Job job;
+		bool found = false;
+		{
+			WorkerQueue* queue = queues[queueIndex];
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			if (!queue->jobs.empty()) {
+				job = std::move(queue->jobs.back());
+				queue->jobs.pop_back();
+				found = true;
+			}
+		}
+
+		// Steal the oldest job of another queue, it is the most likely to spawn more work
+		const uint32_t queueCount = static_cast<uint32_t>(queues.size());
+		for (uint32_t i = 1; i < queueCount && !found; i++) {
+			WorkerQueue* queue = queues[(queueIndex + i) % queueCount];
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			if (!queue->jobs.empty()) {
+				job = std::move(queue->jobs.front());
+				queue->jobs.pop_front();
+				found = true;
+				jobsStolen.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (!found) {
+			return false;
+		}
+		queuedJobs.fetch_sub(1);
+		execute(job);
+		return true;
+	}
+
+	void JobSystem::execute(Job& job) {
+		job.func();
+		jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+		finish(job.counter);
+	}
+
+	void JobSystem::finish(JobCounter* counter) {
+		if (!counter) {
+			return;
+		}
+
+		std::vector<std::pair<JobFunc, JobCounter*>> continuations;
+		{
+			std::lock_guard<std::mutex> lock(counter->continuationMutex);
+			if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				continuations.swap(counter->continuations);
+			}
+		}
+		// The counter might be destroyed by a waiting thread from here on
+		for (auto& continuation : continuations) {
+			schedule(Job{ std::move(continuation.first), continuation.second });
+		}
+	}
+
+	uint32_t JobSystem::getQueueIndex() const {
+		return tlsJobSystem == this ? tlsQueueIndex : 0;
+	}
+}
\ No newline at end of file
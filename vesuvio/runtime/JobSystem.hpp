@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace vesuvio {
+	// Counts unfinished jobs, other jobs can wait on it or depend on it.
+	// Must not be destroyed before JobSystem::wait() has returned for it
+	class JobCounter
+	{
+	public:
+		JobCounter() : value(0) {}
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		bool isDone() const { return value.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> value;
+		// jobs which are scheduled once the counter reaches zero
+		std::mutex continuationMutex;
+		std::vector<std::pair<std::function<void()>, JobCounter*>> continuations;
+	};
+
+	// Work-stealing job scheduler.
+	// Every worker (and the main thread) owns a deque, new jobs are pushed to the deque of the calling thread,
+	// the owner pops from the back (LIFO keeps fork/join trees cache friendly) while idle workers steal from the front of other deques.
+	// Jobs which call into GLFW or other main thread only APIs are queued with runOnMainThread().
+	class JobSystem
+	{
+	public:
+		using JobFunc = std::function<void()>;
+
+		struct Stats
+		{
+			uint64_t jobsExecuted;
+			uint64_t jobsStolen;
+		};
+
+	public:
+		JobSystem();
+		~JobSystem();
+		// workerCount 0 uses one worker per hardware thread besides the main thread
+		void init(uint32_t workerCount = 0);
+		void shutdown();
+
+		// counter (optional) is incremented right away and decremented once the job has finished.
+		// The job is not started before dependency (optional) has reached zero.
+		void run(JobFunc func, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+		// Executed by processMainThreadJobs() or while the main thread waits
+		void runOnMainThread(JobFunc func, JobCounter* counter = nullptr);
+		// Executes other jobs until the counter has reached zero
+		void wait(JobCounter& counter);
+		// Must only be called from the main thread
+		void processMainThreadJobs();
+
+		// Splits [0, count) into batches of at most batchSize and returns once all of them have been processed
+		void parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& func);
+
+		uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+		Stats getStats() const;
+
+	private:
+		struct Job
+		{
+			JobFunc func;
+			JobCounter* counter;
+		};
+
+		struct WorkerQueue
+		{
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+	private:
+		void workerLoop(uint32_t queueIndex);
+		void schedule(Job job);
+		bool tryRunJob(uint32_t queueIndex);
+		void execute(Job& job);
+		void finish(JobCounter* counter);
+		uint32_t getQueueIndex() const;
+		bool isMainThread() const { return std::this_thread::get_id() == mainThreadId; }
+
+	private:
+		std::vector<std::thread> workers;
+		// index 0 belongs to the main thread (and every other thread which is no worker)
+		std::vector<WorkerQueue*> queues;
+		std::thread::id mainThreadId;
+
+		std::mutex mainThreadMutex;
+		std::vector<Job> mainThreadJobs;
+
+		std::atomic<uint32_t> queuedJobs;
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+		std::atomic<bool> quit;
+
+		std::atomic<uint64_t> jobsExecuted;
+		std::atomic<uint64_t> jobsStolen;
+	};
+}
\ No newline at end of file
@@ -15,8 +15,10 @@ namespace vesuvio {
 
 	Runtime::Runtime()
 		: updateFunc(nullptr)
+		, renderFunc(nullptr)
 		, window(nullptr)
 		, gfx(nullptr)
+		, exitRequested(false)
 	{
 			
 	}
@@ -28,24 +30,28 @@ namespace vesuvio {
 		}
 	}
 
-	void Runtime::init(WindowInit windowInit, GfxInit gfxInit, UpdateFunc updateFn) {
+	void Runtime::init(WindowInit windowInit, GfxInit gfxInit, UpdateFunc updateFn, RenderFunc renderFn) {
 		updateFunc = updateFn;
-
-		glfwInit();
-
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-		window = glfwCreateWindow((int)windowInit.width, (int)windowInit.height, windowInit.name, nullptr, nullptr);
-		assert(window);
-		glfwSetWindowUserPointer(window, this);
-		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		renderFunc = renderFn;
+		jobSystem.init();
+
+		if (!windowInit.headless) {
+			glfwInit();
+
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+			glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+			window = glfwCreateWindow((int)windowInit.width, (int)windowInit.height, windowInit.name, nullptr, nullptr);
+			assert(window);
+			glfwSetWindowUserPointer(window, this);
+			glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		}
 
 		if (gfxInit.gfxBackend == GfxContext::GfxBackend::None) {
 			gfx = new GfxContextNone();
 		}
 		else if (gfxInit.gfxBackend == GfxContext::GfxBackend::Vulkan) {
 			#if VSV_GFX_BACKEND(VULKAN)
-				gfx = new VulkanContext();
+				gfx = new VulkanContext(gfxInit.framesInFlight);
 			#else
 				assert(false && "Vulkan backend requested but not enabled in the gfx project");
 			#endif
@@ -58,19 +64,51 @@ namespace vesuvio {
 			#endif
 		}
 		assert(gfx);
-		gfx->init(windowInit.name, window);
+		// Before init, so the swap chain is created with the requested present mode
+		gfx->setPresentPolicy(gfxInit.presentPolicy);
+		// Parallel command recording runs on the job system's workers
+		gfx->setParallelFor([this](uint32_t taskCount, const std::function<void(uint32_t)>& task) {
+			JobCounter counter;
+			for (uint32_t i = 1; i < taskCount; i++) {
+				jobSystem.run([&task, i]() { task(i); }, &counter);
+			}
+			task(0);
+			jobSystem.wait(counter);
+		});
+		if (windowInit.headless) {
+			gfx->initHeadless(windowInit.name, windowInit.width, windowInit.height);
+		}
+		else {
+			gfx->init(windowInit.name, window);
+		}
 		gfxTest.init(gfx);
 	}
 
 	void Runtime::run() {
-		while (!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+		while (!exitRequested && !(window && glfwWindowShouldClose(window))) {
+			// Input is sampled as late as the present policy allows
+			gfx->waitForNextFrame();
+			if (window) {
+				glfwPollEvents();
+			}
+			jobSystem.processMainThreadJobs();
 			updateFunc(0.0f);
-			gfxTest.update();
-			gfx->update();
+			if (gfx->beginFrame()) {
+				if (renderFunc) {
+					renderFunc(gfx);
+				}
+				else {
+					gfxTest.update();
+				}
+				gfx->endFrame();
+			}
 		}
 	}
 
+	void Runtime::requestExit() {
+		exitRequested = true;
+	}
+
 	void Runtime::GfxTest::init(GfxContext* gfxContext) {
 		gfx = gfxContext;
 		const std::vector<Vertex> vertices = {
@@ -90,18 +128,25 @@ namespace vesuvio {
 			4, 5, 6, 6, 7, 4
 		};
 
-		vb = gfx->createVertexBuffer(vertices.data(), (uint16_t)vertices.size());
+		vb = gfx->createVertexBuffer(vertices.data(), (uint32_t)vertices.size());
 		ib = gfx->createIndexBuffer(indices.data(), (uint32_t)indices.size());
+		indexCount = static_cast<uint32_t>(indices.size());
+		material = gfx->createMaterial(TextureHandle());
 	}
 
 
 	void Runtime::GfxTest::cleanup() {
+		gfx->destroyMaterial(material);
 		gfx->destroyVertexBuffer(vb);
 		gfx->destroyIndexBuffer(ib);
 	}
 
 	void Runtime::GfxTest::update() {
-
+		gfx->beginRenderPass(nullptr);
+		gfx->setMaterial(material);
+		gfx->setMeshBuffers(vb, ib);
+		gfx->draw(indexCount);
+		gfx->endRenderPass();
 	}
 
 	void Runtime::framebufferResizeCallback(GLFWwindow* window, int width, int height) noexcept {
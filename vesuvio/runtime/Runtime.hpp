@@ -4,6 +4,7 @@
 
 //#define VSV_ENABLE_VULKAN
 #include "GfxContext.hpp"
+#include "JobSystem.hpp"
 
 struct GLFWwindow;
 
@@ -12,23 +13,33 @@ namespace vesuvio {
 	{
 	public:
 		using UpdateFunc = std::function<void(float frametime)>;
+		// Called between beginFrame() and endFrame(), the only place the frame's passes and draws can be recorded
+		using RenderFunc = std::function<void(GfxContext* gfx)>;
 		struct WindowInit
 		{
 			const char* name;
 			uint16_t width;
 			uint16_t height;
+			bool headless = false; // no window is created, frames are rendered offscreen (e.g. for CI or servers)
 		};
 
 		struct GfxInit
 		{
 			GfxContext::GfxBackend gfxBackend;
+			uint32_t framesInFlight = 2; // how many frames the CPU may record ahead of the GPU
+			GfxContext::PresentPolicy presentPolicy; // framesAhead can lower the frames in flight at runtime
 		};
 
 	public:
 		Runtime();
 		~Runtime();
-		void init(WindowInit windowInit, GfxInit gfxInit, UpdateFunc updateFn);
+		// Without a render function the built-in test geometry is drawn
+		void init(WindowInit windowInit, GfxInit gfxInit, UpdateFunc updateFn, RenderFunc renderFn = nullptr);
 		void run();
+		// Ends run() after the current frame, the only way to stop a headless runtime
+		void requestExit();
+		GfxContext* getGfxContext() const { return gfx; }
+		JobSystem& getJobSystem() { return jobSystem; }
 
 	private:
 		struct GfxTest
@@ -38,13 +49,18 @@ namespace vesuvio {
 			void update();
 			GfxContext* gfx;
 
-			VertexBuffer* vb;
-			IndexBuffer* ib;
+			VertexBufferHandle vb;
+			IndexBufferHandle ib;
+			uint32_t indexCount;
+			Material* material;
 		} gfxTest;
 		static void framebufferResizeCallback(GLFWwindow* window, int width, int height) noexcept;
 	private:
 		UpdateFunc updateFunc;
+		RenderFunc renderFunc;
 		GLFWwindow* window;
 		GfxContext* gfx;
+		bool exitRequested;
+		JobSystem jobSystem;
 	};
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "Application.hpp"
+
+#include <cstdio>
 //#include "vesuvio/gfx/GfxContext.hpp"
 
 namespace sample {
@@ -12,6 +14,7 @@ namespace sample {
 		window.height = height;
 		vesuvio::Runtime::GfxInit gfx;
 		gfx.gfxBackend = vesuvio::GfxContext::GfxBackend::Vulkan;
+		gfx.framesInFlight = 2;
 		vesuvio::Runtime::UpdateFunc updateFn = [&](float ft) { update(ft); };
 		runtime.init(window, gfx, updateFn);
 	}
@@ -24,7 +27,12 @@ namespace sample {
 	}
 
 	void Application::update(float frametime) {
-
+		frameCount++;
+		if (frameCount % GPU_TIMINGS_INTERVAL == 0) {
+			for (const vesuvio::GpuScopeTiming& timing : runtime.getGfxContext()->getGpuTimings()) {
+				printf("%*s%s: min %.3f ms, avg %.3f ms, max %.3f ms\n", timing.depth * 2, "", timing.name.c_str(), timing.minMs, timing.avgMs, timing.maxMs);
+			}
+		}
 	}
 
 	
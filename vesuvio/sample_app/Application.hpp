@@ -24,5 +24,7 @@ namespace sample {
 		const uint16_t height = 600;
 
 		vesuvio::Runtime runtime;
+		uint64_t frameCount = 0;
+		static constexpr uint64_t GPU_TIMINGS_INTERVAL = 1000; // frames between two printouts of the GPU timings
 	};
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 450
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+// per instance
+layout(location = 3) in mat4 inTransform;
+layout(location = 7) in vec4 inParams;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+    gl_Position = ubo.proj * ubo.view * inTransform * vec4(inPosition, 1.0);
+    fragColor = inColor * inParams.rgb;
+    fragTexCoord = inTexCoord;
+}
\ No newline at end of file
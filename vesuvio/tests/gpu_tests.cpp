@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Runtime.hpp"
+#include "VulkanContext.hpp"
+
+using namespace vesuvio;
+
+// Headless tests of the Vulkan backend, meant to run on a software device like lavapipe.
+// Usage: gpu_tests <test name>, returns 0 if the test passed
+
+static constexpr uint16_t TEST_WIDTH = 1920;
+static constexpr uint16_t TEST_HEIGHT = 1080;
+
+// Headless runtime which stops after frameCount frames, without a render function the runtime's test geometry is drawn
+static void initRuntime(Runtime& runtime, uint32_t framesInFlight, uint32_t frameCount, uint32_t& frame, Runtime::RenderFunc renderFn = nullptr) {
+	Runtime::WindowInit window;
+	window.name = "gpu_tests";
+	window.width = TEST_WIDTH;
+	window.height = TEST_HEIGHT;
+	window.headless = true;
+	Runtime::GfxInit gfx;
+	gfx.gfxBackend = GfxContext::GfxBackend::Vulkan;
+	gfx.framesInFlight = framesInFlight;
+	frame = 0;
+	runtime.init(window, gfx, [&runtime, &frame, frameCount](float) {
+		if (++frame == frameCount) {
+			runtime.requestExit();
+		}
+	}, renderFn);
+}
+
+// Renders frameCount frames of the runtime's test geometry and returns the backend's frame stats
+static VulkanContext::FrameStats renderFrames(uint32_t framesInFlight, uint32_t frameCount) {
+	Runtime runtime;
+	uint32_t frame;
+	initRuntime(runtime, framesInFlight, frameCount, frame);
+	runtime.run();
+	return static_cast<VulkanContext*>(runtime.getGfxContext())->getFrameStats();
+}
+
+// With two frames in flight the CPU has to start recording a frame while the GPU still renders the previous one,
+// with a single frame in flight it never may
+static bool testFrameOverlap() {
+	static constexpr uint32_t FRAME_COUNT = 300;
+	const VulkanContext::FrameStats serial = renderFrames(1, FRAME_COUNT);
+	const VulkanContext::FrameStats pipelined = renderFrames(2, FRAME_COUNT);
+	printf("1 frame in flight: %llu of %llu frames overlapped, %.3f s fence waits\n",
+		(unsigned long long)serial.overlappedFrames, (unsigned long long)serial.frameCount, serial.fenceWaitSeconds);
+	printf("2 frames in flight: %llu of %llu frames overlapped, %.3f s fence waits\n",
+		(unsigned long long)pipelined.overlappedFrames, (unsigned long long)pipelined.frameCount, pipelined.fenceWaitSeconds);
+	return serial.frameCount == FRAME_COUNT && pipelined.frameCount == FRAME_COUNT
+		&& serial.overlappedFrames == 0 && pipelined.overlappedFrames > 0;
+}
+
+// Culls a grid of objects around the moving camera on the GPU and compares every visible set with the CPU reference.
+// Many of the objects cross a frustum plane in some frame, the ones within the validation tolerance are not compared
+static bool testCullValidation() {
+	static constexpr uint32_t FRAME_COUNT = 200;
+	static constexpr int GRID_SIZE = 16;
+	Runtime runtime;
+	uint32_t frame;
+	ObjectBuffer* objectBuffer = nullptr;
+	Material* material = nullptr;
+	initRuntime(runtime, 2, FRAME_COUNT, frame, [&](GfxContext* gfx) {
+		gfx->cullObjects(objectBuffer);
+		gfx->beginRenderPass(nullptr);
+		gfx->drawObjects(objectBuffer, material);
+		gfx->endRenderPass();
+	});
+
+	VulkanContext* vulkan = static_cast<VulkanContext*>(runtime.getGfxContext());
+	vulkan->setCullValidation(true);
+	objectBuffer = vulkan->createObjectBuffer(GRID_SIZE * GRID_SIZE * GRID_SIZE);
+	if (!objectBuffer) {
+		printf("The device can't draw indirectly, the GPU culling can't be tested\n");
+		return false;
+	}
+	const Vertex vertices[] = {
+		{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+		{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+		{{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+		{{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
+	};
+	const uint16_t indices[] = { 0, 1, 2, 2, 3, 0 };
+	const VertexBufferHandle vb = vulkan->createVertexBuffer(vertices, 4);
+	const IndexBufferHandle ib = vulkan->createIndexBuffer(indices, 6);
+	material = vulkan->createMaterial(TextureHandle());
+
+	std::vector<DrawObject> objects;
+	for (int x = 0; x < GRID_SIZE; x++) {
+		for (int y = 0; y < GRID_SIZE; y++) {
+			for (int z = 0; z < GRID_SIZE; z++) {
+				DrawObject object{};
+				object.vertexBuffer = vb;
+				object.indexBuffer = ib;
+				object.transform = glm::mat4(1.0f);
+				object.transform[3] = glm::vec4(glm::vec3(x - GRID_SIZE / 2, y - GRID_SIZE / 2, z - GRID_SIZE / 2) * 0.75f, 1.0f);
+				object.boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, 0.71f);
+				object.indexCount = 6;
+				objects.push_back(object);
+			}
+		}
+	}
+	vulkan->setObjects(objectBuffer, objects.data(), static_cast<uint32_t>(objects.size()));
+	runtime.run();
+
+	const VulkanContext::CullStats& stats = vulkan->getCullStats();
+	printf("%llu culls validated, %llu mismatches, %llu of %llu objects visible\n",
+		(unsigned long long)stats.validatedCulls, (unsigned long long)stats.validationMismatches,
+		(unsigned long long)stats.visibleObjects, (unsigned long long)stats.culledObjects);
+	const bool passed = stats.validatedCulls > 0 && stats.validationMismatches == 0
+		&& stats.visibleObjects > 0 && stats.visibleObjects < stats.culledObjects;
+
+	vulkan->destroyObjectBuffer(objectBuffer);
+	vulkan->destroyMaterial(material);
+	vulkan->destroyVertexBuffer(vb);
+	vulkan->destroyIndexBuffer(ib);
+	return passed;
+}
+
+struct Test
+{
+	const char* name;
+	bool (*run)();
+};
+
+static const Test TESTS[] = {
+	{ "frame_overlap", testFrameOverlap },
+	{ "cull_validation", testCullValidation },
+};
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("Usage: gpu_tests <test>\n");
+		for (const Test& test : TESTS) {
+			printf("  %s\n", test.name);
+		}
+		return 1;
+	}
+	for (const Test& test : TESTS) {
+		if (strcmp(test.name, argv[1]) == 0) {
+			const bool passed = test.run();
+			printf("%s: %s\n", test.name, passed ? "passed" : "FAILED");
+			return passed ? 0 : 1;
+		}
+	}
+	printf("Unknown test %s\n", argv[1]);
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "MeshProcessing.hpp"
+#include "MeshFile.hpp"
+
+using namespace vesuvio;
+
+// Converts Wavefront OBJ files into the memory mapped .vsm mesh format.
+// Supported: v (with optional vertex colors), vt, f (polygons are triangulated as fans), everything else is ignored.
+struct ObjMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<Mesh::Remainder> remainders;
+	std::vector<uint32_t> indices;
+};
+
+static int32_t resolveObjIndex(int32_t index, size_t count) {
+	// 1 based, negative indices are relative to the end
+	return index < 0 ? static_cast<int32_t>(count) + index : index - 1;
+}
+
+static bool loadObj(const std::string& fileName, ObjMesh& mesh) {
+	std::ifstream file(fileName);
+	if (!file.is_open()) {
+		printf("'%s' could not be opened\n", fileName.data());
+		return false;
+	}
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> colors;
+	std::vector<glm::vec2> texCoords;
+	// (position, texCoord) -> vertex
+	std::unordered_map<uint64_t, uint32_t> vertexLookup;
+	std::vector<uint32_t> polygon;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream stream(line);
+		std::string type;
+		stream >> type;
+
+		if (type == "v") {
+			glm::vec3 position(0.0f);
+			glm::vec3 color(1.0f);
+			stream >> position.x >> position.y >> position.z;
+			if (!(stream >> color.r >> color.g >> color.b)) {
+				color = glm::vec3(1.0f);
+			}
+			positions.push_back(position);
+			colors.push_back(color);
+		}
+		else if (type == "vt") {
+			glm::vec2 texCoord(0.0f);
+			stream >> texCoord.x >> texCoord.y;
+			// OBJ has its origin at the bottom left
+			texCoord.y = 1.0f - texCoord.y;
+			texCoords.push_back(texCoord);
+		}
+		else if (type == "f") {
+			polygon.clear();
+			std::string corner;
+			while (stream >> corner) {
+				int32_t positionIndex = 0;
+				int32_t texCoordIndex = 0;
+				const size_t slash = corner.find('/');
+				positionIndex = resolveObjIndex(atoi(corner.c_str()), positions.size());
+				if (slash != std::string::npos && slash + 1 < corner.size() && corner[slash + 1] != '/') {
+					texCoordIndex = resolveObjIndex(atoi(corner.c_str() + slash + 1), texCoords.size());
+				}
+				else {
+					texCoordIndex = -1;
+				}
+				if (positionIndex < 0 || positionIndex >= static_cast<int32_t>(positions.size()) || texCoordIndex >= static_cast<int32_t>(texCoords.size())) {
+					printf("'%s' references a missing vertex: %s\n", fileName.data(), line.data());
+					return false;
+				}
+
+				const uint64_t key = static_cast<uint64_t>(positionIndex) << 32 | static_cast<uint32_t>(texCoordIndex);
+				auto it = vertexLookup.find(key);
+				if (it == vertexLookup.end()) {
+					it = vertexLookup.emplace(key, static_cast<uint32_t>(mesh.positions.size())).first;
+					Mesh::Remainder remainder;
+					remainder.color = colors[positionIndex];
+					remainder.texCoord = texCoordIndex >= 0 ? texCoords[texCoordIndex] : glm::vec2(0.0f);
+					mesh.positions.push_back(positions[positionIndex]);
+					mesh.remainders.push_back(remainder);
+				}
+				polygon.push_back(it->second);
+			}
+
+			for (size_t i = 2; i < polygon.size(); i++) {
+				mesh.indices.push_back(polygon[0]);
+				mesh.indices.push_back(polygon[i - 1]);
+				mesh.indices.push_back(polygon[i]);
+			}
+		}
+	}
+
+	printf("Loaded '%s' (%zu vertices, %zu triangles)\n", fileName.data(), mesh.positions.size(), mesh.indices.size() / 3);
+	return !mesh.indices.empty();
+}
+
+// Compares mapping the file against reading it into a heap buffer, both followed by the copy into (simulated) staging memory
+static void benchmarkLoad(const std::string& fileName, uint32_t iterations) {
+	std::vector<uint8_t> staging;
+	double mappedSeconds = 0.0;
+	double readSeconds = 0.0;
+	uint64_t bytes = 0;
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		MeshFile meshFile;
+		if (!meshFile.open(fileName)) {
+			return;
+		}
+		const MeshFile::StreamType types[] = { MeshFile::StreamType::Positions, MeshFile::StreamType::Remainders, MeshFile::StreamType::Indices };
+		bytes = 0;
+		for (MeshFile::StreamType type : types) {
+			const uint64_t size = meshFile.getStreamSize(type);
+			staging.resize(size);
+			memcpy(staging.data(), meshFile.getStreamData(type), size);
+			bytes += size;
+		}
+		meshFile.close();
+		auto mid = std::chrono::high_resolution_clock::now();
+
+		std::ifstream file(fileName, std::ios::ate | std::ios::binary);
+		std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(buffer.data(), buffer.size());
+		staging.resize(buffer.size());
+		memcpy(staging.data(), buffer.data(), buffer.size());
+		auto end = std::chrono::high_resolution_clock::now();
+
+		mappedSeconds += std::chrono::duration<double, std::chrono::seconds::period>(mid - start).count();
+		readSeconds += std::chrono::duration<double, std::chrono::seconds::period>(end - mid).count();
+	}
+
+	const double megabytes = static_cast<double>(bytes) * iterations / (1024.0 * 1024.0);
+	printf("Load throughput over %u iterations: mapped %.1f MB/s, read into heap %.1f MB/s\n",
+		   iterations, megabytes / mappedSeconds, megabytes / readSeconds);
+}
+
+static void printUsage() {
+	printf("Usage: mesh_converter <input.obj> <output.vsm> [--quantize] [--no-optimize] [--bench <iterations>]\n");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		printUsage();
+		return 1;
+	}
+
+	const std::string inputFileName = argv[1];
+	const std::string outputFileName = argv[2];
+	MeshProcessingSettings settings;
+	uint32_t benchIterations = 0;
+	for (int i = 3; i < argc; i++) {
+		if (strcmp(argv[i], "--quantize") == 0) {
+			settings.encoding = VertexEncoding::quantized();
+		}
+		else if (strcmp(argv[i], "--no-optimize") == 0) {
+			settings.optimizeVertexCache = false;
+			settings.optimizeOverdraw = false;
+			settings.optimizeVertexFetch = false;
+		}
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			benchIterations = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+
+	ObjMesh objMesh;
+	if (!loadObj(inputFileName, objMesh)) {
+		return 1;
+	}
+
+	MeshProcessingReport report;
+	const ProcessedMesh processedMesh = processMesh(
+		objMesh.positions.data(), objMesh.remainders.data(), static_cast<uint32_t>(objMesh.positions.size()),
+		objMesh.indices.data(), static_cast<uint32_t>(objMesh.indices.size()),
+		settings, &report
+	);
+	report.print();
+
+	if (!MeshFile::write(outputFileName, processedMesh)) {
+		return 1;
+	}
+	printf("Wrote '%s'\n", outputFileName.data());
+
+	if (benchIterations > 0) {
+		benchmarkLoad(outputFileName, benchIterations);
+	}
+	return 0;
+}
\ No newline at end of file